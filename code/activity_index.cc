@@ -0,0 +1,224 @@
+#include "activity_index.h"
+
+#include "conversion_cache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+using namespace std::chrono;
+
+namespace {
+
+const char* INDEX_HEADER = "# activity index";
+
+uint64_t sum_abs_diff_scalar(const uint8_t* a, const uint8_t* b, size_t n) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < n; ++i) {
+        sum += a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+    }
+    return sum;
+}
+
+#if defined(__AVX2__)
+
+// 32 bytes per iteration, psadbw leaves four 64 bit partial sums
+uint64_t sum_abs_diff(const uint8_t* a, const uint8_t* b, size_t n) {
+    __m256i acc = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        const __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        const __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+        acc = _mm256_add_epi64(acc, _mm256_sad_epu8(va, vb));
+    }
+    const __m128i half = _mm_add_epi64(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    const uint64_t sum = static_cast<uint64_t>(_mm_cvtsi128_si64(half)) + static_cast<uint64_t>(_mm_extract_epi64(half, 1));
+    return sum + sum_abs_diff_scalar(a + i, b + i, n - i);
+}
+
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+
+// 16 bytes per iteration, widened pairwise into 32 bit lanes (a row of a proxy can't overflow them)
+uint64_t sum_abs_diff(const uint8_t* a, const uint8_t* b, size_t n) {
+    uint32x4_t acc = vdupq_n_u32(0);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const uint8x16_t diff = vabdq_u8(vld1q_u8(a + i), vld1q_u8(b + i));
+        acc = vpadalq_u16(acc, vpaddlq_u8(diff));
+    }
+    return vaddvq_u32(acc) + sum_abs_diff_scalar(a + i, b + i, n - i);
+}
+
+#else
+
+uint64_t sum_abs_diff(const uint8_t* a, const uint8_t* b, size_t n) {
+    return sum_abs_diff_scalar(a, b, n);
+}
+
+#endif
+
+// The first score is always 0, it isn't a difference
+double score_percentile(const std::vector<float>& scores, double percentile) {
+    if (scores.size() < 2) return 0.0;
+    std::vector<float> values(scores.begin() + 1, scores.end());
+    const size_t rank = std::min(values.size() - 1, static_cast<size_t>(percentile / 100.0 * values.size()));
+    std::nth_element(values.begin(), values.begin() + rank, values.end());
+    return values[rank];
+}
+
+} // namespace
+
+bool ActivityIndex::save(const std::string& path) const {
+    std::error_code ec;
+    const std::filesystem::path parent = std::filesystem::path(path).parent_path();
+    if (!parent.empty()) {
+        std::filesystem::create_directories(parent, ec);
+    }
+
+    const std::string temp_path = path + ".tmp";
+    {
+        std::ofstream file(temp_path, std::ios::trunc);
+        file << INDEX_HEADER << '\n' << "key\t" << key << '\n' << "fps\t" << fps << '\n';
+        file << std::fixed << std::setprecision(3);
+        for (float score : scores) {
+            file << score << '\n';
+        }
+        if (!file) {
+            std::cout << "Failed to save the activity index " << path << std::endl;
+            return false;
+        }
+    }
+    std::filesystem::rename(temp_path, path, ec);
+    return !ec;
+}
+
+bool ActivityIndex::load(const std::string& path) {
+    std::ifstream file(path);
+    std::string line;
+    if (!std::getline(file, line) || line != INDEX_HEADER) return false;
+
+    key.clear();
+    fps = 0.0;
+    scores.clear();
+    while (std::getline(file, line)) {
+        if (line.compare(0, 4, "key\t") == 0) {
+            key = line.substr(4);
+        }
+        else if (line.compare(0, 4, "fps\t") == 0) {
+            fps = std::atof(line.c_str() + 4);
+        }
+        else if (!line.empty()) {
+            scores.push_back(std::strtof(line.c_str(), nullptr));
+        }
+    }
+    return !key.empty() && fps > 0.0;
+}
+
+double frame_difference(const ImageView& a, const ImageView& b) {
+    if (a.empty() || a.width != b.width || a.height != b.height) return 0.0;
+
+    const size_t row_bytes = static_cast<size_t>(a.width) * 3;
+    uint64_t sum = 0;
+    for (int y = 0; y < a.height; ++y) {
+        sum += sum_abs_diff(a.row(y), b.row(y), row_bytes);
+    }
+    return static_cast<double>(sum) / (static_cast<double>(row_bytes) * a.height);
+}
+
+bool scan_activity(EquirectFrameSource& source, ActivityIndex& index, std::string& error) {
+    if (!source.open()) {
+        error = "failed to open the scan source " + source.error();
+        return false;
+    }
+
+    const SourceInfo info = source.info();
+    index.fps = info.fps;
+    index.scores.clear();
+    if (info.frames > 0) index.scores.reserve(info.frames);
+
+    // Two frames swapped every read, nothing is copied
+    Image frames[2] = { Image(info.width, info.height), Image(info.width, info.height) };
+    for (uint64_t frame = 0; source.read(frames[frame & 1].view()); ++frame) {
+        index.scores.push_back(frame == 0 ? 0.0f : static_cast<float>(frame_difference(frames[frame & 1].view(), frames[~frame & 1].view())));
+    }
+
+    error = source.error();
+    if (!error.empty()) return false;
+    if (index.scores.empty()) {
+        error = "the scan produced no frame";
+        return false;
+    }
+    return true;
+}
+
+std::vector<FrameRange> active_ranges(const ActivityIndex& index, const ActivitySettings& settings, double* threshold_used) {
+    const double threshold = settings.threshold > 0.0
+        ? settings.threshold
+        : std::max(settings.min_threshold, score_percentile(index.scores, settings.noise_percentile) + settings.noise_margin);
+    if (threshold_used) *threshold_used = threshold;
+
+    const double fps = index.fps > 0.0 ? index.fps : 30.0;
+    const uint64_t padding = static_cast<uint64_t>(settings.padding_seconds * fps);
+    const uint64_t frames = index.scores.size();
+
+    // One range per active stretch, padded, merge_frame_ranges clamps them and closes the short gaps
+    std::vector<FrameRange> ranges;
+    for (uint64_t frame = 0; frame < frames; ++frame) {
+        if (index.scores[frame] <= threshold) continue;
+
+        const uint64_t begin = frame > padding ? frame - padding : 0;
+        const uint64_t end = frame + 1 + padding;
+        if (!ranges.empty() && begin <= ranges.back().end) {
+            ranges.back().end = end;
+        }
+        else {
+            ranges.push_back({ begin, end });
+        }
+    }
+    return merge_frame_ranges(ranges, frames, static_cast<uint64_t>(settings.merge_gap_seconds * fps));
+}
+
+bool load_or_scan_activity(const std::vector<std::string>& input_paths, const StitchOptions& options,
+                           const ActivitySettings& settings, const std::string& path, bool force, ActivityIndex& index) {
+    const StitchOptions proxy = proxy_stitch_options(options, settings.scan_width, settings.scan_height);
+    const std::string key = ConversionCache::make_key(input_paths, proxy);
+
+    if (!force && index.load(path) && index.key == key) {
+        std::cout << "Activity index: " << path << " (" << index.scores.size() << " frames, not scanned again)" << std::endl;
+        return true;
+    }
+
+    std::cout << "Scanning activity at " << settings.scan_width << "x" << settings.scan_height << "..." << std::endl;
+    auto start = steady_clock::now();
+
+    StitcherSpoolSource source(input_paths, proxy);
+    std::string error;
+    index = ActivityIndex();
+    if (!scan_activity(source, index, error)) {
+        std::cout << "Activity scan failed: " << error << std::endl;
+        return false;
+    }
+    index.key = key;
+
+    const double seconds = duration<double>(steady_clock::now() - start).count();
+    std::ostringstream line;
+    line << std::fixed << std::setprecision(1) << "Scanned " << index.scores.size() << " frames in " << seconds
+         << " s (" << (seconds > 0.0 ? index.scores.size() / seconds : 0.0) << " fps)";
+    std::cout << line.str() << std::endl;
+
+    if (index.save(path)) {
+        std::cout << "Activity index saved to " << path << std::endl;
+    }
+    return true;
+}
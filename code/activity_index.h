@@ -0,0 +1,48 @@
+#pragma once
+
+#include "frame_source.h"
+#include "range_stitch.h"
+#include "stitch_options.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct ActivitySettings {
+    int scan_width = 256;          // size of the proxy stitch the scan differences
+    int scan_height = 128;
+    double threshold = 0.0;        // mean absolute difference (0-255) above which a frame is active, 0 -> automatic
+    double noise_percentile = 10.0; // automatic threshold: this percentile of the scores is the still scene noise,
+                                    // a recording is rarely busy for more than 90% of its length
+    double noise_margin = 1.0;     // automatic threshold: this much above the noise
+    double min_threshold = 1.0;    // floor of the automatic threshold
+    double padding_seconds = 3.0;  // kept before and after every active stretch
+    double merge_gap_seconds = 5.0; // idle gaps shorter than this are kept too
+};
+
+// Motion score of every frame of a recording: the mean absolute difference with the previous frame
+// of a small proxy stitch. Saved next to the output so re-runs don't scan again
+struct ActivityIndex {
+    std::string key; // ConversionCache::make_key of the inputs and the scan settings
+    double fps = 0.0;
+    std::vector<float> scores; // one per frame, the first one is 0
+
+    // Written through a temp file and renamed
+    bool save(const std::string& path) const;
+    bool load(const std::string& path);
+};
+
+// Mean absolute difference per byte of two images of the same size (SAD, AVX2/NEON when available)
+double frame_difference(const ImageView& a, const ImageView& b);
+
+// Scores every frame the source produces
+bool scan_activity(EquirectFrameSource& source, ActivityIndex& index, std::string& error);
+
+// Frames worth stitching: every frame above the threshold, padded and with short idle gaps merged.
+// threshold_used gets the threshold actually applied when not null
+std::vector<FrameRange> active_ranges(const ActivityIndex& index, const ActivitySettings& settings, double* threshold_used = nullptr);
+
+// The index saved at path when it was made from the same inputs and scan size, otherwise a template
+// stitch at scan_width x scan_height is scanned and the result saved there
+bool load_or_scan_activity(const std::vector<std::string>& input_paths, const StitchOptions& options,
+                           const ActivitySettings& settings, const std::string& path, bool force, ActivityIndex& index);
@@ -0,0 +1,244 @@
+#include "auto_tune.h"
+#include "ffmpeg.h"
+#include "mp4_info.h"
+#include "stitch_job.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+
+#ifdef WIN32
+#include <Windows.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+
+// A candidate slower than this many times the best one so far is cancelled, it can't win anyway
+const double GIVE_UP_FACTOR = 3.0;
+const double GIVE_UP_MARGIN_SECONDS = 10.0;
+// Of the requested bitrate, or of the reference candidate's output when none is
+const double REQUESTED_BITRATE_FLOOR = 0.8;
+const double REFERENCE_BITRATE_FLOOR = 0.5;
+
+std::string host_name() {
+#ifdef WIN32
+    const char* name = std::getenv("COMPUTERNAME");
+    return name ? name : "unknown";
+#else
+    char name[256] = { 0 };
+    if (gethostname(name, sizeof(name) - 1) != 0) return "unknown";
+    return name;
+#endif
+}
+
+// host \t input size \t output size \t stitch type, the columns that decide what is fastest
+std::string tuning_key(const Mp4Info& input, const StitchOptions& options) {
+    std::ostringstream key;
+    key << host_name() << '\t' << input.width << 'x' << input.height << '\t'
+        << options.output_width << 'x' << options.output_height << '\t' << static_cast<int>(options.stitch_type);
+    return key.str();
+}
+
+std::string describe(const TunedCodec& codec) {
+    std::ostringstream out;
+    out << (codec.enable_H265_encoder ? "h265" : "h264")
+        << " cuda=" << (codec.enable_cuda ? "on" : "off")
+        << " decode=" << (codec.enable_soft_decode ? "soft" : "hw")
+        << " encode=" << (codec.enable_soft_encode ? "soft" : "hw");
+    return out.str();
+}
+
+std::map<std::string, TunedCodec> load_cache(const std::string& path) {
+    std::map<std::string, TunedCodec> cache;
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line)) {
+        // The key is the first four columns
+        size_t split = std::string::npos;
+        for (int i = 0; i < 4; ++i) {
+            split = line.find('\t', split == std::string::npos ? 0 : split + 1);
+            if (split == std::string::npos) break;
+        }
+        if (split == std::string::npos) continue;
+
+        std::istringstream values(line.substr(split + 1));
+        TunedCodec codec;
+        if (!(values >> codec.enable_cuda >> codec.enable_soft_decode >> codec.enable_soft_encode
+                     >> codec.enable_H265_encoder >> codec.fps)) continue;
+        // Missing in caches written before the floor was saved
+        if (!(values >> codec.min_bitrate)) codec.min_bitrate = 0;
+        cache[line.substr(0, split)] = codec;
+    }
+    return cache;
+}
+
+void save_cache(const std::string& path, const std::map<std::string, TunedCodec>& cache) {
+    std::error_code ec;
+    const std::filesystem::path parent = std::filesystem::path(path).parent_path();
+    if (!parent.empty()) {
+        std::filesystem::create_directories(parent, ec);
+    }
+
+    const std::string temp_path = path + ".tmp";
+    {
+        std::ofstream file(temp_path, std::ios::trunc);
+        file << std::fixed << std::setprecision(2);
+        for (const auto& [key, codec] : cache) {
+            file << key << '\t' << codec.enable_cuda << '\t' << codec.enable_soft_decode << '\t'
+                 << codec.enable_soft_encode << '\t' << codec.enable_H265_encoder << '\t' << codec.fps << '\t' << codec.min_bitrate << '\n';
+        }
+        if (!file) {
+            std::cout << "Failed to save the tuning cache " << path << std::endl;
+            return;
+        }
+    }
+    std::filesystem::rename(temp_path, path, ec);
+}
+
+std::vector<TunedCodec> candidates() {
+    std::vector<TunedCodec> result;
+    for (bool h265 : { false, true }) {
+        for (bool cuda : { true, false }) {
+            for (bool soft_decode : { false, true }) {
+                for (bool soft_encode : { false, true }) {
+                    TunedCodec codec;
+                    codec.enable_cuda = cuda;
+                    codec.enable_soft_decode = soft_decode;
+                    codec.enable_soft_encode = soft_encode;
+                    codec.enable_H265_encoder = h265;
+                    result.push_back(codec);
+                }
+            }
+        }
+    }
+    return result;
+}
+
+} // namespace
+
+void TunedCodec::apply(StitchOptions& options) const {
+    options.enable_cuda = enable_cuda;
+    options.enable_soft_decode = enable_soft_decode;
+    options.enable_soft_encode = enable_soft_encode;
+    options.enable_H265_encoder = enable_H265_encoder;
+}
+
+bool auto_tune(const std::vector<std::string>& input_paths, StitchOptions& options, const AutoTuneSettings& settings) {
+    if (input_paths.size() != 2) return false;
+
+    const Mp4Info input = read_mp4_info(input_paths[0]);
+    if (!input.valid || input.fps <= 0.0) {
+        std::cout << "auto tune: can't read " << input_paths[0] << std::endl;
+        return false;
+    }
+
+    // < 0: set by the reference candidate
+    int64_t min_bitrate = settings.min_bitrate;
+    if (min_bitrate < 0 && options.output_bitrate > 0) {
+        min_bitrate = static_cast<int64_t>(options.output_bitrate * REQUESTED_BITRATE_FLOOR);
+    }
+
+    const std::string key = tuning_key(input, options);
+    std::map<std::string, TunedCodec> cache = load_cache(settings.cache_path);
+    auto cached = cache.find(key);
+    if (!settings.recalibrate && cached != cache.end()) {
+        if (cached->second.min_bitrate >= min_bitrate) {
+            cached->second.apply(options);
+            std::cout << "auto tune: using " << describe(cached->second) << " (" << cached->second.fps
+                      << " fps, " << cached->second.min_bitrate / 1000 << " kbit/s floor when calibrated)" << std::endl;
+            return true;
+        }
+        std::cout << "auto tune: the cached choice was made against a " << cached->second.min_bitrate / 1000
+                  << " kbit/s floor, below " << min_bitrate / 1000 << " kbit/s, calibrating again" << std::endl;
+    }
+
+    // Calibration window: the start of both lens files, keeping their names, cut into .insv pieces the
+    // stitcher takes (trailer included)
+    const uint64_t frames = std::min<uint64_t>(settings.calibration_frames, input.frame_count);
+    std::error_code ec;
+    const std::filesystem::path work_dir = std::filesystem::temp_directory_path(ec) / ("insv_autotune_" + host_name());
+    std::filesystem::remove_all(work_dir, ec);
+    std::filesystem::create_directories(work_dir, ec);
+
+    std::vector<std::string> window;
+    for (const auto& path : input_paths) {
+        const std::string piece = (work_dir / std::filesystem::path(path).filename()).string();
+        if (!ffmpeg_copy_range(path, piece, 0, frames)) {
+            std::filesystem::remove_all(work_dir, ec);
+            return false;
+        }
+        window.push_back(piece);
+    }
+
+    std::cout << "auto tune: calibrating on " << frames << " frames";
+    if (min_bitrate >= 0) std::cout << ", " << min_bitrate / 1000 << " kbit/s floor";
+    std::cout << std::endl;
+
+    StitchExecutor executor(1, 1);
+    TunedCodec best;
+    double best_seconds = 0.0;
+
+    for (TunedCodec codec : candidates()) {
+        StitchJobSpec spec;
+        spec.input_paths = window;
+        spec.output_path = (work_dir / "calibration.mp4").string();
+        spec.options = options;
+        spec.options.image_sequence_dir.clear();
+        codec.apply(spec.options);
+        if (best_seconds > 0.0) {
+            spec.timeout_seconds = best_seconds * GIVE_UP_FACTOR + GIVE_UP_MARGIN_SECONDS;
+        }
+
+        const StitchResult result = executor.submit(spec)->wait();
+        const uint64_t output_bytes = std::filesystem::file_size(spec.output_path, ec);
+        const int64_t bitrate = ec ? 0 : static_cast<int64_t>(output_bytes * 8 * input.fps / std::max<uint64_t>(frames, 1));
+        std::filesystem::remove(spec.output_path, ec);
+
+        std::cout << "  " << std::left << std::setw(40) << describe(codec) << std::right;
+        if (!result.ok) {
+            std::cout << "failed: " << result.error_info << std::endl;
+            continue;
+        }
+
+        codec.fps = result.wall_seconds > 0.0 ? frames / result.wall_seconds : 0.0;
+        std::cout << std::fixed << std::setprecision(1) << std::setw(8) << codec.fps << " fps"
+                  << std::setw(10) << bitrate / 1000 << " kbit/s";
+        if (min_bitrate < 0) {
+            // Candidates come h264 with hardware codecs first, the SDK's defaults
+            min_bitrate = static_cast<int64_t>(bitrate * REFERENCE_BITRATE_FLOOR);
+            std::cout << "  reference, sets the floor to " << min_bitrate / 1000 << " kbit/s";
+        }
+        if (bitrate < min_bitrate) {
+            std::cout << "  below the " << min_bitrate / 1000 << " kbit/s floor" << std::endl;
+            continue;
+        }
+        std::cout << std::endl;
+
+        if (codec.fps > best.fps) {
+            best = codec;
+            best_seconds = result.wall_seconds;
+        }
+    }
+
+    std::filesystem::remove_all(work_dir, ec);
+
+    if (best.fps <= 0.0) {
+        std::cout << "auto tune: no candidate worked, keeping the given settings" << std::endl;
+        return false;
+    }
+
+    best.apply(options);
+    best.min_bitrate = min_bitrate;
+    cache[key] = best;
+    save_cache(settings.cache_path, cache);
+    std::cout << "auto tune: picked " << describe(best) << " (" << best.fps << " fps, "
+              << min_bitrate / 1000 << " kbit/s floor)" << std::endl;
+    return true;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "stitch_options.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct AutoTuneSettings {
+    std::string cache_path;          // tuning results of every machine, tab separated
+    uint64_t calibration_frames = 300;
+    int64_t min_bitrate = -1;        // bits/s a candidate's output must reach, < 0 -> 80% of -bitrate if given,
+                                     // else half of what the first working candidate produces
+    bool recalibrate = false;        // ignore the cached choice
+};
+
+// Codec settings that only change how fast the stitch runs, not what it produces (h265 aside)
+struct TunedCodec {
+    bool enable_cuda = true;
+    bool enable_soft_decode = false;
+    bool enable_soft_encode = false;
+    bool enable_H265_encoder = false;
+    double fps = 0.0; // calibration throughput
+    int64_t min_bitrate = 0; // bits/s floor it was picked against
+
+    void apply(StitchOptions& options) const;
+};
+
+// Picks the fastest combination of cuda on/off, software/hardware decode and encode and h264/h265
+// for this machine, input resolution, output size and stitch type, and writes it into options.
+//
+// The choice is read from the cache when there is one. Otherwise the first calibration_frames of the
+// inputs are cut by stream copy and stitched with every candidate, one after the other. Candidates that
+// fail (a missing hardware encoder) or produce less than min_bitrate are discarded, and the winner is
+// saved for the next runs with its floor; a cached choice made against a lower floor than the one asked
+// for is calibrated again. With neither a floor nor a bitrate, the first candidate that works (h264 with the
+// SDK's default bitrate, cuda and hardware codecs unless they fail) sets it: a candidate whose encoder
+// ignores the bitrate and produces less than half of that is discarded.
+// Returns false, leaving options untouched, if no candidate works
+bool auto_tune(const std::vector<std::string>& input_paths, StitchOptions& options, const AutoTuneSettings& settings);
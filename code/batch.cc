@@ -0,0 +1,189 @@
+#include "batch.h"
+#include "conversion_cache.h"
+#include "ffmpeg.h"
+#include "stitch_job.h"
+#include "stitch_runner.h"
+#include "stitch_telemetry.h"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+
+namespace {
+
+uintmax_t input_size(const BatchJob& job) {
+    uintmax_t total = 0;
+    for (const auto& path : job.input_paths) {
+        std::error_code ec;
+        const uintmax_t size = std::filesystem::file_size(path, ec);
+        if (!ec) total += size;
+    }
+    return total;
+}
+
+std::string job_name(const BatchJob& job) {
+    return std::filesystem::path(job.output_path).filename().string();
+}
+
+} // namespace
+
+int run_batch(std::vector<BatchJob> jobs, const StitchOptions& options, const BatchSettings& settings) {
+    if (jobs.empty()) {
+        std::cout << "No insta360 pairs to stitch" << std::endl;
+        return -1;
+    }
+
+    // Largest recordings first so a long job never ends up alone at the tail of the batch
+    std::vector<std::pair<uintmax_t, BatchJob>> sorted;
+    for (auto& job : jobs) {
+        const uintmax_t size = input_size(job);
+        sorted.emplace_back(size, std::move(job));
+    }
+    std::stable_sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+
+    const int workers = std::max(1, std::min(settings.max_jobs, static_cast<int>(sorted.size())));
+
+    // One manifest per output directory, shared by the jobs
+    std::map<std::string, std::unique_ptr<ConversionCache>> caches;
+    for (const auto& entry : sorted) {
+        const std::string manifest = default_manifest_path(entry.second.output_path);
+        if (!caches.count(manifest)) {
+            caches[manifest] = std::make_unique<ConversionCache>(manifest);
+        }
+    }
+
+    std::vector<StitchResult> results(sorted.size());
+    std::mutex output_mutex;
+
+    std::cout << "Stitching " << sorted.size() << " recordings with " << workers << " workers" << std::endl;
+
+    auto start_time = std::chrono::steady_clock::now();
+    {
+        StitchExecutor executor(workers, settings.max_hw_sessions);
+        std::vector<std::shared_ptr<StitchJob>> submitted;
+
+        for (size_t i = 0; i < sorted.size(); ++i) {
+            const BatchJob& job = sorted[i].second;
+            const std::string name = job_name(job);
+
+            StitchJobSpec spec;
+            spec.input_paths = job.input_paths;
+            spec.output_path = job.output_path;
+            spec.options = options;
+            spec.timeout_seconds = settings.timeout_seconds;
+
+            spec.on_start = [&, name, inputs = job.input_paths] {
+                if (settings.telemetry) {
+                    settings.telemetry->begin_job(name, stitch_frame_count(inputs, options));
+                }
+                std::lock_guard<std::mutex> lck(output_mutex);
+                std::cout << "start stitch " << name << std::endl;
+            };
+            if (settings.telemetry) {
+                spec.on_progress = [&, name](int progress) { settings.telemetry->progress(name, progress); };
+            }
+            spec.on_finished = [&, name](StitchResult& result) {
+                if (settings.telemetry) {
+                    settings.telemetry->end_job(name, result);
+                }
+                std::lock_guard<std::mutex> lck(output_mutex);
+                if (result.ok) {
+                    std::cout << "end stitch " << name << std::endl;
+                }
+                else {
+                    std::cout << "error stitching " << name << ": " << result.error_info << std::endl;
+                }
+            };
+
+            ConversionCache& cache = *caches[default_manifest_path(job.output_path)];
+            submitted.push_back(submit_stitch_cached(executor, cache, std::move(spec), settings.force));
+        }
+
+        for (size_t i = 0; i < submitted.size(); ++i) {
+            results[i] = submitted[i]->wait();
+        }
+    }
+    const double batch_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+
+    // Per job summary
+    int failed = 0;
+    uint64_t total_frames = 0;
+
+    std::cout << std::endl << "Batch summary:" << std::endl;
+    for (size_t i = 0; i < sorted.size(); ++i) {
+        const StitchResult& result = results[i];
+        std::cout << std::left << std::setw(48) << job_name(sorted[i].second)
+                  << std::setw(8) << (result.cached ? "cached" : result.ok ? "ok" : "FAILED")
+                  << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(10) << result.wall_seconds << " s"
+                  << std::setw(10) << result.frames << " frames"
+                  << std::setw(10) << result.fps() << " fps" << std::endl;
+
+        if (!result.ok) {
+            ++failed;
+            std::cout << "    error " << result.error << ": " << result.error_info << std::endl;
+        }
+        total_frames += result.frames;
+    }
+
+    std::cout << sorted.size() - failed << "/" << sorted.size() << " recordings stitched in "
+              << batch_seconds << " s (" << (batch_seconds > 0.0 ? total_frames / batch_seconds : 0.0) << " fps overall)" << std::endl;
+
+    // Long recordings: the stitched file segments are joined in order by stream copy
+    std::map<std::string, std::vector<std::pair<int, size_t>>> joins;
+    for (size_t i = 0; i < sorted.size(); ++i) {
+        const BatchJob& job = sorted[i].second;
+        if (!job.joined_path.empty()) {
+            joins[job.joined_path].emplace_back(job.segment, i);
+        }
+    }
+
+    int failed_joins = 0;
+    for (auto& [joined_path, parts] : joins) {
+        std::sort(parts.begin(), parts.end());
+
+        bool all_ok = true;
+        bool all_cached = true;
+        std::vector<ConcatPart> concat;
+        for (const auto& part : parts) {
+            all_ok = all_ok && results[part.second].ok;
+            all_cached = all_cached && results[part.second].cached;
+            ConcatPart concat_part;
+            concat_part.path = sorted[part.second].second.output_path;
+            concat.push_back(concat_part);
+        }
+
+        std::error_code ec;
+        if (!all_ok) {
+            std::cout << "Not joining " << joined_path << ", some of its segments failed" << std::endl;
+            ++failed_joins;
+            continue;
+        }
+        if (all_cached && !settings.force && std::filesystem::exists(joined_path, ec)) {
+            std::cout << "Up to date: " << joined_path << std::endl;
+            continue;
+        }
+
+        const std::filesystem::path joined(joined_path);
+        const std::string temp_path = (joined.parent_path() / (joined.stem().string() + ".partial" + joined.extension().string())).string();
+        if (!ffmpeg_concat(concat, temp_path)) {
+            std::filesystem::remove(temp_path, ec);
+            ++failed_joins;
+            continue;
+        }
+        std::filesystem::rename(temp_path, joined_path, ec);
+        if (ec) {
+            std::cout << "Failed to move the joined output to " << joined_path << ": " << ec.message() << std::endl;
+            ++failed_joins;
+            continue;
+        }
+        std::cout << "Joined " << parts.size() << " segments into " << joined_path << std::endl;
+    }
+
+    return failed || failed_joins ? -1 : 0;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "stitch_options.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class StitchTelemetry;
+
+struct BatchJob {
+    std::vector<std::string> input_paths; // the _00_ and _10_ files of one recording
+    std::string output_path;
+
+    // Set on the file segments of a long recording: once every job with the same joined_path is
+    // stitched, their outputs are concatenated into it in segment order
+    std::string joined_path;
+    int segment = 0;
+};
+
+struct BatchSettings {
+    int max_jobs = 2;         // VideoStitcher jobs running at the same time
+    int max_hw_sessions = 1;  // jobs allowed to hold a hardware decoder/encoder at the same time
+    bool force = false;       // stitch even when the conversion manifest says the output is up to date
+    double timeout_seconds = 0.0; // a job stitching for longer is cancelled, 0 -> no limit
+    StitchTelemetry* telemetry = nullptr; // records every job when set
+};
+
+// Stitches every job on a StitchExecutor with max_jobs slots, largest recordings first.
+// A failing job doesn't stop the rest. Prints a per job summary at the end and
+// returns 0 only if every job succeeded
+int run_batch(std::vector<BatchJob> jobs, const StitchOptions& options, const BatchSettings& settings);
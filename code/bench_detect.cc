@@ -0,0 +1,126 @@
+// Throughput of the native detection stage: one inference run per cube face (what the per view loop
+// of track-goalkeeper.py does) against every face of several frames packed in one batch.
+// bench_detect.py times the python loop on the same views for the comparison.
+// Build: g++ -O2 -mavx2 -std=c++17 -I<onnxruntime>/include bench_detect.cc object_detector.cc equirect_remap.cc thread_pool.cc
+//          -L<onnxruntime>/lib -lonnxruntime -lpthread
+// The model has to be exported with a dynamic batch axis for the batched run to batch anything:
+//   yolo export model=yolov8n.pt format=onnx dynamic=True
+#include "equirect_remap.h"
+#include "object_detector.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std::chrono;
+
+const int OUTPUT_WIDTH = 640;
+const int OUTPUT_HEIGHT = 480;
+const double FOV = 90;
+
+// Average milliseconds per call after a warm up run
+double time_ms(int iterations, const std::function<void()>& fn) {
+    fn();
+    auto start = steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        fn();
+    }
+    return duration_cast<duration<double, std::milli>>(steady_clock::now() - start).count() / iterations;
+}
+
+// Smooth pattern so the network sees something image like, the detections themselves don't matter
+void fill_frame(const ImageView& frame, int seed) {
+    for (int y = 0; y < frame.height; ++y) {
+        uint8_t* row = frame.row(y);
+        for (int x = 0; x < frame.width; ++x) {
+            row[x * 3 + 0] = static_cast<uint8_t>(128 + 100 * std::sin((x + seed * 7) * 0.013));
+            row[x * 3 + 1] = static_cast<uint8_t>(128 + 100 * std::sin(y * 0.021 + seed));
+            row[x * 3 + 2] = static_cast<uint8_t>((x ^ y) & 0xff);
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    DetectorSettings settings;
+    int frames = 8;
+    int iterations = 5;
+
+    for (int i = 1; i < argc; i++) {
+        if (std::string("-model") == std::string(argv[i])) {
+            settings.model_path = argv[++i];
+        }
+        else if (std::string("-frames") == std::string(argv[i])) {
+            frames = std::atoi(argv[++i]);
+        }
+        else if (std::string("-iterations") == std::string(argv[i])) {
+            iterations = std::atoi(argv[++i]);
+        }
+        else if (std::string("-threads") == std::string(argv[i])) {
+            settings.threads = std::atoi(argv[++i]);
+        }
+    }
+
+    const auto& views = default_views();
+    settings.max_batch = frames * static_cast<int>(views.size());
+
+    ObjectDetector detector(settings);
+    if (!detector.ok()) {
+        std::cout << "error: " << detector.error() << std::endl;
+        return -1;
+    }
+
+    // Cube faces of `frames` different equirect frames
+    Image equirect(1920, 960);
+    EquirectRemapper remapper(views, FOV, OUTPUT_WIDTH, OUTPUT_HEIGHT);
+    std::vector<Image> faces(frames * views.size());
+    std::vector<DetectorInput> inputs;
+    for (int f = 0; f < frames; ++f) {
+        fill_frame(equirect.view(), f);
+        std::vector<ImageView> outputs;
+        for (size_t v = 0; v < views.size(); ++v) {
+            Image& face = faces[f * views.size() + v];
+            face.resize(OUTPUT_WIDTH, OUTPUT_HEIGHT);
+            outputs.push_back(face.view());
+
+            DetectorInput input;
+            input.image = face.view();
+            input.frame = f;
+            input.fov_deg = FOV;
+            input.yaw_deg = views[v].yaw_deg;
+            input.pitch_deg = views[v].pitch_deg;
+            inputs.push_back(input);
+        }
+        remapper.process(equirect.view(), outputs);
+    }
+
+    size_t per_view_detections = 0;
+    const double per_view = time_ms(iterations, [&] {
+        per_view_detections = 0;
+        for (const auto& input : inputs) {
+            per_view_detections += detector.detect({ input }).size();
+        }
+    });
+
+    size_t batched_detections = 0;
+    const double batched = time_ms(iterations, [&] { batched_detections = detector.detect(inputs).size(); });
+
+    if (!detector.ok()) {
+        std::cout << "error: " << detector.error() << std::endl;
+        return -1;
+    }
+
+    std::cout << std::fixed << std::setprecision(2)
+              << frames << " frames x " << views.size() << " faces of " << OUTPUT_WIDTH << "x" << OUTPUT_HEIGHT
+              << ", network input " << detector.input_size() << ", batch " << detector.batch_size() << std::endl
+              << "  one run per face   " << std::setw(8) << per_view / frames << " ms/frame  "
+              << std::setw(8) << 1000.0 * frames / per_view << " fps  (" << per_view_detections << " detections)" << std::endl
+              << "  batched            " << std::setw(8) << batched / frames << " ms/frame  "
+              << std::setw(8) << 1000.0 * frames / batched << " fps  (" << batched_detections << " detections, "
+              << per_view / batched << "x)" << std::endl;
+    return 0;
+}
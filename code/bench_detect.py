@@ -0,0 +1,65 @@
+"""
+Per view detection loop of track-goalkeeper.py on the same synthetic cube faces as bench_detect.cc,
+the baseline of the native batched detection stage.
+
+Usage: python bench_detect.py [model] [frames]
+The model defaults to yolov8n.pt. Passing the .onnx file benchmarks ultralytics on ONNX Runtime,
+the same backend as the native stage
+"""
+import sys
+import time
+
+import numpy as np
+from EquirectProcessor import EquirectProcessor
+from ultralytics import YOLO
+
+VIEWS = {
+    "right": (90, 0),
+    "back": (180, 0),
+    "left": (270, 0),
+    "front": (0, 0),
+}
+OUTPUT_SIZE = (640, 480)
+FOV = 90
+ITERATIONS = 5
+
+
+def synthetic_frame(seed, width=1920, height=960):
+    """Same pattern bench_detect.cc fills its frames with"""
+    x = np.arange(width)[None, :]
+    y = np.arange(height)[:, None]
+    frame = np.empty((height, width, 3), dtype=np.uint8)
+    frame[..., 0] = (128 + 100 * np.sin((x + seed * 7) * 0.013)).astype(np.uint8)
+    frame[..., 1] = (128 + 100 * np.sin(y * 0.021 + seed)).astype(np.uint8)
+    frame[..., 2] = (x ^ y) & 0xff
+    return frame
+
+
+model_path = sys.argv[1] if len(sys.argv) > 1 else 'yolov8n.pt'
+frames = int(sys.argv[2]) if len(sys.argv) > 2 else 8
+
+processor = EquirectProcessor(VIEWS, FOV, OUTPUT_SIZE, use_gpu=False, num_workers=1)
+processor.precompute_mappings(synthetic_frame(0).shape)
+faces = [view for f in range(frames) for view in processor.process_frame(synthetic_frame(f))]
+
+model = YOLO(model_path, task='detect')
+
+
+def run():
+    detections = 0
+    for view in faces:
+        for result in model(view, verbose=False):
+            for box in result.boxes:
+                if box.cls.item() in (0, 32) and box.conf.item() > 0.75:
+                    detections += 1
+    return detections
+
+
+run()  # warm up
+start = time.time()
+for _ in range(ITERATIONS):
+    detections = run()
+elapsed = (time.time() - start) / ITERATIONS
+
+print(f"{frames} frames x {len(VIEWS)} faces, {model_path}")
+print(f"  python per view loop {elapsed * 1000 / frames:8.2f} ms/frame {frames / elapsed:8.2f} fps  ({detections} detections)")
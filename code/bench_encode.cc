@@ -0,0 +1,111 @@
+// Encoder sink of the reframed video: the mp4v cv::VideoWriter output track-goalkeeper.py and the
+// pipeline used to write against libx264/libx265 through libavcodec, on the same reframed frames.
+// Build: g++ -O2 -mavx2 -std=c++17 bench_encode.cc video_encoder.cc frame_source.cc frame_ring.cc chunked_output.cc mp4_info.cc
+//          ffmpeg.cc stitch_job.cc stitch_runner.cc stitch_backend.cc stitch_options.cc stitch_telemetry.cc -DNO_INSTA360_SDK
+//          -lavformat -lavcodec -lavutil -lopencv_core -lopencv_imgcodecs -lopencv_imgproc -lopencv_videoio -lpthread
+#include "frame_source.h"
+#include "video_encoder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std::chrono;
+
+int main(int argc, char* argv[]) {
+    int width = 1280;
+    int height = 720;
+    double fps = 30.0;
+    int frames = 300;
+    std::string codecs = "mp4v,libx264,libx265";
+    std::string output_dir = "/tmp/encode_bench";
+    EncoderSettings settings;
+
+    for (int i = 1; i < argc; i++) {
+        if (std::string("-frames") == std::string(argv[i])) {
+            frames = std::atoi(argv[++i]);
+        }
+        else if (std::string("-codecs") == std::string(argv[i])) {
+            codecs = argv[++i];
+        }
+        else if (std::string("-preset") == std::string(argv[i])) {
+            settings.preset = argv[++i];
+        }
+        else if (std::string("-crf") == std::string(argv[i])) {
+            settings.crf = std::atoi(argv[++i]);
+        }
+        else if (std::string("-threads") == std::string(argv[i])) {
+            settings.threads = std::atoi(argv[++i]);
+        }
+        else if (std::string("-output_dir") == std::string(argv[i])) {
+            output_dir = argv[++i];
+        }
+    }
+
+    // Rendered once, so only the encoders are timed
+    SyntheticEquirectSource source(width, height, fps, frames);
+    std::vector<Image> inputs(frames);
+    for (auto& input : inputs) {
+        input.resize(width, height);
+        source.read(input.view());
+    }
+
+    // Conversion alone, the SIMD part of the sink
+    {
+        std::vector<uint8_t> yuv(static_cast<size_t>(width) * height * 3 / 2);
+        auto start = steady_clock::now();
+        for (auto& input : inputs) {
+            bgr_to_yuv420(input.view(), yuv.data(), width, yuv.data() + width * height, width / 2,
+                          yuv.data() + width * height * 5 / 4, width / 2);
+        }
+        const double ms = duration<double, std::milli>(steady_clock::now() - start).count() / frames;
+        std::cout << std::fixed << std::setprecision(2) << width << "x" << height << " BGR -> YUV 4:2:0: "
+                  << ms << " ms/frame" << std::endl;
+    }
+
+    std::error_code ec;
+    std::filesystem::create_directories(output_dir, ec);
+
+    std::istringstream list(codecs);
+    std::string codec;
+    while (std::getline(list, codec, ',')) {
+        settings.codec = codec;
+        const std::string path = (std::filesystem::path(output_dir) / (codec + ".mp4")).string();
+
+        auto start = steady_clock::now();
+        EncoderStats stats;
+        {
+            VideoEncoder encoder(path, width, height, fps, settings);
+            if (!encoder.ok()) {
+                std::cout << "  " << std::setw(8) << codec << "  " << encoder.error() << std::endl;
+                continue;
+            }
+            for (auto& input : inputs) {
+                FrameSlot* slot = encoder.acquire();
+                if (!slot) break;
+                const ImageView src = input.view();
+                std::memcpy(slot->image.view().data, src.data, src.size_bytes());
+                encoder.submit(slot);
+            }
+            if (!encoder.finish()) {
+                std::cout << "  " << std::setw(8) << codec << "  " << encoder.error() << std::endl;
+                continue;
+            }
+            stats = encoder.stats();
+        }
+        const double wall = duration<double>(steady_clock::now() - start).count();
+
+        std::cout << "  " << std::setw(8) << codec << "  " << std::setw(8) << frames / wall << " fps  "
+                  << std::setw(10) << stats.bitrate_kbps() << " kbit/s  (" << stats.bytes / 1024 << " KiB, "
+                  << stats.convert_seconds * 1000.0 / std::max<uint64_t>(stats.frames, 1) << " ms/frame converting)" << std::endl;
+        std::filesystem::remove(path, ec);
+    }
+    return 0;
+}
@@ -0,0 +1,164 @@
+// Microbenchmark of the native remap engine against the OpenCV path used by EquirectProcessor.py
+// Build: g++ -O2 -mavx2 -std=c++17 bench_remap.cc equirect_remap.cc thread_pool.cc `pkg-config --cflags --libs opencv4`
+#include "equirect_remap.h"
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std::chrono;
+
+const int OUTPUT_WIDTH = 640;
+const int OUTPUT_HEIGHT = 480;
+const double FOV = 90;
+
+// Average milliseconds per frame after a warm up run
+double time_ms(int iterations, const std::function<void()>& fn) {
+    fn();
+    auto start = steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        fn();
+    }
+    return duration_cast<duration<double, std::milli>>(steady_clock::now() - start).count() / iterations;
+}
+
+void bench_size(int src_width, int src_height, int iterations, unsigned threads) {
+    cv::Mat frame(src_height, src_width, CV_8UC3);
+    cv::randu(frame, cv::Scalar::all(0), cv::Scalar::all(255));
+    cv::GaussianBlur(frame, frame, cv::Size(5, 5), 0);
+
+    const auto& views = default_views();
+
+    // Same float maps the python code feeds to cv2.remap
+    std::vector<cv::Mat> uf(views.size()), vf(views.size()), fixed_xy(views.size()), fixed_w(views.size());
+    for (size_t v = 0; v < views.size(); ++v) {
+        uf[v].create(OUTPUT_HEIGHT, OUTPUT_WIDTH, CV_32F);
+        vf[v].create(OUTPUT_HEIGHT, OUTPUT_WIDTH, CV_32F);
+        compute_view_map(src_width, src_height, FOV, views[v].yaw_deg, views[v].pitch_deg,
+                         OUTPUT_WIDTH, OUTPUT_HEIGHT, uf[v].ptr<float>(), vf[v].ptr<float>());
+        cv::convertMaps(uf[v], vf[v], fixed_xy[v], fixed_w[v], CV_16SC2);
+    }
+
+    std::vector<cv::Mat> cv_outputs(views.size());
+    const double opencv_float = time_ms(iterations, [&] {
+        for (size_t v = 0; v < views.size(); ++v) {
+            cv::remap(frame, cv_outputs[v], uf[v], vf[v], cv::INTER_LINEAR, cv::BORDER_WRAP);
+        }
+    });
+
+    const double opencv_fixed = time_ms(iterations, [&] {
+        for (size_t v = 0; v < views.size(); ++v) {
+            cv::remap(frame, cv_outputs[v], fixed_xy[v], fixed_w[v], cv::INTER_LINEAR, cv::BORDER_WRAP);
+        }
+    });
+
+    ImageView src{ frame.data, frame.cols, frame.rows, frame.step };
+    std::vector<Image> outputs(views.size());
+    std::vector<ImageView> output_views;
+    for (auto& output : outputs) {
+        output.resize(OUTPUT_WIDTH, OUTPUT_HEIGHT);
+        output_views.push_back(output.view());
+    }
+
+    EquirectRemapper single(views, FOV, OUTPUT_WIDTH, OUTPUT_HEIGHT, 1);
+    single.precompute_mappings(src.width, src.height, src.stride);
+    const double native_single = time_ms(iterations, [&] { single.process(src, output_views); });
+
+    EquirectRemapper remapper(views, FOV, OUTPUT_WIDTH, OUTPUT_HEIGHT, threads);
+    remapper.precompute_mappings(src.width, src.height, src.stride);
+    const double native = time_ms(iterations, [&] { remapper.process(src, output_views); });
+
+    // Largest difference against the float OpenCV result, the fixed point fractions allow a few levels
+    double max_diff = 0.0;
+    for (size_t v = 0; v < views.size(); ++v) {
+        cv::remap(frame, cv_outputs[v], uf[v], vf[v], cv::INTER_LINEAR, cv::BORDER_WRAP);
+        cv::Mat native_output(OUTPUT_HEIGHT, OUTPUT_WIDTH, CV_8UC3, output_views[v].data, output_views[v].stride);
+        cv::Mat abs_diff;
+        cv::absdiff(native_output, cv_outputs[v], abs_diff);
+        double diff = 0.0;
+        cv::minMaxLoc(abs_diff.reshape(1), nullptr, &diff);
+        max_diff = std::max(max_diff, diff);
+    }
+
+    std::cout << std::fixed << std::setprecision(2)
+              << src_width << "x" << src_height << " -> " << views.size() << " x " << OUTPUT_WIDTH << "x" << OUTPUT_HEIGHT << std::endl
+              << "  opencv remap (float maps)   " << std::setw(8) << opencv_float << " ms" << std::endl
+              << "  opencv remap (fixed maps)   " << std::setw(8) << opencv_fixed << " ms" << std::endl
+              << "  native, 1 thread            " << std::setw(8) << native_single << " ms" << std::endl
+              << "  native, " << std::setw(2) << remapper.pool().size() << " threads          " << std::setw(8) << native << " ms"
+              << "  (" << opencv_float / native << "x)" << std::endl
+              << "  max abs diff vs opencv      " << std::setw(8) << max_diff << std::endl;
+}
+
+// The reframed output of a moving camera: a new lookup table every frame against the pitch keyed
+// map cache with the yaw applied while sampling
+void bench_dynamic_view(int src_width, int src_height, int frames) {
+    cv::Mat frame(src_height, src_width, CV_8UC3);
+    cv::randu(frame, cv::Scalar::all(0), cv::Scalar::all(255));
+    cv::GaussianBlur(frame, frame, cv::Size(5, 5), 0);
+    ImageView src{ frame.data, frame.cols, frame.rows, frame.step };
+
+    Image rebuilt(OUTPUT_WIDTH, OUTPUT_HEIGHT), cached(OUTPUT_WIDTH, OUTPUT_HEIGHT);
+
+    // A slow pan with a small tilt, a few degrees per second like the goalkeeper view
+    auto yaw_at = [](int f) { return 30.0 * std::sin(f / 120.0); };
+    auto pitch_at = [](int f) { return -8.0 + 3.0 * std::sin(f / 200.0); };
+
+    auto start = steady_clock::now();
+    for (int f = 0; f < frames; ++f) {
+        const RemapLut lut = build_remap_lut(src_width, src_height, src.stride, FOV, yaw_at(f), pitch_at(f), OUTPUT_WIDTH, OUTPUT_HEIGHT);
+        remap_rows(src, lut, rebuilt.view(), 0, OUTPUT_HEIGHT);
+    }
+    const double per_frame_lut = duration_cast<duration<double, std::milli>>(steady_clock::now() - start).count() / frames;
+
+    ViewMapCache cache;
+    start = steady_clock::now();
+    for (int f = 0; f < frames; ++f) {
+        const auto map = cache.get(src_width, src_height, src.stride, FOV, pitch_at(f), OUTPUT_WIDTH, OUTPUT_HEIGHT);
+        remap_rows_yaw(src, *map, yaw_at(f), cached.view(), 0, OUTPUT_HEIGHT);
+    }
+    const double per_frame_cached = duration_cast<duration<double, std::milli>>(steady_clock::now() - start).count() / frames;
+
+    // The last frame rendered both ways, the difference is the pitch quantization
+    cv::Mat a(OUTPUT_HEIGHT, OUTPUT_WIDTH, CV_8UC3, rebuilt.view().data, rebuilt.view().stride);
+    cv::Mat b(OUTPUT_HEIGHT, OUTPUT_WIDTH, CV_8UC3, cached.view().data, cached.view().stride);
+    cv::Mat abs_diff;
+    cv::absdiff(a, b, abs_diff);
+    const double mean_diff = cv::mean(abs_diff.reshape(1))[0];
+
+    std::cout << std::fixed << std::setprecision(2)
+              << src_width << "x" << src_height << " -> moving " << OUTPUT_WIDTH << "x" << OUTPUT_HEIGHT << " view, " << frames << " frames" << std::endl
+              << "  lookup table every frame    " << std::setw(8) << per_frame_lut << " ms" << std::endl
+              << "  view map cache              " << std::setw(8) << per_frame_cached << " ms"
+              << "  (" << per_frame_lut / per_frame_cached << "x, " << cache.misses() << " maps built)" << std::endl
+              << "  mean abs diff               " << std::setw(8) << mean_diff << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    int iterations = 50;
+    unsigned threads = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (std::string("-iterations") == std::string(argv[i])) {
+            iterations = std::atoi(argv[++i]);
+        }
+        else if (std::string("-threads") == std::string(argv[i])) {
+            threads = static_cast<unsigned>(std::atoi(argv[++i]));
+        }
+    }
+
+    bench_size(1920, 960, iterations, threads);
+    bench_size(5760, 2880, iterations, threads);
+    bench_dynamic_view(1920, 960, iterations * 10);
+    bench_dynamic_view(5760, 2880, iterations * 2);
+    return 0;
+}
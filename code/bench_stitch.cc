@@ -0,0 +1,408 @@
+// Benchmark of stitch settings over a fixed clip: throughput, latency, peak RSS and output size per cell.
+// Build (SDK):  g++ -O2 -std=c++17 -I<sdk>/include bench_stitch.cc stitch_runner.cc stitch_job.cc stitch_backend.cc ins_stitch_backend.cc
+//               fake_stitch_backend.cc stitch_options.cc mp4_info.cc -L<sdk>/lib -lMediaSDK -lpthread
+// Build (fake): g++ -O2 -std=c++17 -DNO_INSTA360_SDK bench_stitch.cc stitch_runner.cc stitch_job.cc stitch_backend.cc
+//               fake_stitch_backend.cc stitch_options.cc mp4_info.cc -lpthread
+#include "fake_stitch_backend.h"
+#include "mp4_info.h"
+#include "stitch_backend.h"
+#include "stitch_options.h"
+#include "stitch_runner.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std::chrono;
+
+static std::string helpstr =
+"{-help                   | false              | print this message\n"
+"{-inputs                 | None               | clip to stitch, comma separated like the converter\n"
+"{-fake                   | false              | use the fake stitcher instead of the SDK\n"
+"{-fake_frames            | 0                  | frames the fake stitches, 0 -> frame count of the clip\n"
+"{-fake_time_scale        | 1.0                | multiplies the fake frame costs\n"
+"{-fake_fail_at           | -1                 | progress at which every fake job fails\n"
+"{-stitch_types           | all                | template,optflow,dynamicstitch,aistitch\n"
+"{-output_sizes           | 1920x960,3840x1920 | comma separated WxH\n"
+"{-codecs                 | h264,h265          | encoders to try\n"
+"{-soft_codec             | off,on             | software encode and decode\n"
+"{-denoise                | off                | off,on (needs -denoise_model for the SDK)\n"
+"{-denoise_model          | None               | denoise model path\n"
+"{-colorplus              | off                | off,on (needs -colorplus_model for the SDK)\n"
+"{-colorplus_model        | None               | colorplus model path\n"
+"{-ai_stitching_model     | None               | model for aistitch\n"
+"{-disable_cuda           | true               | disable cuda\n"
+"{-repeat                 | 1                  | runs per cell, the median is reported\n"
+"{-output_dir             | /tmp/stitch_bench  | where the stitched files go, removed after each run\n"
+"{-csv                    | None               | write the results as csv\n"
+"{-json                   | None               | write the results as json\n"
+"{-baseline               | None               | csv of an earlier run to compare against\n"
+"{-tolerance              | 0.10               | allowed relative regression before failing\n";
+
+struct Cell {
+    std::string name;
+    StitchOptions options;
+};
+
+struct CellResult {
+    Cell cell;
+    bool ok = false;
+    int error = 0;
+    uint64_t frames = 0;
+    double latency_seconds = 0;
+    double first_progress_seconds = 0;
+    double peak_rss_mb = 0;
+    uint64_t output_bytes = 0;
+
+    double fps() const { return ok && latency_seconds > 0 ? frames / latency_seconds : 0.0; }
+};
+
+std::vector<std::string> split(const std::string& text, char separator) {
+    std::vector<std::string> parts;
+    std::stringstream stream(text);
+    std::string part;
+    while (std::getline(stream, part, separator)) {
+        if (!part.empty()) parts.push_back(part);
+    }
+    return parts;
+}
+
+bool parse_stitch_type(const std::string& name, StitchType& type) {
+    if (name == "template") type = StitchType::TEMPLATE;
+    else if (name == "optflow") type = StitchType::OPTFLOW;
+    else if (name == "dynamicstitch") type = StitchType::DYNAMICSTITCH;
+    else if (name == "aistitch" || name == "aiflow") type = StitchType::AIFLOW;
+    else return false;
+    return true;
+}
+
+std::vector<bool> parse_switch(const std::string& values) {
+    std::vector<bool> result;
+    for (const auto& value : split(values, ',')) {
+        result.push_back(value == "on" || value == "1" || value == "true");
+    }
+    return result;
+}
+
+// Clearing the refs resets VmHWM (Linux 4.0+), so every cell gets its own peak
+void reset_peak_rss() {
+    std::ofstream clear_refs("/proc/self/clear_refs");
+    clear_refs << "5";
+}
+
+double peak_rss_mb() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.rfind("VmHWM:", 0) == 0) {
+            return std::atof(line.c_str() + 6) / 1024.0;
+        }
+    }
+    return 0.0;
+}
+
+CellResult run_cell(const Cell& cell, const std::vector<std::string>& inputs, const std::string& output_dir,
+                    uint64_t frames) {
+    CellResult cell_result;
+    cell_result.cell = cell;
+    cell_result.frames = frames;
+
+    std::string safe_name = cell.name;
+    std::replace(safe_name.begin(), safe_name.end(), '/', '_');
+    const std::string output_path = (std::filesystem::path(output_dir) / (safe_name + ".mp4")).string();
+
+    reset_peak_rss();
+    auto start = steady_clock::now();
+    bool seen_progress = false;
+    StitchResult result = run_stitch(inputs, output_path, cell.options, [&](int) {
+        if (!seen_progress) {
+            seen_progress = true;
+            cell_result.first_progress_seconds = duration_cast<duration<double>>(steady_clock::now() - start).count();
+        }
+    });
+    cell_result.latency_seconds = duration_cast<duration<double>>(steady_clock::now() - start).count();
+    cell_result.peak_rss_mb = peak_rss_mb();
+    cell_result.ok = result.ok;
+    cell_result.error = result.error;
+    if (cell_result.frames == 0) {
+        cell_result.frames = result.frames;
+    }
+
+    std::error_code ec;
+    const auto size = std::filesystem::file_size(output_path, ec);
+    cell_result.output_bytes = ec ? 0 : size;
+    std::filesystem::remove(output_path, ec);
+    return cell_result;
+}
+
+void write_csv(const std::vector<CellResult>& results, std::ostream& out) {
+    out << "cell,ok,error,frames,latency_s,first_progress_s,fps,peak_rss_mb,output_bytes\n";
+    out << std::fixed << std::setprecision(3);
+    for (const auto& r : results) {
+        out << r.cell.name << "," << r.ok << "," << r.error << "," << r.frames << "," << r.latency_seconds << ","
+            << r.first_progress_seconds << "," << r.fps() << "," << r.peak_rss_mb << "," << r.output_bytes << "\n";
+    }
+}
+
+void write_json(const std::vector<CellResult>& results, std::ostream& out) {
+    out << std::fixed << std::setprecision(3) << "[\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const auto& r = results[i];
+        out << "  {\"cell\": \"" << r.cell.name << "\", \"ok\": " << (r.ok ? "true" : "false")
+            << ", \"error\": " << r.error << ", \"frames\": " << r.frames
+            << ", \"latency_s\": " << r.latency_seconds << ", \"first_progress_s\": " << r.first_progress_seconds
+            << ", \"fps\": " << r.fps() << ", \"peak_rss_mb\": " << r.peak_rss_mb
+            << ", \"output_bytes\": " << r.output_bytes << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "]\n";
+}
+
+// cell -> column -> value of a csv written by write_csv
+std::map<std::string, std::map<std::string, double>> read_baseline(const std::string& path) {
+    std::map<std::string, std::map<std::string, double>> baseline;
+    std::ifstream in(path);
+    std::string line;
+    if (!std::getline(in, line)) return baseline;
+
+    const std::vector<std::string> header = split(line, ',');
+    while (std::getline(in, line)) {
+        const std::vector<std::string> fields = split(line, ',');
+        if (fields.size() != header.size()) continue;
+        for (size_t i = 1; i < fields.size(); ++i) {
+            baseline[fields[0]][header[i]] = std::atof(fields[i].c_str());
+        }
+    }
+    return baseline;
+}
+
+// Cells that got slower, bigger or started failing. Output size is left out, it only moves with the settings
+int compare_with_baseline(const std::vector<CellResult>& results, const std::string& path, double tolerance) {
+    const auto baseline = read_baseline(path);
+    if (baseline.empty()) {
+        std::cout << "could not read baseline " << path << std::endl;
+        return -1;
+    }
+
+    int regressions = 0;
+    auto report = [&](const std::string& cell, const char* what, double before, double now) {
+        std::cout << "REGRESSION " << cell << " " << what << ": " << before << " -> " << now << std::endl;
+        ++regressions;
+    };
+
+    for (const auto& r : results) {
+        auto it = baseline.find(r.cell.name);
+        if (it == baseline.end()) {
+            std::cout << "no baseline for " << r.cell.name << std::endl;
+            continue;
+        }
+        const auto& before = it->second;
+        if (before.at("ok") > 0 && !r.ok) {
+            report(r.cell.name, "ok", 1, 0);
+            continue;
+        }
+        if (r.fps() < before.at("fps") * (1.0 - tolerance)) {
+            report(r.cell.name, "fps", before.at("fps"), r.fps());
+        }
+        if (r.latency_seconds > before.at("latency_s") * (1.0 + tolerance)) {
+            report(r.cell.name, "latency_s", before.at("latency_s"), r.latency_seconds);
+        }
+        if (r.peak_rss_mb > before.at("peak_rss_mb") * (1.0 + tolerance)) {
+            report(r.cell.name, "peak_rss_mb", before.at("peak_rss_mb"), r.peak_rss_mb);
+        }
+    }
+    return regressions;
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<std::string> inputs;
+    bool fake = false;
+    FakeStitchSettings fake_settings;
+    std::string stitch_types = "template,optflow,dynamicstitch,aistitch";
+    std::string output_sizes = "1920x960,3840x1920";
+    std::string codecs = "h264,h265";
+    std::string soft_codec = "off,on";
+    std::string denoise = "off";
+    std::string colorplus = "off";
+    StitchOptions base;
+    int repeat = 1;
+    std::string output_dir = "/tmp/stitch_bench";
+    std::string csv_path, json_path, baseline_path;
+    double tolerance = 0.10;
+
+    for (int i = 1; i < argc; i++) {
+        if (std::string("-help") == std::string(argv[i])) {
+            std::cout << helpstr << std::endl;
+            return 0;
+        }
+        else if (std::string("-inputs") == std::string(argv[i])) {
+            inputs = split(argv[++i], ',');
+        }
+        else if (std::string("-fake") == std::string(argv[i])) {
+            fake = true;
+        }
+        else if (std::string("-fake_frames") == std::string(argv[i])) {
+            fake_settings.frames = std::strtoull(argv[++i], nullptr, 10);
+        }
+        else if (std::string("-fake_time_scale") == std::string(argv[i])) {
+            fake_settings.time_scale = std::atof(argv[++i]);
+        }
+        else if (std::string("-fake_fail_at") == std::string(argv[i])) {
+            fake_settings.fail_at = std::atoi(argv[++i]);
+        }
+        else if (std::string("-stitch_types") == std::string(argv[i])) {
+            stitch_types = argv[++i];
+            if (stitch_types == "all") stitch_types = "template,optflow,dynamicstitch,aistitch";
+        }
+        else if (std::string("-output_sizes") == std::string(argv[i])) {
+            output_sizes = argv[++i];
+        }
+        else if (std::string("-codecs") == std::string(argv[i])) {
+            codecs = argv[++i];
+        }
+        else if (std::string("-soft_codec") == std::string(argv[i])) {
+            soft_codec = argv[++i];
+        }
+        else if (std::string("-denoise") == std::string(argv[i])) {
+            denoise = argv[++i];
+        }
+        else if (std::string("-denoise_model") == std::string(argv[i])) {
+            base.denoise_model_path = argv[++i];
+        }
+        else if (std::string("-colorplus") == std::string(argv[i])) {
+            colorplus = argv[++i];
+        }
+        else if (std::string("-colorplus_model") == std::string(argv[i])) {
+            base.color_plus_model_path = argv[++i];
+        }
+        else if (std::string("-ai_stitching_model") == std::string(argv[i])) {
+            base.ai_stitching_model = argv[++i];
+        }
+        else if (std::string("-disable_cuda") == std::string(argv[i])) {
+            base.enable_cuda = false;
+        }
+        else if (std::string("-repeat") == std::string(argv[i])) {
+            repeat = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (std::string("-output_dir") == std::string(argv[i])) {
+            output_dir = argv[++i];
+        }
+        else if (std::string("-csv") == std::string(argv[i])) {
+            csv_path = argv[++i];
+        }
+        else if (std::string("-json") == std::string(argv[i])) {
+            json_path = argv[++i];
+        }
+        else if (std::string("-baseline") == std::string(argv[i])) {
+            baseline_path = argv[++i];
+        }
+        else if (std::string("-tolerance") == std::string(argv[i])) {
+            tolerance = std::atof(argv[++i]);
+        }
+    }
+
+    if (inputs.empty() && !fake) {
+        std::cout << "-inputs is required unless -fake is given" << std::endl;
+        return -1;
+    }
+
+    if (fake) {
+        set_stitch_backend_factory([fake_settings] { return std::make_unique<FakeStitchBackend>(fake_settings); });
+    }
+
+    // The fake reads the clip for its frame count, the throughput needs the same number
+    uint64_t frames = 0;
+    if (fake) {
+        frames = fake_settings.frames;
+        if (frames == 0 && !inputs.empty()) frames = read_mp4_info(inputs[0]).frame_count;
+        if (frames == 0) frames = 300;
+    }
+
+    // Every combination of the given settings
+    std::vector<Cell> cells;
+    for (const auto& type_name : split(stitch_types, ',')) {
+        StitchType type;
+        if (!parse_stitch_type(type_name, type)) {
+            std::cout << "unknown stitch type " << type_name << std::endl;
+            return -1;
+        }
+        for (const auto& size : split(output_sizes, ',')) {
+            int width = 0, height = 0;
+            if (std::sscanf(size.c_str(), "%dx%d", &width, &height) != 2) {
+                std::cout << "bad output size " << size << std::endl;
+                return -1;
+            }
+            for (const auto& codec : split(codecs, ',')) {
+                for (bool soft : parse_switch(soft_codec)) {
+                    for (bool with_denoise : parse_switch(denoise)) {
+                        for (bool with_colorplus : parse_switch(colorplus)) {
+                            Cell cell;
+                            cell.options = base;
+                            cell.options.stitch_type = type;
+                            cell.options.output_width = width;
+                            cell.options.output_height = height;
+                            cell.options.enable_H265_encoder = codec == "h265";
+                            cell.options.enable_soft_encode = soft;
+                            cell.options.enable_soft_decode = soft;
+                            cell.options.enable_sequence_denoise = with_denoise;
+                            cell.options.enable_colorplus = with_colorplus;
+                            cell.name = type_name + "/" + size + "/" + codec + "/" + (soft ? "soft" : "hw")
+                                + (with_denoise ? "/denoise" : "") + (with_colorplus ? "/colorplus" : "");
+                            cells.push_back(cell);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    std::vector<CellResult> results;
+    for (const auto& cell : cells) {
+        std::vector<CellResult> runs;
+        for (int r = 0; r < repeat; ++r) {
+            runs.push_back(run_cell(cell, inputs, output_dir, frames));
+        }
+        std::sort(runs.begin(), runs.end(), [](const CellResult& a, const CellResult& b) {
+            return a.latency_seconds < b.latency_seconds;
+        });
+        const CellResult& median = runs[runs.size() / 2];
+        results.push_back(median);
+
+        std::cout << std::left << std::setw(44) << cell.name << std::right << std::fixed << std::setprecision(2)
+                  << (median.ok ? "      ok" : "  FAILED")
+                  << std::setw(10) << median.fps() << " fps"
+                  << std::setw(10) << median.latency_seconds << " s"
+                  << std::setw(10) << median.peak_rss_mb << " MB"
+                  << std::setw(10) << median.output_bytes / (1024.0 * 1024.0) << " MB out" << std::endl;
+    }
+
+    if (!csv_path.empty()) {
+        std::ofstream out(csv_path);
+        write_csv(results, out);
+    }
+    if (!json_path.empty()) {
+        std::ofstream out(json_path);
+        write_json(results, out);
+    }
+
+    if (!baseline_path.empty()) {
+        const int regressions = compare_with_baseline(results, baseline_path, tolerance);
+        if (regressions != 0) {
+            std::cout << (regressions < 0 ? 1 : regressions) << " regression(s) against " << baseline_path << std::endl;
+            return 1;
+        }
+        std::cout << "no regressions against " << baseline_path << std::endl;
+    }
+
+    bool all_ok = std::all_of(results.begin(), results.end(), [](const CellResult& r) { return r.ok; });
+    return all_ok ? 0 : -1;
+}
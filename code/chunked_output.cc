@@ -0,0 +1,363 @@
+#include "chunked_output.h"
+#include "ffmpeg.h"
+#include "mp4_info.h"
+#include "stitch_job.h"
+#include "stitch_telemetry.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+namespace {
+
+struct Chunk {
+    uint64_t begin = 0;       // first frame the chunk contributes
+    uint64_t end = 0;         // one past the last one
+    uint64_t input_begin = 0; // first stitched frame, a keyframe of both lenses at or before begin - overlap
+                              // (0 for image chunks exported from the whole lens files)
+    std::string dir;          // stream copied pieces of the lens files and the stitched output
+    std::string stitched;     // clip or frame directory the stitcher writes
+    std::string published;    // final place inside the output directory
+    std::shared_ptr<StitchJob> job;
+};
+
+std::string chunk_name(size_t index) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "chunk_%06zu", index);
+    return name;
+}
+
+int64_t unix_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// The frames of an image chunk numbered from the first frame of its pieces, moved to a new directory
+// under their number in the recording: the two numberings overlap when there is a pre-roll
+bool renumber_frames(const Chunk& chunk, const std::string& renamed, const char* extension, std::string& error) {
+    std::error_code ec;
+    std::filesystem::create_directories(renamed, ec);
+    for (uint64_t frame = chunk.begin; frame < chunk.end; ++frame) {
+        const std::string local = std::to_string(frame - chunk.input_begin) + extension;
+        std::filesystem::rename(std::filesystem::path(chunk.stitched) / local,
+                                std::filesystem::path(renamed) / (std::to_string(frame) + extension), ec);
+        if (ec) {
+            error = "frame " + std::to_string(frame) + " missing: " + ec.message();
+            return false;
+        }
+    }
+    return true;
+}
+
+// Appends one line and flushes it, a reader never sees a chunk before its file is in place
+void append_line(std::ofstream& manifest, const std::string& line) {
+    manifest << line << '\n';
+    manifest.flush();
+}
+
+} // namespace
+
+bool run_chunked_stitch(const std::vector<std::string>& input_paths, const std::string& output_dir,
+                        const StitchOptions& options, const ChunkSettings& settings) {
+    auto start_time = std::chrono::steady_clock::now();
+
+    const Mp4Info lens0 = read_mp4_info(input_paths[0]);
+    const Mp4Info lens1 = read_mp4_info(input_paths[1]);
+    if (!lens0.valid || !lens1.valid || lens0.fps <= 0.0) {
+        std::cout << "Failed to read the frame count of the inputs, can't split them in chunks" << std::endl;
+        return false;
+    }
+
+    const double fps = lens0.fps;
+    const uint64_t frames = std::min(lens0.frame_count, lens1.frame_count);
+    const std::vector<uint64_t> keyframes = common_keyframes(lens0, lens1, frames);
+    if (keyframes.empty()) {
+        std::cout << "The lens files have no keyframe in common, can't split them in chunks" << std::endl;
+        return false;
+    }
+
+    int64_t overlap = settings.overlap_frames;
+    if (overlap < 0) {
+        overlap = (options.enable_flowstate || options.enable_deflicker || options.enable_directionlock)
+            ? static_cast<int64_t>(std::ceil(fps)) : 0;
+    }
+
+    // Cut at the keyframe closest to every chunk_seconds
+    const uint64_t chunk_frames = std::max<uint64_t>(1, static_cast<uint64_t>(settings.chunk_seconds * fps));
+    std::vector<uint64_t> cuts = { 0 };
+    for (uint64_t target = chunk_frames; target < frames; target += chunk_frames) {
+        const uint64_t cut = keyframe_at_or_before(keyframes, target);
+        if (cut > cuts.back()) cuts.push_back(cut);
+    }
+    cuts.push_back(frames);
+
+    const bool images = !options.image_sequence_dir.empty();
+    if (!images && options.uses_recording_motion()) {
+        std::cout << "Flowstate and direction lock need the gyro on the recording's timeline, video chunks can't be cut "
+                     "out of the lens files. Use image chunks (-image_sequence_dir) instead" << std::endl;
+        return false;
+    }
+    // Image chunks are exported from the whole lens files then
+    const bool cut = !options.uses_recording_motion();
+    const char* extension = options.image_type == ImageType::PNG ? ".png" : ".jpg";
+
+    // Absolute, the consumer reading the manifest may run somewhere else
+    std::error_code ec;
+    const std::filesystem::path out_dir = std::filesystem::absolute(output_dir, ec);
+    const std::filesystem::path work_dir = out_dir / ".work";
+    const std::filesystem::path manifest_path = out_dir / CHUNK_MANIFEST_NAME;
+
+    // Chunks of an earlier run would be taken for this one, anything else in the directory is left alone.
+    // The manifest is truncated in place, a reader already following it keeps the same file
+    std::filesystem::create_directories(out_dir, ec);
+    for (const auto& entry : std::filesystem::directory_iterator(out_dir, ec)) {
+        if (entry.path().filename().string().rfind("chunk_", 0) == 0) {
+            std::filesystem::remove_all(entry.path(), ec);
+        }
+    }
+    std::filesystem::remove_all(work_dir, ec);
+    std::filesystem::create_directories(work_dir, ec);
+
+    std::ofstream manifest(manifest_path, std::ios::trunc);
+    if (!manifest) {
+        std::cout << "Failed to create the chunk manifest " << manifest_path.string() << std::endl;
+        return false;
+    }
+    {
+        std::ostringstream line;
+        line << "stream\t" << (images ? extension + 1 : "video") << '\t' << fps << '\t' << frames << '\t'
+             << options.output_width << '\t' << options.output_height;
+        append_line(manifest, line.str());
+    }
+
+    std::vector<Chunk> chunks(cuts.size() - 1);
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        Chunk& chunk = chunks[i];
+        chunk.begin = cuts[i];
+        chunk.end = cuts[i + 1];
+        chunk.input_begin = cut ? keyframe_at_or_before(keyframes, chunk.begin > static_cast<uint64_t>(overlap) ? chunk.begin - overlap : 0)
+                                : 0;
+        chunk.dir = (work_dir / chunk_name(i)).string();
+        chunk.stitched = (std::filesystem::path(chunk.dir) / (images ? "frames" : "stitched.mp4")).string();
+        chunk.published = (out_dir / (chunk_name(i) + (images ? "" : ".mp4"))).string();
+    }
+
+    std::cout << "Stitching " << frames << " frames in " << chunks.size() << " chunks of " << settings.chunk_seconds
+              << " s, manifest " << manifest_path.string() << std::endl;
+
+    // Only a window of chunks is cut and queued ahead of the oldest unpublished one: the first chunk
+    // starts stitching right after its own cut and the lens pieces never pile up on the disk
+    const int max_jobs = std::max(settings.max_jobs, 1);
+    const size_t window = static_cast<size_t>(max_jobs) + 1;
+    StitchExecutor executor(max_jobs, settings.max_hw_sessions);
+    size_t next_submit = 0;
+    bool ok = true;
+
+    for (size_t i = 0; i < chunks.size() && ok; ++i) {
+        while (next_submit < chunks.size() && next_submit < i + window) {
+            Chunk& chunk = chunks[next_submit];
+            const std::string name = out_dir.filename().string() + "#" + chunk_name(next_submit);
+
+            StitchJobSpec spec;
+            spec.options = options;
+            spec.options.export_frame_nums.clear();
+            std::filesystem::create_directories(chunk.dir, ec);
+            // The lens files are cut with their trailer from the keyframe before the chunk, the SDK has
+            // no frame range for a video and an image export would decode everything before the chunk
+            if (cut) {
+                for (const auto& input : input_paths) {
+                    const std::string piece = (std::filesystem::path(chunk.dir) / std::filesystem::path(input).filename()).string();
+                    if (!ffmpeg_copy_range(input, piece, chunk.input_begin, chunk.end - chunk.input_begin)) {
+                        ok = false;
+                        break;
+                    }
+                    spec.input_paths.push_back(piece);
+                }
+                if (!ok) {
+                    append_line(manifest, "failed\t" + std::to_string(next_submit) + "\tcutting the lens files failed");
+                    break;
+                }
+            }
+            else {
+                spec.input_paths = input_paths;
+            }
+            if (images) {
+                // SetExportFrameSequence skips the pre-roll, the frames are numbered from input_begin
+                std::filesystem::create_directories(chunk.stitched, ec);
+                spec.output_path = (std::filesystem::path(chunk.dir) / "unused.mp4").string();
+                spec.options.image_sequence_dir = chunk.stitched;
+                for (uint64_t frame = chunk.begin; frame < chunk.end; ++frame) {
+                    spec.options.export_frame_nums.push_back(frame - chunk.input_begin);
+                }
+            }
+            else {
+                spec.output_path = chunk.stitched;
+                spec.options.image_sequence_dir.clear();
+            }
+            spec.timeout_seconds = settings.timeout_seconds;
+
+            if (settings.telemetry) {
+                spec.on_start = [&, name, frames = chunk.end - chunk.input_begin] {
+                    settings.telemetry->begin_job(name, frames);
+                };
+                spec.on_progress = [&, name](int progress) { settings.telemetry->progress(name, progress); };
+                spec.on_finished = [&, name](StitchResult& result) { settings.telemetry->end_job(name, result); };
+            }
+
+            chunk.job = executor.submit(std::move(spec));
+            ++next_submit;
+        }
+        if (!ok) break;
+
+        Chunk& chunk = chunks[i];
+        const StitchResult result = chunk.job->wait();
+        std::string error = result.error_info;
+        if (result.ok) {
+            std::string ready = chunk.stitched;
+            if (images) {
+                ready = (std::filesystem::path(chunk.dir) / "renamed").string();
+                ok = renumber_frames(chunk, ready, extension, error);
+            }
+            if (ok) {
+                std::filesystem::rename(ready, chunk.published, ec);
+                ok = !ec;
+                if (ec) error = "failed to publish " + chunk.published + ": " + ec.message();
+            }
+        }
+        else {
+            ok = false;
+        }
+        std::filesystem::remove_all(chunk.dir, ec);
+
+        if (!ok) {
+            std::cout << chunk_name(i) << " failed: " << error << std::endl;
+            append_line(manifest, "failed\t" + std::to_string(i) + "\t" + error);
+            break;
+        }
+
+        std::ostringstream line;
+        line << std::fixed << std::setprecision(3) << "chunk\t" << i << '\t' << chunk.published << '\t'
+             << (images ? chunk.begin : chunk.input_begin) << '\t' << chunk.begin << '\t' << chunk.end << '\t'
+             << chunk.begin / fps << '\t' << unix_ms();
+        append_line(manifest, line.str());
+
+        const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+        std::cout << std::fixed << std::setprecision(2) << chunk_name(i) << " [" << chunk.begin << ", " << chunk.end
+                  << ") published after " << elapsed << " s" << std::endl;
+    }
+
+    // Whatever is still queued or running after a failure is of no use
+    for (auto& chunk : chunks) {
+        if (chunk.job) chunk.job->cancel();
+    }
+    executor.wait_all();
+    std::filesystem::remove_all(work_dir, ec);
+
+    if (ok) {
+        append_line(manifest, "end\t" + std::to_string(chunks.size()));
+    }
+
+    const double wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "chunked stitch: " << wall_seconds << " s, " << frames / wall_seconds << " fps" << std::endl;
+    return ok;
+}
+
+ChunkManifestReader::ChunkManifestReader(std::string path) : path_(std::move(path)) {}
+
+std::vector<ChunkEntry> ChunkManifestReader::poll() {
+    std::vector<ChunkEntry> entries;
+    if (!file_.is_open()) {
+        file_.open(path_);
+        if (!file_.is_open()) return entries;
+    }
+
+    // getline stops at the end of the file too, a line only counts once its '\n' is there
+    char buffer[4096];
+    while (true) {
+        file_.read(buffer, sizeof(buffer));
+        const std::streamsize count = file_.gcount();
+        if (count <= 0) break;
+        partial_.append(buffer, static_cast<size_t>(count));
+    }
+    file_.clear();
+
+    size_t start = 0;
+    size_t newline;
+    while ((newline = partial_.find('\n', start)) != std::string::npos) {
+        parse_line(partial_.substr(start, newline - start), entries);
+        start = newline + 1;
+    }
+    partial_.erase(0, start);
+    return entries;
+}
+
+void ChunkManifestReader::parse_line(const std::string& line, std::vector<ChunkEntry>& entries) {
+    std::vector<std::string> fields;
+    std::istringstream row(line);
+    std::string field;
+    while (std::getline(row, field, '\t')) fields.push_back(field);
+    if (fields.empty()) return;
+
+    try {
+        if (fields[0] == "stream" && fields.size() >= 6) {
+            kind_ = fields[1];
+            fps_ = std::stod(fields[2]);
+            frames_ = std::stoull(fields[3]);
+            width_ = std::stoi(fields[4]);
+            height_ = std::stoi(fields[5]);
+            has_stream_ = true;
+        }
+        else if (fields[0] == "chunk" && fields.size() >= 8) {
+            ChunkEntry entry;
+            entry.index = std::stoull(fields[1]);
+            entry.path = fields[2];
+            entry.first_frame = std::stoull(fields[3]);
+            entry.begin = std::stoull(fields[4]);
+            entry.end = std::stoull(fields[5]);
+            entry.start_seconds = std::stod(fields[6]);
+            entry.published_ms = std::stoll(fields[7]);
+            entries.push_back(entry);
+        }
+        else if (fields[0] == "end") {
+            finished_ = true;
+        }
+        else if (fields[0] == "failed") {
+            failed_ = true;
+            error_ = "chunk " + (fields.size() > 1 ? fields[1] : std::string("?")) + " failed"
+                   + (fields.size() > 2 ? ": " + fields[2] : std::string());
+        }
+    } catch (const std::exception&) {
+        // malformed line, written by something else
+    }
+}
+
+bool ChunkManifestReader::next(ChunkEntry& entry, double timeout_seconds) {
+    auto last_change = std::chrono::steady_clock::now();
+    while (true) {
+        if (!pending_.empty()) {
+            entry = pending_.front();
+            pending_.erase(pending_.begin());
+            return true;
+        }
+        if (finished_ || failed_) return false;
+
+        std::vector<ChunkEntry> entries = poll();
+        if (!entries.empty() || finished_ || failed_) {
+            pending_.insert(pending_.end(), entries.begin(), entries.end());
+            last_change = std::chrono::steady_clock::now();
+            continue;
+        }
+
+        if (timeout_seconds > 0.0 &&
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - last_change).count() > timeout_seconds) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "stitch_options.h"
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+class StitchTelemetry;
+
+struct ChunkSettings {
+    double chunk_seconds = 10.0;  // length of every chunk, rounded down to a keyframe of both lenses
+    int max_jobs = 2;             // chunks stitched at the same time
+    int max_hw_sessions = 1;      // chunks holding a hardware codec at the same time
+    int64_t overlap_frames = -1;  // pre-roll stitched before every chunk, < 0 -> automatic
+    double timeout_seconds = 0.0; // a chunk stitching for longer is cancelled, 0 -> no limit
+    StitchTelemetry* telemetry = nullptr; // records every chunk as its own job when set
+};
+
+// Name of the manifest inside the output directory
+const char* const CHUNK_MANIFEST_NAME = "chunks.tsv";
+
+// Stitches the recording as a stream of chunks a consumer can pick up while the rest is still being
+// stitched. The recording is split at the common keyframe closest to every chunk_seconds, the chunks
+// are stitched in parallel, and every finished chunk is published in order: moved into output_dir in
+// one rename and only then appended to output_dir/chunks.tsv.
+//
+// Every chunk is stitched from pieces of the lens files cut with their trailer at the keyframe before
+// it (minus the overlap). Without options.image_sequence_dir it is a self-contained chunk_<index>.mp4
+// that keeps its pre-roll, refused with flowstate or direction lock: a cut piece doesn't line up with
+// its gyro. With it, it is a chunk_<index>/ directory with only the frames of the chunk, picked by
+// SetExportFrameSequence and renamed to their frame number in the recording like a whole export would
+// name them; with flowstate or direction lock they are exported from the whole lens files instead.
+//
+// The manifest is only ever appended to, one line per event, tab separated:
+//   stream  <video|jpg|png> <fps> <frames> <width> <height>
+//   chunk   <index> <path> <first frame in the file> <begin> <end> <start seconds> <published unix ms>
+//   end     <chunks>
+//   failed  <index> <reason>
+// Frames are frames of the recording and end is exclusive
+bool run_chunked_stitch(const std::vector<std::string>& input_paths, const std::string& output_dir,
+                        const StitchOptions& options, const ChunkSettings& settings);
+
+struct ChunkEntry {
+    uint64_t index = 0;
+    std::string path;         // absolute
+    uint64_t first_frame = 0; // first frame stored in the chunk, its pre-roll included
+    uint64_t begin = 0;       // first frame the chunk contributes
+    uint64_t end = 0;         // one past the last one
+    double start_seconds = 0.0;
+    int64_t published_ms = 0; // unix time the chunk became available
+};
+
+// Follows the manifest of run_chunked_stitch, possibly from another process while it is being written.
+// Only complete lines are taken, a line still being appended is read again on the next poll
+class ChunkManifestReader {
+public:
+    explicit ChunkManifestReader(std::string path);
+
+    // Reads what was appended since the last call and returns the chunks it published
+    std::vector<ChunkEntry> poll();
+
+    // Next chunk in order. Blocks until it is published; false once the stream ended or failed, or
+    // when nothing was appended for timeout_seconds (0 -> wait forever)
+    bool next(ChunkEntry& entry, double timeout_seconds = 0.0);
+
+    bool has_stream() const { return has_stream_; }
+    bool finished() const { return finished_; }
+    bool failed() const { return failed_; }
+    const std::string& error() const { return error_; }
+
+    // From the stream line
+    const std::string& kind() const { return kind_; }
+    double fps() const { return fps_; }
+    uint64_t frames() const { return frames_; }
+    int width() const { return width_; }
+    int height() const { return height_; }
+
+private:
+    void parse_line(const std::string& line, std::vector<ChunkEntry>& entries);
+
+    std::string path_;
+    std::ifstream file_;
+    std::string partial_;
+    std::vector<ChunkEntry> pending_; // polled but not yet returned by next()
+
+    bool has_stream_ = false;
+    bool finished_ = false;
+    bool failed_ = false;
+    std::string error_;
+
+    std::string kind_;
+    double fps_ = 0.0;
+    uint64_t frames_ = 0;
+    int width_ = 0;
+    int height_ = 0;
+};
@@ -0,0 +1,217 @@
+#include "conversion_cache.h"
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+namespace {
+
+const uint64_t FNV_OFFSET = 1469598103934665603ULL;
+const uint64_t FNV_PRIME = 1099511628211ULL;
+
+const size_t SAMPLE_BLOCK_SIZE = 64 * 1024;
+const int SAMPLE_BLOCKS = 4; // first, last and evenly spaced ones in between
+
+void fnv1a(uint64_t& hash, const void* data, size_t size) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+}
+
+void fnv1a(uint64_t& hash, const std::string& text) {
+    fnv1a(hash, text.data(), text.size());
+}
+
+int64_t file_mtime(const std::filesystem::path& path, std::error_code& ec) {
+    const auto time = std::filesystem::last_write_time(path, ec);
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+std::string to_hex(uint64_t value) {
+    std::ostringstream out;
+    out << std::hex << std::setw(16) << std::setfill('0') << value;
+    return out.str();
+}
+
+std::string temp_output_path(const std::string& output_path) {
+    // keep the extension, the SDK picks the container from it
+    std::filesystem::path p(output_path);
+    std::filesystem::path temp = p.parent_path() / p.stem();
+    temp += ".partial";
+    temp += p.extension();
+    return temp.string();
+}
+
+} // namespace
+
+std::string fingerprint_inputs(const std::vector<std::string>& input_paths) {
+    uint64_t hash = FNV_OFFSET;
+    std::vector<char> block(SAMPLE_BLOCK_SIZE);
+
+    for (const auto& path : input_paths) {
+        std::error_code ec;
+        const uintmax_t size = std::filesystem::file_size(path, ec);
+        if (ec) return "";
+        const int64_t mtime = file_mtime(path, ec);
+        if (ec) return "";
+
+        fnv1a(hash, std::filesystem::path(path).filename().string());
+        fnv1a(hash, &size, sizeof(size));
+        fnv1a(hash, &mtime, sizeof(mtime));
+
+        std::ifstream file(path, std::ios::binary);
+        for (int i = 0; i < SAMPLE_BLOCKS && file; ++i) {
+            const uintmax_t last_start = size > SAMPLE_BLOCK_SIZE ? size - SAMPLE_BLOCK_SIZE : 0;
+            const uintmax_t offset = last_start * i / (SAMPLE_BLOCKS - 1);
+
+            file.seekg(static_cast<std::streamoff>(offset));
+            file.read(block.data(), static_cast<std::streamsize>(block.size()));
+            fnv1a(hash, block.data(), static_cast<size_t>(file.gcount()));
+            file.clear();
+        }
+    }
+
+    return to_hex(hash);
+}
+
+std::string default_manifest_path(const std::string& output_path) {
+    std::filesystem::path converted_dir = std::filesystem::path(output_path).parent_path();
+    std::filesystem::path manifest = converted_dir.parent_path() / converted_dir.filename();
+    manifest += ".manifest";
+    return manifest.string();
+}
+
+ConversionCache::ConversionCache(std::string manifest_path) : manifest_path_(std::move(manifest_path)) {}
+
+std::string ConversionCache::make_key(const std::vector<std::string>& input_paths, const StitchOptions& options) {
+    const std::string inputs = fingerprint_inputs(input_paths);
+    if (inputs.empty()) return "";
+
+    uint64_t settings = FNV_OFFSET;
+    fnv1a(settings, describe_stitch_options(options));
+    return inputs + to_hex(settings);
+}
+
+void ConversionCache::load() {
+    entries_.clear();
+
+    std::ifstream file(manifest_path_);
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream row(line);
+        std::string key, size, mtime;
+        Entry entry;
+        if (!std::getline(row, key, '\t') || !std::getline(row, size, '\t') ||
+            !std::getline(row, mtime, '\t') || !std::getline(row, entry.output_path)) continue;
+
+        try {
+            entry.output_size = std::stoull(size);
+            entry.output_mtime = std::stoll(mtime);
+        } catch (const std::exception&) {
+            continue;
+        }
+        entries_[key] = entry;
+    }
+}
+
+bool ConversionCache::save() {
+    const std::string temp_path = manifest_path_ + ".tmp";
+    {
+        std::ofstream file(temp_path, std::ios::trunc);
+        for (const auto& [key, entry] : entries_) {
+            file << key << '\t' << entry.output_size << '\t' << entry.output_mtime << '\t' << entry.output_path << '\n';
+        }
+        if (!file) return false;
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(temp_path, manifest_path_, ec);
+    return !ec;
+}
+
+bool ConversionCache::lookup(const std::string& key, const std::string& output_path) {
+    if (key.empty()) return false;
+
+    std::lock_guard<std::mutex> lck(mutex_);
+    load();
+
+    auto it = entries_.find(key);
+    if (it == entries_.end() || it->second.output_path != output_path) return false;
+
+    // The output must still be exactly the file that was recorded
+    std::error_code ec;
+    const uintmax_t size = std::filesystem::file_size(output_path, ec);
+    if (ec || size != it->second.output_size) return false;
+    const int64_t mtime = file_mtime(output_path, ec);
+    return !ec && mtime == it->second.output_mtime;
+}
+
+void ConversionCache::store(const std::string& key, const std::string& output_path) {
+    if (key.empty()) return;
+
+    Entry entry;
+    entry.output_path = output_path;
+
+    std::error_code ec;
+    entry.output_size = std::filesystem::file_size(output_path, ec);
+    if (ec) return;
+    entry.output_mtime = file_mtime(output_path, ec);
+    if (ec) return;
+
+    // Reload first so entries written by other jobs since our lookup survive
+    std::lock_guard<std::mutex> lck(mutex_);
+    load();
+    entries_[key] = entry;
+    if (!save()) {
+        std::cout << "Failed to update the conversion manifest " << manifest_path_ << std::endl;
+    }
+}
+
+std::shared_ptr<StitchJob> submit_stitch_cached(StitchExecutor& executor, ConversionCache& cache,
+                                                StitchJobSpec spec, bool force) {
+    auto start_time = std::chrono::steady_clock::now();
+    const std::string key = ConversionCache::make_key(spec.input_paths, spec.options);
+
+    if (!force && cache.lookup(key, spec.output_path)) {
+        std::cout << "Up to date: " << spec.output_path << std::endl;
+
+        StitchResult result;
+        result.ok = true;
+        result.cached = true;
+        if (spec.on_start) spec.on_start();
+        result.wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+        if (spec.on_finished) spec.on_finished(result);
+        return StitchJob::completed(std::move(spec), result);
+    }
+
+    const std::string output_path = spec.output_path;
+    const std::string temp_path = temp_output_path(output_path);
+    std::error_code ec;
+    std::filesystem::remove(temp_path, ec);
+
+    spec.output_path = temp_path;
+    spec.on_finished = [&cache, key, output_path, temp_path, on_finished = std::move(spec.on_finished)](StitchResult& result) {
+        std::error_code ec;
+        if (!result.ok) {
+            std::filesystem::remove(temp_path, ec);
+        }
+        else {
+            std::filesystem::rename(temp_path, output_path, ec);
+            if (ec) {
+                result.ok = false;
+                result.error_info = "failed to move " + temp_path + " to " + output_path + ": " + ec.message();
+            }
+            else {
+                cache.store(key, output_path);
+            }
+        }
+
+        if (on_finished) on_finished(result);
+    };
+    return executor.submit(std::move(spec));
+}
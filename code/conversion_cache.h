@@ -0,0 +1,59 @@
+#pragma once
+
+#include "stitch_job.h"
+#include "stitch_options.h"
+#include "stitch_runner.h"
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Cheap content fingerprint of a set of input files: size, mtime and a hash of a few
+// blocks spread over every file. Reads a few hundred KB no matter how big the recording is
+std::string fingerprint_inputs(const std::vector<std::string>& input_paths);
+
+// Manifest of finished conversions keyed by the fingerprint of the inputs plus the stitch settings.
+// It lives next to the convertedFootage directory as a tab separated text file
+class ConversionCache {
+public:
+    explicit ConversionCache(std::string manifest_path);
+
+    // Key of a conversion of these inputs with these settings
+    static std::string make_key(const std::vector<std::string>& input_paths, const StitchOptions& options);
+
+    // True when the manifest has the key and the output it points at is still the file we wrote
+    bool lookup(const std::string& key, const std::string& output_path);
+
+    // Records a finished conversion. The manifest is rewritten through a temp file and renamed
+    void store(const std::string& key, const std::string& output_path);
+
+    const std::string& manifest_path() const { return manifest_path_; }
+
+private:
+    struct Entry {
+        std::string output_path;
+        uintmax_t output_size = 0;
+        int64_t output_mtime = 0;
+    };
+
+    void load();
+    bool save();
+
+    std::string manifest_path_;
+    std::map<std::string, Entry> entries_;
+    std::mutex mutex_;
+};
+
+// Manifest used for the outputs of get_output_path(): <sources>/convertedFootage.manifest
+std::string default_manifest_path(const std::string& output_path);
+
+// Submits the job going through the cache. A hit returns a job that is already done (on_start and
+// on_finished are still called); a miss stitches into a temp file that is only renamed to the output
+// once the stitch succeeded, so a crashed or failed run never leaves a file behind that could pass for
+// a finished one. force skips the lookup. The cache has to outlive the job
+std::shared_ptr<StitchJob> submit_stitch_cached(StitchExecutor& executor, ConversionCache& cache,
+                                                StitchJobSpec spec, bool force);
@@ -0,0 +1,485 @@
+#include "equirect_remap.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+constexpr double PI = 3.14159265358979323846;
+constexpr int TILE_ROWS = 16;
+
+inline double radians(double degrees) { return degrees * PI / 180.0; }
+
+inline void remap_pixel_scalar(const uint8_t* src, size_t stride, int32_t offset, int32_t right, uint16_t weight, uint8_t* out) {
+    const int wx = weight & 0xFF;
+    const int wy = weight >> 8;
+    const int ix = RemapLut::ONE - wx;
+    const int iy = RemapLut::ONE - wy;
+
+    const uint8_t* p00 = src + offset;
+    const uint8_t* p01 = p00 + right;
+    const uint8_t* p10 = p00 + stride;
+    const uint8_t* p11 = p10 + right;
+
+    for (int c = 0; c < 3; ++c) {
+        const int top = p00[c] * ix + p01[c] * wx;
+        const int bottom = p10[c] * ix + p11[c] * wx;
+        out[c] = static_cast<uint8_t>((top * iy + bottom * wy + 512) >> 10);
+    }
+}
+
+#if defined(__AVX2__)
+
+// 8 output pixels per iteration. Writes 28 bytes, so the caller leaves 2 pixels of slack at the end of the row
+inline void remap_8_avx2(const uint8_t* src, int32_t stride, const int32_t* offset, const int32_t* right,
+                         const uint16_t* weight, uint8_t* out) {
+    const __m256i off = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(offset));
+    const __m256i rgt = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(right));
+    const __m256i str = _mm256_set1_epi32(stride);
+    const int* base = reinterpret_cast<const int*>(src);
+
+    // BGRx words of the four corners
+    const __m256i p00 = _mm256_i32gather_epi32(base, off, 1);
+    const __m256i p01 = _mm256_i32gather_epi32(base, _mm256_add_epi32(off, rgt), 1);
+    const __m256i p10 = _mm256_i32gather_epi32(base, _mm256_add_epi32(off, str), 1);
+    const __m256i p11 = _mm256_i32gather_epi32(base, _mm256_add_epi32(_mm256_add_epi32(off, str), rgt), 1);
+
+    const __m256i w = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(weight)));
+    const __m256i one = _mm256_set1_epi32(RemapLut::ONE);
+    const __m256i wx = _mm256_and_si256(w, _mm256_set1_epi32(0xFF));
+    const __m256i wy = _mm256_srli_epi32(w, 8);
+
+    // Horizontal weights as (ix, wx) byte pairs repeated for the 4 bytes of every pixel
+    __m256i h = _mm256_or_si256(_mm256_sub_epi32(one, wx), _mm256_slli_epi32(wx, 8));
+    h = _mm256_or_si256(h, _mm256_slli_epi32(h, 16));
+    const __m256i h_lo = _mm256_unpacklo_epi32(h, h); // pixels 0,1 | 4,5
+    const __m256i h_hi = _mm256_unpackhi_epi32(h, h); // pixels 2,3 | 6,7
+
+    // top/bottom = p0 * ix + p1 * wx as 16 bit BGRx
+    const __m256i top_lo = _mm256_maddubs_epi16(_mm256_unpacklo_epi8(p00, p01), h_lo);
+    const __m256i top_hi = _mm256_maddubs_epi16(_mm256_unpackhi_epi8(p00, p01), h_hi);
+    const __m256i bot_lo = _mm256_maddubs_epi16(_mm256_unpacklo_epi8(p10, p11), h_lo);
+    const __m256i bot_hi = _mm256_maddubs_epi16(_mm256_unpackhi_epi8(p10, p11), h_hi);
+
+    // Vertical weights as (iy, wy) 16 bit pairs, broadcast per pixel
+    const __m256i v = _mm256_or_si256(_mm256_sub_epi32(one, wy), _mm256_slli_epi32(wy, 16));
+    const __m256i round = _mm256_set1_epi32(512);
+
+    __m256i r0 = _mm256_madd_epi16(_mm256_unpacklo_epi16(top_lo, bot_lo), _mm256_shuffle_epi32(v, _MM_SHUFFLE(0, 0, 0, 0)));
+    __m256i r1 = _mm256_madd_epi16(_mm256_unpackhi_epi16(top_lo, bot_lo), _mm256_shuffle_epi32(v, _MM_SHUFFLE(1, 1, 1, 1)));
+    __m256i r2 = _mm256_madd_epi16(_mm256_unpacklo_epi16(top_hi, bot_hi), _mm256_shuffle_epi32(v, _MM_SHUFFLE(2, 2, 2, 2)));
+    __m256i r3 = _mm256_madd_epi16(_mm256_unpackhi_epi16(top_hi, bot_hi), _mm256_shuffle_epi32(v, _MM_SHUFFLE(3, 3, 3, 3)));
+    r0 = _mm256_srai_epi32(_mm256_add_epi32(r0, round), 10);
+    r1 = _mm256_srai_epi32(_mm256_add_epi32(r1, round), 10);
+    r2 = _mm256_srai_epi32(_mm256_add_epi32(r2, round), 10);
+    r3 = _mm256_srai_epi32(_mm256_add_epi32(r3, round), 10);
+
+    // Back to BGRx bytes in pixel order, then drop the x byte
+    const __m256i bgrx = _mm256_packus_epi16(_mm256_packs_epi32(r0, r1), _mm256_packs_epi32(r2, r3));
+    const __m256i bgr = _mm256_shuffle_epi8(bgrx, _mm256_setr_epi8(
+        0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+        0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1));
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm256_castsi256_si128(bgr));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 12), _mm256_extracti128_si256(bgr, 1));
+}
+
+#define SIMD_PIXELS 8
+
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+
+// 4 output pixels per iteration. NEON has no gather so the corners are loaded one by one,
+// the interpolation itself is vectorized. Writes 16 bytes, so 2 pixels of slack at the end of the row
+inline void remap_4_neon(const uint8_t* src, int32_t stride, const int32_t* offset, const int32_t* right,
+                         const uint16_t* weight, uint8_t* out) {
+    uint32_t c00[4], c01[4], c10[4], c11[4];
+    uint8_t ix[16], wx[16];
+    uint16_t iy[16], wy[16];
+
+    for (int i = 0; i < 4; ++i) {
+        const uint8_t* p = src + offset[i];
+        std::memcpy(&c00[i], p, 4);
+        std::memcpy(&c01[i], p + right[i], 4);
+        std::memcpy(&c10[i], p + stride, 4);
+        std::memcpy(&c11[i], p + stride + right[i], 4);
+
+        const uint8_t fx = weight[i] & 0xFF;
+        const uint16_t fy = weight[i] >> 8;
+        for (int c = 0; c < 4; ++c) {
+            ix[i * 4 + c] = RemapLut::ONE - fx;
+            wx[i * 4 + c] = fx;
+            iy[i * 4 + c] = RemapLut::ONE - fy;
+            wy[i * 4 + c] = fy;
+        }
+    }
+
+    const uint8x16_t p00 = vreinterpretq_u8_u32(vld1q_u32(c00));
+    const uint8x16_t p01 = vreinterpretq_u8_u32(vld1q_u32(c01));
+    const uint8x16_t p10 = vreinterpretq_u8_u32(vld1q_u32(c10));
+    const uint8x16_t p11 = vreinterpretq_u8_u32(vld1q_u32(c11));
+    const uint8x16_t vix = vld1q_u8(ix);
+    const uint8x16_t vwx = vld1q_u8(wx);
+
+    // pixels 0,1 in the low half, 2,3 in the high half
+    const uint16x8_t top_lo = vmlal_u8(vmull_u8(vget_low_u8(p00), vget_low_u8(vix)), vget_low_u8(p01), vget_low_u8(vwx));
+    const uint16x8_t top_hi = vmlal_u8(vmull_u8(vget_high_u8(p00), vget_high_u8(vix)), vget_high_u8(p01), vget_high_u8(vwx));
+    const uint16x8_t bot_lo = vmlal_u8(vmull_u8(vget_low_u8(p10), vget_low_u8(vix)), vget_low_u8(p11), vget_low_u8(vwx));
+    const uint16x8_t bot_hi = vmlal_u8(vmull_u8(vget_high_u8(p10), vget_high_u8(vix)), vget_high_u8(p11), vget_high_u8(vwx));
+
+    const uint16x8_t iy_lo = vld1q_u16(iy), iy_hi = vld1q_u16(iy + 8);
+    const uint16x8_t wy_lo = vld1q_u16(wy), wy_hi = vld1q_u16(wy + 8);
+
+    const uint32x4_t r0 = vmlal_u16(vmull_u16(vget_low_u16(top_lo), vget_low_u16(iy_lo)), vget_low_u16(bot_lo), vget_low_u16(wy_lo));
+    const uint32x4_t r1 = vmlal_u16(vmull_u16(vget_high_u16(top_lo), vget_high_u16(iy_lo)), vget_high_u16(bot_lo), vget_high_u16(wy_lo));
+    const uint32x4_t r2 = vmlal_u16(vmull_u16(vget_low_u16(top_hi), vget_low_u16(iy_hi)), vget_low_u16(bot_hi), vget_low_u16(wy_hi));
+    const uint32x4_t r3 = vmlal_u16(vmull_u16(vget_high_u16(top_hi), vget_high_u16(iy_hi)), vget_high_u16(bot_hi), vget_high_u16(wy_hi));
+
+    // Rounding shift adds the same 512 as the scalar path
+    const uint16x8_t lo = vcombine_u16(vrshrn_n_u32(r0, 10), vrshrn_n_u32(r1, 10));
+    const uint16x8_t hi = vcombine_u16(vrshrn_n_u32(r2, 10), vrshrn_n_u32(r3, 10));
+    const uint8x16_t bgrx = vcombine_u8(vqmovn_u16(lo), vqmovn_u16(hi));
+
+    static const uint8_t drop_x[16] = {0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, 255, 255, 255, 255};
+    vst1q_u8(out, vqtbl1q_u8(bgrx, vld1q_u8(drop_x)));
+}
+
+#define SIMD_PIXELS 4
+
+#else
+
+#define SIMD_PIXELS 0
+
+#endif
+
+} // namespace
+
+const std::vector<ViewDirection>& default_views() {
+    static const std::vector<ViewDirection> views = {
+        { "right", 90, 0 },
+        { "back", 180, 0 },
+        { "left", 270, 0 },
+        { "front", 0, 0 },
+    };
+    return views;
+}
+
+void compute_view_map(int src_width, int src_height, double fov_deg, double yaw_deg, double pitch_deg,
+                      int out_width, int out_height, float* uf, float* vf) {
+    const double z = 1.0 / std::tan(radians(fov_deg) / 2.0);
+    const double cos_yaw = std::cos(radians(yaw_deg)), sin_yaw = std::sin(radians(yaw_deg));
+    const double cos_pitch = std::cos(radians(pitch_deg)), sin_pitch = std::sin(radians(pitch_deg));
+
+    for (int j = 0; j < out_height; ++j) {
+        // np.linspace(-1, 1) flipped vertically like meshgrid(x, -y)
+        const double y = out_height > 1 ? 1.0 - 2.0 * j / (out_height - 1) : 0.0;
+
+        for (int i = 0; i < out_width; ++i) {
+            const double x = out_width > 1 ? -1.0 + 2.0 * i / (out_width - 1) : 0.0;
+            const double norm = std::sqrt(x * x + y * y + z * z);
+            const double nx = x / norm, ny = y / norm, nz = z / norm;
+
+            // rot_yaw(yaw) @ rot_pitch(pitch)
+            const double py = cos_pitch * ny - sin_pitch * nz;
+            const double pz = sin_pitch * ny + cos_pitch * nz;
+            const double rx = cos_yaw * nx + sin_yaw * pz;
+            const double rz = -sin_yaw * nx + cos_yaw * pz;
+
+            const double lon = std::atan2(rx, rz);
+            const double lat = std::asin(std::max(-1.0, std::min(1.0, py)));
+
+            const size_t index = static_cast<size_t>(j) * out_width + i;
+            uf[index] = static_cast<float>((lon / PI + 1.0) / 2.0 * src_width);
+            vf[index] = static_cast<float>((0.5 - lat / PI) * src_height);
+        }
+    }
+}
+
+void view_point_to_yaw_pitch(double fov_deg, double view_yaw_deg, double view_pitch_deg, int out_width, int out_height,
+                             double x, double y, double& yaw_deg, double& pitch_deg) {
+    const double z = 1.0 / std::tan(radians(fov_deg) / 2.0);
+    const double cos_yaw = std::cos(radians(view_yaw_deg)), sin_yaw = std::sin(radians(view_yaw_deg));
+    const double cos_pitch = std::cos(radians(view_pitch_deg)), sin_pitch = std::sin(radians(view_pitch_deg));
+
+    const double nx0 = out_width > 1 ? -1.0 + 2.0 * x / (out_width - 1) : 0.0;
+    const double ny0 = out_height > 1 ? 1.0 - 2.0 * y / (out_height - 1) : 0.0;
+    const double norm = std::sqrt(nx0 * nx0 + ny0 * ny0 + z * z);
+    const double nx = nx0 / norm, ny = ny0 / norm, nz = z / norm;
+
+    const double py = cos_pitch * ny - sin_pitch * nz;
+    const double pz = sin_pitch * ny + cos_pitch * nz;
+    const double rx = cos_yaw * nx + sin_yaw * pz;
+    const double rz = -sin_yaw * nx + cos_yaw * pz;
+
+    yaw_deg = std::atan2(rx, rz) * 180.0 / PI;
+    pitch_deg = std::asin(std::max(-1.0, std::min(1.0, py))) * 180.0 / PI;
+}
+
+RemapLut build_remap_lut(int src_width, int src_height, size_t src_stride, const float* uf, const float* vf,
+                         int out_width, int out_height) {
+    RemapLut lut;
+    lut.src_width = src_width;
+    lut.src_height = src_height;
+    lut.src_stride = src_stride;
+    lut.width = out_width;
+    lut.height = out_height;
+
+    const size_t count = static_cast<size_t>(out_width) * out_height;
+    lut.offset.resize(count);
+    lut.right.resize(count);
+    lut.weights.resize(count);
+    lut.row_safe.resize(out_height);
+    lut.mean_src_row.resize(out_height);
+
+    const int64_t src_bytes = static_cast<int64_t>(src_height) * src_stride;
+    const int32_t wrap = -(src_width - 1) * 3;
+
+    for (int j = 0; j < out_height; ++j) {
+        bool safe = true;
+        double row_sum = 0.0;
+
+        for (int i = 0; i < out_width; ++i) {
+            const size_t index = static_cast<size_t>(j) * out_width + i;
+
+            const long ufix = std::lround(static_cast<double>(uf[index]) * RemapLut::ONE);
+            int x0 = static_cast<int>(ufix >> RemapLut::FRACTION_BITS);
+            const int wx = static_cast<int>(ufix & (RemapLut::ONE - 1));
+            x0 = ((x0 % src_width) + src_width) % src_width;
+
+            // Vertically clamp instead of wrapping, it only matters on the pole rows
+            const long vfix = std::lround(static_cast<double>(vf[index]) * RemapLut::ONE);
+            int y0 = static_cast<int>(vfix >> RemapLut::FRACTION_BITS);
+            int wy = static_cast<int>(vfix & (RemapLut::ONE - 1));
+            if (vfix < 0) {
+                y0 = 0;
+                wy = 0;
+            }
+            else if (y0 >= src_height - 1) {
+                y0 = src_height - 2;
+                wy = RemapLut::ONE;
+            }
+
+            const int32_t offset = static_cast<int32_t>(y0 * static_cast<int64_t>(src_stride) + x0 * 3);
+            const int32_t right = x0 == src_width - 1 ? wrap : 3;
+
+            lut.offset[index] = offset;
+            lut.right[index] = right;
+            lut.weights[index] = static_cast<uint16_t>(wx | (wy << 8));
+
+            // bottom right corner read as a 4 byte word
+            if (static_cast<int64_t>(offset) + static_cast<int64_t>(src_stride) + std::max(right, 0) + 4 > src_bytes) {
+                safe = false;
+            }
+            row_sum += y0;
+        }
+
+        lut.row_safe[j] = safe ? 1 : 0;
+        lut.mean_src_row[j] = static_cast<float>(row_sum / std::max(1, out_width));
+    }
+
+    return lut;
+}
+
+RemapLut build_remap_lut(int src_width, int src_height, size_t src_stride, double fov_deg,
+                         double yaw_deg, double pitch_deg, int out_width, int out_height) {
+    const size_t count = static_cast<size_t>(out_width) * out_height;
+    std::vector<float> uf(count), vf(count);
+    compute_view_map(src_width, src_height, fov_deg, yaw_deg, pitch_deg, out_width, out_height, uf.data(), vf.data());
+    return build_remap_lut(src_width, src_height, src_stride, uf.data(), vf.data(), out_width, out_height);
+}
+
+namespace {
+
+// One output row from per pixel corner offsets and weights, SIMD when the row is safe to read in words
+void sample_row(const ImageView& src, const int32_t* offset, const int32_t* right, const uint16_t* weight,
+                int width, bool safe, uint8_t* out) {
+    int i = 0;
+#if defined(__AVX2__)
+    if (safe) {
+        const int32_t stride = static_cast<int32_t>(src.stride);
+        for (; i + SIMD_PIXELS + 2 <= width; i += SIMD_PIXELS) {
+            remap_8_avx2(src.data, stride, offset + i, right + i, weight + i, out + i * 3);
+        }
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    if (safe) {
+        const int32_t stride = static_cast<int32_t>(src.stride);
+        for (; i + SIMD_PIXELS + 2 <= width; i += SIMD_PIXELS) {
+            remap_4_neon(src.data, stride, offset + i, right + i, weight + i, out + i * 3);
+        }
+    }
+#else
+    (void)safe;
+#endif
+    for (; i < width; ++i) {
+        remap_pixel_scalar(src.data, src.stride, offset[i], right[i], weight[i], out + i * 3);
+    }
+}
+
+} // namespace
+
+void remap_rows(const ImageView& src, const RemapLut& lut, const ImageView& dst, int y_begin, int y_end) {
+    for (int j = y_begin; j < y_end; ++j) {
+        const size_t row = static_cast<size_t>(j) * lut.width;
+        sample_row(src, lut.offset.data() + row, lut.right.data() + row, lut.weights.data() + row,
+                   lut.width, lut.row_safe[j] != 0, dst.row(j));
+    }
+}
+
+ViewMap build_view_map(int src_width, int src_height, size_t src_stride, double fov_deg, double pitch_deg,
+                       int out_width, int out_height) {
+    ViewMap map;
+    map.src_width = src_width;
+    map.src_height = src_height;
+    map.src_stride = src_stride;
+    map.width = out_width;
+    map.height = out_height;
+
+    const size_t count = static_cast<size_t>(out_width) * out_height;
+    std::vector<float> uf(count), vf(count);
+    compute_view_map(src_width, src_height, fov_deg, 0.0, pitch_deg, out_width, out_height, uf.data(), vf.data());
+
+    map.u.resize(count);
+    map.row_offset.resize(count);
+    map.wy.resize(count);
+    map.row_safe.resize(out_height);
+
+    const int64_t u_range = static_cast<int64_t>(src_width) * RemapLut::ONE;
+    const int64_t src_bytes = static_cast<int64_t>(src_height) * src_stride;
+
+    for (int j = 0; j < out_height; ++j) {
+        int64_t last_row = 0;
+        for (int i = 0; i < out_width; ++i) {
+            const size_t index = static_cast<size_t>(j) * out_width + i;
+
+            const int64_t ufix = std::lround(static_cast<double>(uf[index]) * RemapLut::ONE);
+            map.u[index] = static_cast<int32_t>(((ufix % u_range) + u_range) % u_range);
+
+            // Same vertical clamp as build_remap_lut
+            const long vfix = std::lround(static_cast<double>(vf[index]) * RemapLut::ONE);
+            int y0 = static_cast<int>(vfix >> RemapLut::FRACTION_BITS);
+            int wy = static_cast<int>(vfix & (RemapLut::ONE - 1));
+            if (vfix < 0) {
+                y0 = 0;
+                wy = 0;
+            }
+            else if (y0 >= src_height - 1) {
+                y0 = src_height - 2;
+                wy = RemapLut::ONE;
+            }
+
+            map.row_offset[index] = static_cast<int32_t>(y0 * static_cast<int64_t>(src_stride));
+            map.wy[index] = static_cast<uint8_t>(wy);
+            last_row = std::max<int64_t>(last_row, map.row_offset[index]);
+        }
+
+        // Any yaw can put a corner on the last column: the furthest 4 byte read of the row
+        map.row_safe[j] = last_row + static_cast<int64_t>(src_stride) + (src_width - 1) * 3 + 4 <= src_bytes ? 1 : 0;
+    }
+
+    return map;
+}
+
+void remap_rows_yaw(const ImageView& src, const ViewMap& map, double yaw_deg, const ImageView& dst, int y_begin, int y_end) {
+    const int32_t u_range = map.src_width * RemapLut::ONE;
+    int32_t shift = static_cast<int32_t>(std::lround(yaw_deg / 360.0 * u_range) % u_range);
+    if (shift < 0) shift += u_range;
+    const int32_t wrap = -(map.src_width - 1) * 3;
+
+    std::vector<int32_t> offset(map.width), right(map.width);
+    std::vector<uint16_t> weight(map.width);
+
+    for (int j = y_begin; j < y_end; ++j) {
+        const size_t row = static_cast<size_t>(j) * map.width;
+        const int32_t* u = map.u.data() + row;
+        const int32_t* row_offset = map.row_offset.data() + row;
+        const uint8_t* wy = map.wy.data() + row;
+
+        for (int i = 0; i < map.width; ++i) {
+            int32_t turned = u[i] + shift;
+            if (turned >= u_range) turned -= u_range;
+            const int32_t x0 = turned >> RemapLut::FRACTION_BITS;
+            offset[i] = row_offset[i] + x0 * 3;
+            right[i] = x0 == map.src_width - 1 ? wrap : 3;
+            weight[i] = static_cast<uint16_t>((turned & (RemapLut::ONE - 1)) | (wy[i] << 8));
+        }
+
+        sample_row(src, offset.data(), right.data(), weight.data(), map.width, map.row_safe[j] != 0, dst.row(j));
+    }
+}
+
+ViewMapCache::ViewMapCache(size_t capacity, double pitch_step_deg)
+    : capacity_(std::max<size_t>(capacity, 1)), pitch_step_deg_(pitch_step_deg > 0.0 ? pitch_step_deg : 0.1) {}
+
+std::shared_ptr<const ViewMap> ViewMapCache::get(int src_width, int src_height, size_t src_stride, double fov_deg,
+                                                 double pitch_deg, int out_width, int out_height) {
+    const int64_t pitch_step = std::llround(pitch_deg / pitch_step_deg_);
+    const Key key(src_width, src_height, src_stride, fov_deg, pitch_step, out_width, out_height);
+
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+        ++hits_;
+        entries_.splice(entries_.begin(), entries_, it->second);
+        return it->second->second;
+    }
+
+    ++misses_;
+    auto map = std::make_shared<const ViewMap>(build_view_map(src_width, src_height, src_stride, fov_deg,
+                                                              pitch_step * pitch_step_deg_, out_width, out_height));
+    entries_.emplace_front(key, map);
+    index_[key] = entries_.begin();
+
+    if (entries_.size() > capacity_) {
+        index_.erase(entries_.back().first);
+        entries_.pop_back();
+    }
+    return map;
+}
+
+EquirectRemapper::EquirectRemapper(std::vector<ViewDirection> views, double fov_deg, int out_width, int out_height, unsigned threads)
+    : views_(std::move(views)), fov_deg_(fov_deg), out_width_(out_width), out_height_(out_height), pool_(threads) {}
+
+void EquirectRemapper::precompute_mappings(int src_width, int src_height, size_t src_stride) {
+    luts_.resize(views_.size());
+    pool_.parallel_for(views_.size(), [&](size_t v) {
+        luts_[v] = build_remap_lut(src_width, src_height, src_stride, fov_deg_,
+                                   views_[v].yaw_deg, views_[v].pitch_deg, out_width_, out_height_);
+    });
+
+    tiles_.clear();
+    for (size_t v = 0; v < luts_.size(); ++v) {
+        for (int y = 0; y < out_height_; y += TILE_ROWS) {
+            Tile tile;
+            tile.view = static_cast<int>(v);
+            tile.y_begin = y;
+            tile.y_end = std::min(out_height_, y + TILE_ROWS);
+
+            double sum = 0.0;
+            for (int j = tile.y_begin; j < tile.y_end; ++j) {
+                sum += luts_[v].mean_src_row[j];
+            }
+            tile.src_row = static_cast<float>(sum / (tile.y_end - tile.y_begin));
+            tiles_.push_back(tile);
+        }
+    }
+
+    // Bands of every view reading the same source rows end up next to each other
+    std::stable_sort(tiles_.begin(), tiles_.end(), [](const Tile& a, const Tile& b) { return a.src_row < b.src_row; });
+}
+
+void EquirectRemapper::process(const ImageView& src, const std::vector<ImageView>& outputs) {
+    if (luts_.empty() || luts_[0].src_width != src.width || luts_[0].src_height != src.height || luts_[0].src_stride != src.stride) {
+        precompute_mappings(src.width, src.height, src.stride);
+    }
+
+    pool_.parallel_for(tiles_.size(), [&](size_t t) {
+        const Tile& tile = tiles_[t];
+        remap_rows(src, luts_[tile.view], outputs[tile.view], tile.y_begin, tile.y_end);
+    });
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+#include "image.h"
+#include "thread_pool.h"
+
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+// C++ port of EquirectProcessor.py. Projects an equirectangular frame into a set of
+// perspective views with bilinear sampling and horizontal wrap around (cv2.BORDER_WRAP).
+// The sampling kernels use AVX2 or NEON when the compiler targets them (-mavx2, aarch64)
+// and fall back to scalar code otherwise
+
+// All angles in degrees, same convention as VIEWS in track-goalkeeper.py
+struct ViewDirection {
+    std::string name;
+    double yaw_deg = 0.0;
+    double pitch_deg = 0.0;
+};
+
+// The VIEWS table used by the goalkeeper tracker
+const std::vector<ViewDirection>& default_views();
+
+// Same math as compute_mapping_tables: fills uf/vf (out_width * out_height each) with the
+// source coordinates sampled by every output pixel
+void compute_view_map(int src_width, int src_height, double fov_deg, double yaw_deg, double pitch_deg,
+                      int out_width, int out_height, float* uf, float* vf);
+
+// Inverse of compute_view_map for one point: the direction seen by output pixel (x, y) of the view,
+// as longitude (yaw) and latitude (pitch, up positive). Same result as yolo_box_to_yaw_pitch on a box
+// centre, so rendering that point in the middle of a view takes remap pitch = -pitch_deg
+void view_point_to_yaw_pitch(double fov_deg, double view_yaw_deg, double view_pitch_deg, int out_width, int out_height,
+                             double x, double y, double& yaw_deg, double& pitch_deg);
+
+// Fixed point lookup table of one view for a given source size. Fractions are stored in 1/32
+// of a pixel like OpenCV's fixed point remap
+struct RemapLut {
+    static constexpr int FRACTION_BITS = 5;
+    static constexpr int ONE = 1 << FRACTION_BITS;
+
+    int src_width = 0;
+    int src_height = 0;
+    size_t src_stride = 0;
+    int width = 0;
+    int height = 0;
+
+    std::vector<int32_t> offset;   // byte offset of the top left source pixel
+    std::vector<int32_t> right;    // byte delta to its right neighbour, negative when wrapping around
+    std::vector<uint16_t> weights; // wx | wy << 8
+    std::vector<uint8_t> row_safe; // 1 when a 4 byte read of every corner of the row stays inside the source
+    std::vector<float> mean_src_row; // average source row of every output row, used to order the tiles
+};
+
+RemapLut build_remap_lut(int src_width, int src_height, size_t src_stride, const float* uf, const float* vf,
+                         int out_width, int out_height);
+
+RemapLut build_remap_lut(int src_width, int src_height, size_t src_stride, double fov_deg,
+                         double yaw_deg, double pitch_deg, int out_width, int out_height);
+
+// Samples rows [y_begin, y_end) of dst from src
+void remap_rows(const ImageView& src, const RemapLut& lut, const ImageView& dst, int y_begin, int y_end);
+
+// Map of a view looking at yaw 0. Turning the view only adds a constant to the source column
+// (the longitude), so one map serves every yaw at its pitch: the yaw is added to u while sampling
+struct ViewMap {
+    int src_width = 0;
+    int src_height = 0;
+    size_t src_stride = 0;
+    int width = 0;
+    int height = 0;
+
+    std::vector<int32_t> u;          // source column in 1/32 of a pixel, in [0, src_width * 32)
+    std::vector<int32_t> row_offset; // byte offset of the top source row
+    std::vector<uint8_t> wy;         // vertical weight
+    std::vector<uint8_t> row_safe;   // 1 when 4 byte reads of every corner of the row stay inside the source
+};
+
+ViewMap build_view_map(int src_width, int src_height, size_t src_stride, double fov_deg, double pitch_deg,
+                       int out_width, int out_height);
+
+// Samples rows [y_begin, y_end) of dst from src for the view of map turned by yaw_deg. Same result as
+// remap_rows with a lookup table built for that yaw, up to 1/32 of a pixel of rounding
+void remap_rows_yaw(const ImageView& src, const ViewMap& map, double yaw_deg, const ImageView& dst, int y_begin, int y_end);
+
+// LRU bounded ViewMaps keyed by source size, fov, output size and pitch rounded to pitch_step_deg.
+// A camera path that keeps moving then costs one sampling pass per frame instead of a new lookup
+// table: yaw changes are free and a new map is only built when the pitch crosses a step
+class ViewMapCache {
+public:
+    explicit ViewMapCache(size_t capacity = 32, double pitch_step_deg = 0.1);
+
+    // Map for the pitch rounded to the step, built on a miss. Stays valid while the caller holds it
+    std::shared_ptr<const ViewMap> get(int src_width, int src_height, size_t src_stride, double fov_deg,
+                                       double pitch_deg, int out_width, int out_height);
+
+    size_t hits() const { return hits_; }
+    size_t misses() const { return misses_; }
+
+private:
+    using Key = std::tuple<int, int, size_t, double, int64_t, int, int>;
+    using Entry = std::pair<Key, std::shared_ptr<const ViewMap>>;
+
+    size_t capacity_;
+    double pitch_step_deg_;
+    std::list<Entry> entries_; // most recently used first
+    std::map<Key, std::list<Entry>::iterator> index_;
+    size_t hits_ = 0;
+    size_t misses_ = 0;
+};
+
+class EquirectRemapper {
+public:
+    // threads == 0 -> one per hardware thread
+    EquirectRemapper(std::vector<ViewDirection> views, double fov_deg, int out_width, int out_height, unsigned threads = 0);
+
+    // Builds the lookup tables for a source size. process() calls it by itself when the size changes
+    void precompute_mappings(int src_width, int src_height, size_t src_stride);
+
+    // Renders every view (outputs[i] is views()[i]) in one pass over the source. The work is split
+    // in bands of output rows ordered by the source rows they read, so the threads sweep the
+    // equirectangular frame from top to bottom together and it stays in cache
+    void process(const ImageView& src, const std::vector<ImageView>& outputs);
+
+    const std::vector<ViewDirection>& views() const { return views_; }
+    int output_width() const { return out_width_; }
+    int output_height() const { return out_height_; }
+    ThreadPool& pool() { return pool_; }
+
+private:
+    struct Tile {
+        int view;
+        int y_begin;
+        int y_end;
+        float src_row;
+    };
+
+    std::vector<ViewDirection> views_;
+    double fov_deg_;
+    int out_width_;
+    int out_height_;
+
+    std::vector<RemapLut> luts_;
+    std::vector<Tile> tiles_;
+    ThreadPool pool_;
+};
@@ -0,0 +1,142 @@
+#include "fake_stitch_backend.h"
+#include "mp4_info.h"
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+
+namespace {
+
+// Per output megapixel, roughly how the SDK stitch types compare on a mid range GPU
+double type_ms_per_megapixel(StitchType type) {
+    switch (type) {
+    case StitchType::TEMPLATE: return 2.0;
+    case StitchType::OPTFLOW: return 6.0;
+    case StitchType::DYNAMICSTITCH: return 9.0;
+    case StitchType::AIFLOW: return 14.0;
+    }
+    return 6.0;
+}
+
+void write_file(const std::filesystem::path& path, uint64_t bytes) {
+    std::error_code ec;
+    std::filesystem::create_directories(path.parent_path(), ec);
+    { std::ofstream out(path, std::ios::binary | std::ios::trunc); }
+    std::filesystem::resize_file(path, bytes, ec);
+}
+
+} // namespace
+
+double fake_frame_ms(const StitchOptions& options) {
+    const double megapixels = double(options.output_width) * options.output_height / 1e6;
+    double ms = type_ms_per_megapixel(options.stitch_type) * megapixels;
+    if (options.enable_sequence_denoise) {
+        ms *= 1.8;
+    }
+    if (options.enable_colorplus) {
+        ms *= 1.3;
+    }
+    if (options.enable_H265_encoder) {
+        ms *= 1.15;
+    }
+    if (options.enable_soft_encode) {
+        ms += (options.enable_H265_encoder ? 9.0 : 4.0) * megapixels;
+    }
+    if (options.enable_soft_decode) {
+        ms += 3.0 * megapixels;
+    }
+    return ms;
+}
+
+uint64_t fake_output_bytes(const StitchOptions& options, uint64_t frames, double fps) {
+    if (fps <= 0) {
+        fps = 30;
+    }
+    double bits_per_second = options.output_bitrate;
+    if (bits_per_second <= 0) {
+        bits_per_second = 0.1 * options.output_width * options.output_height * fps;
+        if (options.enable_H265_encoder) {
+            bits_per_second *= 0.6;
+        }
+    }
+    return uint64_t(bits_per_second / 8 * frames / fps);
+}
+
+FakeStitchBackend::FakeStitchBackend(FakeStitchSettings settings) : settings_(settings) {}
+
+FakeStitchBackend::~FakeStitchBackend() {
+    cancelled_ = true;
+    if (worker_.joinable()) {
+        worker_.join();
+    }
+}
+
+void FakeStitchBackend::start(const std::vector<std::string>& input_paths, const std::string& output_path,
+                              const StitchOptions& options, ProgressCallback on_progress, ErrorCallback on_error) {
+    uint64_t frames = settings_.frames;
+    double fps = 30;
+    if (!input_paths.empty()) {
+        Mp4Info info = read_mp4_info(input_paths[0]);
+        if (info.valid && info.fps > 0) {
+            fps = info.fps;
+        }
+        if (frames == 0) {
+            frames = info.frame_count;
+        }
+    }
+    if (frames == 0) {
+        frames = 300;
+    }
+    if (!options.export_frame_nums.empty() && !options.image_sequence_dir.empty()) {
+        frames = options.export_frame_nums.size();
+    }
+
+    cancelled_ = false;
+    worker_ = std::thread([this, frames, fps, output_path, options, on_progress, on_error] {
+        const auto frame_cost = std::chrono::duration<double, std::milli>(fake_frame_ms(options) * settings_.time_scale);
+        auto next = std::chrono::steady_clock::now();
+        int reported = -1;
+
+        // Image sequences are written frame by frame like the SDK does, readers of the directory see them arrive
+        const bool images = settings_.write_output && !options.image_sequence_dir.empty();
+        const char* extension = options.image_type == ImageType::PNG ? ".png" : ".jpg";
+        const std::filesystem::path dir(options.image_sequence_dir);
+
+        for (uint64_t frame = 0; frame < frames; ++frame) {
+            if (cancelled_) {
+                on_error(CANCELLED, "stitch cancelled");
+                return;
+            }
+
+            // Progress only moves on whole percents, like the SDK
+            const int progress = int(frame * 100 / frames);
+            if (progress != reported) {
+                if (settings_.fail_at >= 0 && progress >= settings_.fail_at) {
+                    on_error(settings_.error_code, "fake stitcher failure at " + std::to_string(progress) + "%");
+                    return;
+                }
+                reported = progress;
+                on_progress(progress);
+            }
+
+            // Sleeping until an absolute time keeps small costs from drifting
+            next += std::chrono::duration_cast<std::chrono::steady_clock::duration>(frame_cost);
+            std::this_thread::sleep_until(next);
+
+            if (images) {
+                // Empty frames, only the names match what the SDK writes
+                const uint64_t number = options.export_frame_nums.empty() ? frame : options.export_frame_nums[frame];
+                write_file(dir / (std::to_string(number) + extension), 0);
+            }
+        }
+
+        if (settings_.write_output && options.image_sequence_dir.empty()) {
+            write_file(output_path, fake_output_bytes(options, frames, fps));
+        }
+        on_progress(100);
+    });
+}
+
+void FakeStitchBackend::cancel() {
+    cancelled_ = true;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "stitch_backend.h"
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+// How the fake stitcher behaves. Frame costs are made up but deterministic so runs can be compared
+struct FakeStitchSettings {
+    uint64_t frames = 0;       // 0 -> frame count of the first input, 300 if it can't be read
+    double time_scale = 1.0;   // multiplies every frame cost, < 1 to run the matrix quickly
+    int fail_at = -1;          // progress at which the job fails, < 0 -> never
+    int error_code = -1;       // error reported on failure
+    bool write_output = true;  // create the output file (sparse) with the size the model predicts
+};
+
+// Milliseconds one frame costs with the given options, the model behind FakeStitchBackend.
+// Scales with output pixels and stitch type, denoise/colorplus/software codecs add on top
+double fake_frame_ms(const StitchOptions& options);
+
+// Bytes of output the fake writes for `frames` frames
+uint64_t fake_output_bytes(const StitchOptions& options, uint64_t frames, double fps);
+
+// Stand-in for the SDK: one worker thread sleeps through the frames and reports progress like
+// VideoStitcher does, errors included
+class FakeStitchBackend : public StitchBackend {
+public:
+    explicit FakeStitchBackend(FakeStitchSettings settings = {});
+    ~FakeStitchBackend() override;
+
+    void start(const std::vector<std::string>& input_paths, const std::string& output_path,
+               const StitchOptions& options, ProgressCallback on_progress, ErrorCallback on_error) override;
+    void cancel() override;
+
+    static const int CANCELLED = -2;
+
+private:
+    FakeStitchSettings settings_;
+    std::atomic<bool> cancelled_{ false };
+    std::thread worker_;
+};
@@ -0,0 +1,151 @@
+#include "ffmpeg.h"
+#include "mp4_info.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#ifndef WIN32
+#include <spawn.h>
+#include <sys/wait.h>
+
+extern char** environ;
+#endif
+
+namespace {
+
+std::string ffmpeg_binary() {
+    const char* binary = std::getenv("FFMPEG_BINARY");
+    return binary ? binary : "ffmpeg";
+}
+
+std::string quote(const std::string& arg) {
+    std::string quoted = "\"";
+    for (char c : arg) {
+        if (c == '"' || c == '\\') quoted += '\\';
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+// Started without a shell where possible, a $ or a backtick in a path is just a character
+bool run(const std::vector<std::string>& args) {
+    std::vector<std::string> argv = { ffmpeg_binary(), "-hide_banner", "-loglevel", "error", "-y" };
+    argv.insert(argv.end(), args.begin(), args.end());
+
+    std::string command;
+    for (const auto& arg : argv) {
+        command += (command.empty() ? "" : " ") + quote(arg);
+    }
+
+#ifdef WIN32
+    const bool ok = std::system(command.c_str()) == 0;
+#else
+    std::vector<char*> pointers;
+    for (auto& arg : argv) pointers.push_back(&arg[0]);
+    pointers.push_back(nullptr);
+
+    pid_t pid = 0;
+    int status = 0;
+    bool ok = posix_spawnp(&pid, pointers[0], nullptr, nullptr, pointers.data(), environ) == 0;
+    if (ok) {
+        pid_t waited;
+        while ((waited = waitpid(pid, &status, 0)) < 0 && errno == EINTR) {}
+        ok = waited == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+#endif
+
+    if (!ok) {
+        std::cout << "ffmpeg failed: " << command << std::endl;
+    }
+    return ok;
+}
+
+// Single quoted for the concat demuxer, a quote inside is closed, escaped and reopened
+std::string concat_quote(const std::string& path) {
+    std::string quoted = "'";
+    for (char c : path) {
+        quoted += c == '\'' ? std::string("'\\''") : std::string(1, c);
+    }
+    return quoted + "'";
+}
+
+std::string seconds(double value) {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(6) << value;
+    return out.str();
+}
+
+// Exact decimal seconds rounded up to the microsecond ffmpeg parses times in: the seek then lands on
+// the frame itself and never on the keyframe before it
+std::string ticks_to_seconds(uint64_t ticks, uint32_t timescale) {
+    const uint64_t micros = (ticks * 1000000 + timescale - 1) / timescale;
+    std::ostringstream out;
+    out << micros / 1000000 << '.' << std::setw(6) << std::setfill('0') << micros % 1000000;
+    return out.str();
+}
+
+bool append_insta360_trailer(const std::string& input, const std::string& output) {
+    const uint64_t size = insta360_trailer_size(input);
+    if (size == 0) return true;
+
+    std::ifstream in(input, std::ios::binary);
+    std::ofstream out(output, std::ios::binary | std::ios::app);
+    in.seekg(-static_cast<std::streamoff>(size), std::ios::end);
+    std::vector<char> buffer(1 << 20);
+    for (uint64_t left = size; left > 0 && in && out;) {
+        const size_t chunk = static_cast<size_t>(std::min<uint64_t>(left, buffer.size()));
+        in.read(buffer.data(), chunk);
+        out.write(buffer.data(), in.gcount());
+        left -= static_cast<uint64_t>(in.gcount());
+    }
+    if (!in || !out) {
+        std::cout << "Failed to copy the Insta360 trailer of " << input << " to " << output << std::endl;
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+bool ffmpeg_copy_range(const std::string& input, const std::string& output, uint64_t start_frame, uint64_t frames) {
+    const Mp4Info info = read_mp4_info(input);
+    if (!info.valid || info.timescale == 0) {
+        std::cout << "Failed to read the sample times of " << input << std::endl;
+        return false;
+    }
+
+    // -ss before -i seeks to the last keyframe at or before that time, which is exactly start_frame.
+    // The format is explicit, nothing claims the .insv extension
+    const std::string start = ticks_to_seconds(frame_time_ticks(info, start_frame), info.timescale);
+    if (!run({ "-ss", start, "-i", input, "-map", "0", "-c", "copy", "-frames:v", std::to_string(frames), "-f", "mp4", output })) {
+        return false;
+    }
+    return append_insta360_trailer(input, output);
+}
+
+bool ffmpeg_concat(const std::vector<ConcatPart>& parts, const std::string& output) {
+    const std::string list_path = output + ".concat.txt";
+    {
+        std::ofstream list(list_path, std::ios::trunc);
+        list << "ffconcat version 1.0\n";
+        for (const auto& part : parts) {
+            // the concat demuxer resolves relative paths against the list file
+            list << "file " << concat_quote(std::filesystem::absolute(part.path).string()) << "\n";
+            if (part.inpoint >= 0.0) list << "inpoint " << seconds(part.inpoint) << "\n";
+            if (part.outpoint >= 0.0) list << "outpoint " << seconds(part.outpoint) << "\n";
+        }
+        if (!list) return false;
+    }
+
+    const bool ok = run({ "-f", "concat", "-safe", "0", "-i", list_path, "-map", "0", "-c", "copy", output });
+
+    std::error_code ec;
+    std::filesystem::remove(list_path, ec);
+    return ok;
+}
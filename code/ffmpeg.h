@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Thin wrappers over the ffmpeg command line for the operations that never re-encode.
+// ffmpeg has to be in the PATH, the binary is picked with FFMPEG_BINARY otherwise
+
+// Copies frames [start_frame, start_frame + frames) of every stream into output, an mp4 whatever its
+// extension. start_frame has to be a keyframe, the cut is done by stream copy from its exact
+// presentation time. The Insta360 trailer of an .insv input (calibration, gyro) is appended to the
+// piece, VideoStitcher can't stitch it without. The trailer is the whole one of the input: its records
+// keep the timeline of the recording while the piece starts at 0, so only a piece starting at frame 0
+// lines up with its gyro. Callers don't cut when StitchOptions::uses_recording_motion()
+bool ffmpeg_copy_range(const std::string& input, const std::string& output, uint64_t start_frame, uint64_t frames);
+
+struct ConcatPart {
+    std::string path;
+    double inpoint = -1.0;  // seconds into the part to start at, < 0 for the beginning
+    double outpoint = -1.0; // seconds into the part to stop at, < 0 for the end
+};
+
+// Joins the parts in order with the concat demuxer and stream copy
+bool ffmpeg_concat(const std::vector<ConcatPart>& parts, const std::string& output);
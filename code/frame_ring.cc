@@ -0,0 +1,65 @@
+#include "frame_ring.h"
+
+FrameRing::FrameRing(size_t capacity, int width, int height) : slots_(capacity) {
+    for (auto& slot : slots_) {
+        slot.image.resize(width, height);
+        free_.push_back(&slot);
+    }
+}
+
+FrameSlot* FrameRing::acquire_write() {
+    std::unique_lock<std::mutex> lck(mutex_);
+    free_cond_.wait(lck, [&] { return aborted_ || !free_.empty(); });
+    if (aborted_) return nullptr;
+
+    FrameSlot* slot = free_.front();
+    free_.pop_front();
+    return slot;
+}
+
+void FrameRing::commit_write(FrameSlot* slot) {
+    {
+        std::unique_lock<std::mutex> lck(mutex_);
+        ready_.push_back(slot);
+    }
+    ready_cond_.notify_one();
+}
+
+void FrameRing::discard_write(FrameSlot* slot) {
+    release_read(slot);
+}
+
+FrameSlot* FrameRing::acquire_read() {
+    std::unique_lock<std::mutex> lck(mutex_);
+    ready_cond_.wait(lck, [&] { return aborted_ || closed_ || !ready_.empty(); });
+    if (aborted_ || ready_.empty()) return nullptr;
+
+    FrameSlot* slot = ready_.front();
+    ready_.pop_front();
+    return slot;
+}
+
+void FrameRing::release_read(FrameSlot* slot) {
+    {
+        std::unique_lock<std::mutex> lck(mutex_);
+        free_.push_back(slot);
+    }
+    free_cond_.notify_one();
+}
+
+void FrameRing::close() {
+    {
+        std::unique_lock<std::mutex> lck(mutex_);
+        closed_ = true;
+    }
+    ready_cond_.notify_all();
+}
+
+void FrameRing::abort() {
+    {
+        std::unique_lock<std::mutex> lck(mutex_);
+        aborted_ = true;
+    }
+    free_cond_.notify_all();
+    ready_cond_.notify_all();
+}
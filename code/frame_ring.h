@@ -0,0 +1,50 @@
+#pragma once
+
+#include "image.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+struct FrameSlot {
+    Image image;
+    uint64_t index = 0; // frame number within the recording
+};
+
+// Bounded single producer / single consumer ring of preallocated frames.
+// The producer decodes straight into a free slot and the consumer reads it in place,
+// so frames are never copied. When every slot is in use the producer blocks (backpressure)
+class FrameRing {
+public:
+    FrameRing(size_t capacity, int width, int height);
+
+    // Blocks until a slot is free. nullptr once the ring has been aborted
+    FrameSlot* acquire_write();
+    void commit_write(FrameSlot* slot);
+    // Hands an acquired slot back without publishing it
+    void discard_write(FrameSlot* slot);
+
+    // Blocks until a frame is ready. nullptr when the producer closed the ring and every frame was read
+    FrameSlot* acquire_read();
+    void release_read(FrameSlot* slot);
+
+    // Producer side: no more frames will be written
+    void close();
+    // Consumer side: stop accepting frames and wake up the producer
+    void abort();
+
+    size_t capacity() const { return slots_.size(); }
+
+private:
+    std::vector<FrameSlot> slots_;
+    std::deque<FrameSlot*> free_;
+    std::deque<FrameSlot*> ready_;
+
+    std::mutex mutex_;
+    std::condition_variable free_cond_;
+    std::condition_variable ready_cond_;
+    bool closed_ = false;
+    bool aborted_ = false;
+};
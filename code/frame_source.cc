@@ -0,0 +1,369 @@
+#include "frame_source.h"
+#include "mp4_info.h"
+
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/videoio.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+namespace {
+
+bool read_file(const std::string& path, std::vector<unsigned char>& buffer) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file) return false;
+    const std::streamsize size = file.tellg();
+    file.seekg(0);
+    buffer.resize(static_cast<size_t>(std::max<std::streamsize>(size, 0)));
+    file.read(reinterpret_cast<char*>(buffer.data()), size);
+    return true;
+}
+
+// Decodes straight into dst when the sizes match
+bool decode_frame(const std::vector<unsigned char>& buffer, const ImageView& dst) {
+    cv::Mat target(dst.height, dst.width, CV_8UC3, dst.data, dst.stride);
+    cv::Mat decoded = cv::imdecode(buffer, cv::IMREAD_COLOR, &target);
+    if (decoded.empty()) return false;
+
+    if (decoded.data != dst.data) {
+        // The stitcher produced a different size than requested
+        cv::Mat wrapper(dst.height, dst.width, CV_8UC3, dst.data, dst.stride);
+        cv::resize(decoded, wrapper, wrapper.size(), 0, 0, cv::INTER_AREA);
+    }
+    return true;
+}
+
+} // namespace
+
+SyntheticEquirectSource::SyntheticEquirectSource(int width, int height, double fps, uint64_t frames) {
+    info_.width = width;
+    info_.height = height;
+    info_.fps = fps;
+    info_.frames = frames;
+}
+
+bool SyntheticEquirectSource::read(const ImageView& dst) {
+    if (info_.frames && next_frame_ >= info_.frames) return false;
+
+    // Background: a colour gradient with a line every 10 degrees. Rendered once, copied per frame
+    if (background_.width() != dst.width || background_.height() != dst.height) {
+        background_.resize(dst.width, dst.height);
+        const ImageView bg = background_.view();
+        const int grid_x = std::max(1, dst.width / 36);
+        const int grid_y = std::max(1, dst.height / 18);
+        for (int y = 0; y < bg.height; ++y) {
+            uint8_t* row = bg.row(y);
+            const bool grid_row = y % grid_y == 0;
+            for (int x = 0; x < bg.width; ++x) {
+                const bool grid = grid_row || x % grid_x == 0;
+                row[x * 3 + 0] = grid ? 255 : static_cast<uint8_t>(x * 255 / bg.width);
+                row[x * 3 + 1] = grid ? 255 : static_cast<uint8_t>(y * 255 / bg.height);
+                row[x * 3 + 2] = grid ? 255 : 64;
+            }
+        }
+    }
+
+    const ImageView bg = background_.view();
+    for (int y = 0; y < dst.height; ++y) {
+        std::memcpy(dst.row(y), bg.row(y), static_cast<size_t>(dst.width) * 3);
+    }
+
+    // Blob going around the horizon once every 10 seconds, slightly below it
+    const double t = next_frame_ / std::max(1.0, info_.fps);
+    const int cx = static_cast<int>(std::fmod(t / 10.0, 1.0) * dst.width);
+    const int cy = dst.height * 5 / 9;
+    const int radius = std::max(2, dst.width / 90);
+    for (int y = std::max(0, cy - radius); y < std::min(dst.height, cy + radius); ++y) {
+        uint8_t* row = dst.row(y);
+        for (int dx = -radius; dx < radius; ++dx) {
+            if (dx * dx + (y - cy) * (y - cy) > radius * radius) continue;
+            const int x = ((cx + dx) % dst.width + dst.width) % dst.width;
+            row[x * 3 + 0] = 0;
+            row[x * 3 + 1] = 0;
+            row[x * 3 + 2] = 255;
+        }
+    }
+
+    ++next_frame_;
+    return true;
+}
+
+std::string default_spool_dir(const std::string& name) {
+    std::error_code ec;
+    std::filesystem::path base = "/dev/shm";
+    if (!std::filesystem::is_directory(base, ec)) {
+        base = std::filesystem::temp_directory_path(ec);
+    }
+    return (base / ("media_conversor_" + name)).string();
+}
+
+StitcherSpoolSource::StitcherSpoolSource(std::vector<std::string> input_paths, StitchOptions options, std::string spool_dir,
+                                         uint64_t spool_bytes)
+    : input_paths_(std::move(input_paths)), options_(std::move(options)), spool_dir_(std::move(spool_dir)),
+      spool_bytes_(spool_bytes) {
+    if (spool_dir_.empty() && !input_paths_.empty()) {
+        spool_dir_ = default_spool_dir(std::filesystem::path(input_paths_[0]).stem().string());
+    }
+}
+
+StitcherSpoolSource::StitcherSpoolSource(std::vector<std::string> input_paths, StitchOptions options, std::vector<FrameRange> ranges,
+                                         std::string spool_dir, uint64_t spool_bytes)
+    : StitcherSpoolSource(std::move(input_paths), std::move(options), std::move(spool_dir), spool_bytes) {
+    ranged_ = true;
+    for (const auto& range : ranges) {
+        if (range.end > range.begin) ranges_.push_back(range);
+    }
+    std::sort(ranges_.begin(), ranges_.end(), [](const FrameRange& a, const FrameRange& b) { return a.begin < b.begin; });
+}
+
+StitcherSpoolSource::~StitcherSpoolSource() {
+    // The reframe stage may stop early, no point in stitching the rest of the recording
+    for (Window* window : { &current_, &next_ }) {
+        if (window->job) {
+            window->job->cancel();
+            window->job->wait();
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::remove_all(spool_dir_, ec);
+}
+
+bool StitcherSpoolSource::open() {
+    if (ranged_ && ranges_.empty()) {
+        error_ = "no frame to stitch in the ranges";
+        return false;
+    }
+
+    const Mp4Info input_info = read_mp4_info(input_paths_.empty() ? "" : input_paths_[0]);
+    info_.width = options_.output_width;
+    info_.height = options_.output_height;
+    info_.fps = input_info.fps > 0.0 ? input_info.fps : 30.0;
+    info_.frames = input_info.frame_count;
+
+    if (!ranged_) {
+        // The export list, consecutive frames merged, or the whole recording
+        std::vector<uint64_t> frames = options_.export_frame_nums;
+        std::sort(frames.begin(), frames.end());
+        frames.erase(std::unique(frames.begin(), frames.end()), frames.end());
+        for (uint64_t frame : frames) {
+            if (!ranges_.empty() && ranges_.back().end == frame) ranges_.back().end = frame + 1;
+            else ranges_.push_back({ frame, frame + 1 });
+        }
+        if (frames.empty()) {
+            if (info_.frames == 0) {
+                error_ = "can't read the frame count of " + (input_paths_.empty() ? std::string() : input_paths_[0]);
+                return false;
+            }
+            ranges_.push_back({ 0, info_.frames });
+        }
+    }
+
+    const uint64_t frame_bytes = uint64_t(std::max(info_.width, 1)) * uint64_t(std::max(info_.height, 1)) * 3;
+    window_frames_ = static_cast<size_t>(std::clamp<uint64_t>(spool_bytes_ / 2 / frame_bytes, 8, 1024));
+
+    // Leftovers of a crashed run would be taken as the first frames
+    std::error_code ec;
+    std::filesystem::remove_all(spool_dir_, ec);
+    std::filesystem::create_directories(spool_dir_, ec);
+    if (ec) return false;
+
+    options_.image_sequence_dir = spool_dir_;
+    options_.image_type = ImageType::PNG;
+    range_index_ = 0;
+    range_frame_ = ranges_.front().begin;
+    current_ = submit_window();
+    next_index_ = 0;
+
+    return true;
+}
+
+StitcherSpoolSource::Window StitcherSpoolSource::submit_window() {
+    Window window;
+    while (window.frames.size() < window_frames_ && range_index_ < ranges_.size()) {
+        if (range_frame_ >= ranges_[range_index_].end) {
+            if (++range_index_ < ranges_.size()) range_frame_ = ranges_[range_index_].begin;
+            continue;
+        }
+        window.frames.push_back(range_frame_++);
+    }
+    if (window.frames.empty()) return window;
+
+    StitchJobSpec spec;
+    spec.input_paths = input_paths_;
+    spec.options = options_;
+    spec.options.export_frame_nums = window.frames;
+    window.job = executor_.submit(std::move(spec));
+    return window;
+}
+
+// Once every frame of the current window was read, and only when its stitch succeeded
+bool StitcherSpoolSource::start_next_window() {
+    if (!current_.job || !current_.job->wait().ok) return false;
+    current_ = next_.job ? std::move(next_) : submit_window();
+    next_ = Window();
+    next_index_ = 0;
+    return current_.job != nullptr;
+}
+
+std::string StitcherSpoolSource::error() const {
+    if (!error_.empty()) return error_;
+    if (!current_.job || !current_.job->done()) return "";
+    return current_.job->wait().error_info;
+}
+
+std::string StitcherSpoolSource::spooled_path(uint64_t frame) const {
+    return (std::filesystem::path(spool_dir_) / (std::to_string(frame) + ".png")).string();
+}
+
+// The frame the stitcher writes next is known, so the spool is never listed. It is completely
+// written once the frame after it exists or the stitcher finished
+bool StitcherSpoolSource::next_spooled_file(std::string& path) {
+    std::error_code ec;
+    while (true) {
+        if (!current_.job) return false;
+        if (next_index_ >= current_.frames.size()) {
+            if (!start_next_window()) return false;
+            continue;
+        }
+
+        const bool done = current_.job->done();
+        // The next window is stitched while the reader drains this one, never further ahead
+        if (done && !next_.job && current_.job->wait().ok) {
+            next_ = submit_window();
+        }
+
+        const uint64_t frame = current_.frames[next_index_];
+        const bool has_following = next_index_ + 1 < current_.frames.size()
+                                   && std::filesystem::exists(spooled_path(current_.frames[next_index_ + 1]), ec);
+
+        if (has_following || done) {
+            if (std::filesystem::exists(spooled_path(frame), ec)) {
+                path = spooled_path(frame);
+                last_frame_ = frame;
+                ++next_index_;
+                return true;
+            }
+            if (!has_following && !current_.job->wait().ok) return false;
+            // Skipped by the stitcher
+            ++next_index_;
+            continue;
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+}
+
+bool StitcherSpoolSource::read(const ImageView& dst) {
+    std::string path;
+    if (!next_spooled_file(path)) return false;
+
+    read_file(path, file_buffer_);
+    std::error_code ec;
+    std::filesystem::remove(path, ec);
+
+    return decode_frame(file_buffer_, dst);
+}
+
+bool StitcherSpoolSource::frame_number(uint64_t& frame) const {
+    if (!current_.job) return false;
+    frame = last_frame_;
+    return true;
+}
+
+ChunkManifestSource::ChunkManifestSource(const std::string& manifest_path, double stall_seconds)
+    : reader_(manifest_path), stall_seconds_(stall_seconds) {}
+
+ChunkManifestSource::~ChunkManifestSource() = default;
+
+bool ChunkManifestSource::open() {
+    // The stream line comes before the first chunk, waiting for that chunk is waiting for the producer
+    has_chunk_ = reader_.next(chunk_, stall_seconds_);
+    if (!reader_.has_stream()) {
+        error_ = "no chunk stream started within " + std::to_string(stall_seconds_) + " s";
+        return false;
+    }
+
+    info_.width = reader_.width();
+    info_.height = reader_.height();
+    info_.fps = reader_.fps();
+    info_.frames = reader_.frames();
+    next_frame_ = has_chunk_ ? chunk_.begin : 0;
+    return true;
+}
+
+bool ChunkManifestSource::next_chunk() {
+    capture_.reset();
+    has_chunk_ = reader_.next(chunk_, stall_seconds_);
+    if (!has_chunk_) {
+        if (reader_.failed()) {
+            error_ = reader_.error();
+        }
+        else if (!reader_.finished()) {
+            error_ = "no new chunk for " + std::to_string(stall_seconds_) + " s";
+        }
+        return false;
+    }
+    if (chunk_.begin != next_frame_) {
+        error_ = "chunk " + std::to_string(chunk_.index) + " starts at frame " + std::to_string(chunk_.begin)
+               + ", expected " + std::to_string(next_frame_);
+        has_chunk_ = false;
+        return false;
+    }
+    return true;
+}
+
+bool ChunkManifestSource::read(const ImageView& dst) {
+    if (!has_chunk_ || next_frame_ >= chunk_.end) {
+        if (!next_chunk()) return false;
+    }
+
+    if (reader_.kind() != "video") {
+        const std::string path = (std::filesystem::path(chunk_.path) / (std::to_string(next_frame_) + "." + reader_.kind())).string();
+        if (!read_file(path, file_buffer_) || !decode_frame(file_buffer_, dst)) {
+            error_ = "failed to read " + path;
+            return false;
+        }
+        ++next_frame_;
+        return true;
+    }
+
+    if (!capture_) {
+        capture_ = std::make_unique<cv::VideoCapture>();
+        if (!capture_->open(chunk_.path)) {
+            error_ = "failed to open " + chunk_.path;
+            return false;
+        }
+        for (uint64_t frame = chunk_.first_frame; frame < chunk_.begin; ++frame) {
+            capture_->grab();
+        }
+    }
+
+    cv::Mat frame;
+    if (!capture_->read(frame) || frame.empty()) {
+        error_ = chunk_.path + " ends before frame " + std::to_string(next_frame_);
+        return false;
+    }
+    cv::Mat wrapper(dst.height, dst.width, CV_8UC3, dst.data, dst.stride);
+    if (frame.size() == wrapper.size()) {
+        frame.copyTo(wrapper);
+    }
+    else {
+        cv::resize(frame, wrapper, wrapper.size(), 0, 0, cv::INTER_AREA);
+    }
+    ++next_frame_;
+    return true;
+}
+
+bool ChunkManifestSource::frame_number(uint64_t& frame) const {
+    if (next_frame_ == 0) return false;
+    frame = next_frame_ - 1;
+    return true;
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include "chunked_output.h"
+#include "image.h"
+#include "range_stitch.h"
+#include "stitch_job.h"
+#include "stitch_options.h"
+#include "stitch_runner.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace cv {
+class VideoCapture;
+}
+
+struct SourceInfo {
+    int width = 0;
+    int height = 0;
+    double fps = 0.0;
+    uint64_t frames = 0; // 0 when unknown
+};
+
+// Anything producing equirectangular BGR24 frames in order
+class EquirectFrameSource {
+public:
+    virtual ~EquirectFrameSource() = default;
+
+    virtual bool open() = 0;
+    virtual SourceInfo info() const = 0;
+
+    // Writes the next frame into dst (already sized to info().width x info().height).
+    // Returns false at the end of the recording or on error
+    virtual bool read(const ImageView& dst) = 0;
+
+    // Number in the recording of the frame read last, for sources that skip frames. Returns false
+    // when the frames simply follow each other from 0
+    virtual bool frame_number(uint64_t& frame) const { (void)frame; return false; }
+
+    virtual std::string error() const { return ""; }
+};
+
+// Stand-in for the stitcher: a grid with a bright blob moving around the horizon.
+// Lets the pipeline run and be measured without the SDK or any footage
+class SyntheticEquirectSource : public EquirectFrameSource {
+public:
+    SyntheticEquirectSource(int width, int height, double fps, uint64_t frames);
+
+    bool open() override { return true; }
+    SourceInfo info() const override { return info_; }
+    bool read(const ImageView& dst) override;
+
+private:
+    SourceInfo info_;
+    uint64_t next_frame_ = 0;
+    Image background_;
+};
+
+// Runs VideoStitcher in image sequence mode against a spool directory (tmpfs when available)
+// and hands every frame over as soon as the next one shows up. Frames are deleted once read.
+// The stitcher can't be paused, so the frames are stitched in windows, one export list each: the
+// next window is stitched while the reader drains the current one and the one after only once the
+// reader reached it, so the spool never holds more than two windows whatever the reader's pace.
+// Windows are sized so that two of them fit in spool_bytes, each is a stitcher start.
+// Frames are spooled as PNG, lossless. What still costs per frame: the stitcher's PNG encode and
+// file write, our read of the file and the decode into the reader's buffer (in place when the size
+// matches, resized otherwise). Only the read goes through a memory copy the decoder doesn't need
+class StitcherSpoolSource : public EquirectFrameSource {
+public:
+    StitcherSpoolSource(std::vector<std::string> input_paths, StitchOptions options, std::string spool_dir = "",
+                        uint64_t spool_bytes = uint64_t(1) << 30);
+    // Only the frames of the ranges, in order
+    StitcherSpoolSource(std::vector<std::string> input_paths, StitchOptions options, std::vector<FrameRange> ranges,
+                        std::string spool_dir = "", uint64_t spool_bytes = uint64_t(1) << 30);
+    ~StitcherSpoolSource() override;
+
+    bool open() override;
+    SourceInfo info() const override { return info_; }
+    bool read(const ImageView& dst) override;
+    // The stitcher names exported frames by their number
+    bool frame_number(uint64_t& frame) const override;
+    std::string error() const override;
+
+private:
+    struct Window {
+        std::vector<uint64_t> frames;
+        std::shared_ptr<StitchJob> job;
+    };
+
+    // The next window_frames_ frames of the ranges, empty past the last one
+    Window submit_window();
+    bool start_next_window();
+    bool next_spooled_file(std::string& path);
+    std::string spooled_path(uint64_t frame) const;
+
+    std::vector<std::string> input_paths_;
+    StitchOptions options_;
+    std::string spool_dir_;
+    uint64_t spool_bytes_;
+    size_t window_frames_ = 0;
+    SourceInfo info_;
+    std::string error_;
+    bool ranged_ = false;
+    std::vector<FrameRange> ranges_; // the non-empty ones, in order; the export list or the whole recording otherwise
+    size_t range_index_ = 0;
+    uint64_t range_frame_ = 0; // next frame of ranges_[range_index_] to put in a window
+
+    StitchExecutor executor_{ 1, 1 };
+    Window current_;
+    Window next_;
+
+    std::vector<unsigned char> file_buffer_;
+    size_t next_index_ = 0; // in current_.frames, of the next frame to read
+    uint64_t last_frame_ = 0;
+};
+
+// Reads the chunks run_chunked_stitch publishes, as they appear, possibly while another process is
+// still stitching the rest. Video chunks skip their pre-roll, image chunks only hold their own frames
+class ChunkManifestSource : public EquirectFrameSource {
+public:
+    // Gives up when the manifest doesn't move for stall_seconds
+    explicit ChunkManifestSource(const std::string& manifest_path, double stall_seconds = 600.0);
+    ~ChunkManifestSource() override;
+
+    bool open() override;
+    SourceInfo info() const override { return info_; }
+    bool read(const ImageView& dst) override;
+    bool frame_number(uint64_t& frame) const override;
+    std::string error() const override { return error_; }
+
+private:
+    bool next_chunk();
+
+    ChunkManifestReader reader_;
+    double stall_seconds_;
+    SourceInfo info_;
+    std::string error_;
+
+    ChunkEntry chunk_;
+    bool has_chunk_ = false;
+    uint64_t next_frame_ = 0; // in the recording
+    std::unique_ptr<cv::VideoCapture> capture_;
+    std::vector<unsigned char> file_buffer_;
+};
+
+// Default place for the spool: /dev/shm when present, the system temp dir otherwise
+std::string default_spool_dir(const std::string& name);
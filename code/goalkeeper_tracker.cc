@@ -0,0 +1,444 @@
+#include "goalkeeper_tracker.h"
+#include "equirect_remap.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+
+using namespace std::chrono;
+
+namespace {
+
+const double PI = 3.14159265358979323846;
+
+// Real heights used to estimate distances, same as object-distance.py
+const double PERSON_HEIGHT_M = 1.7;
+const double BALL_DIAMETER_M = 0.22;
+
+// Velocity uncertainty of a track that was just (re)started, in (degrees per frame)^2
+const double INITIAL_VELOCITY_VARIANCE = 0.25;
+
+// Output size of the cube faces given to the detector, as in track-goalkeeper.py
+const int FACE_WIDTH = 640;
+const int FACE_HEIGHT = 480;
+const double FACE_FOV = 90.0;
+
+// Attention windows are rendered in bands of rows, their fov is rounded up to this and their pitch
+// to whole degrees so the view maps of a steady lock get reused
+const int WINDOW_BAND_ROWS = 32;
+const double WINDOW_FOV_STEP = 5.0;
+
+double seconds_since(steady_clock::time_point start) {
+    return duration_cast<duration<double>>(steady_clock::now() - start).count();
+}
+
+// a - b folded into [-180, 180)
+double angle_diff(double a, double b) {
+    double diff = std::fmod(a - b + 180.0, 360.0);
+    if (diff < 0.0) diff += 360.0;
+    return diff - 180.0;
+}
+
+double normalize_yaw(double yaw) {
+    return angle_diff(yaw, 0.0);
+}
+
+// Pinhole distance from the angular height of the box
+double distance_of(const Detection& detection) {
+    const double real_size = detection.class_id == COCO_SPORTS_BALL ? BALL_DIAMETER_M : PERSON_HEIGHT_M;
+    const double height = std::max(detection.height_deg, 0.1) * PI / 180.0;
+    return real_size / (2.0 * std::tan(height / 2.0));
+}
+
+// IoU of two boxes given by centre and angular size, yaw wrapping around
+double angular_iou(double yaw_a, double pitch_a, double w_a, double h_a,
+                   double yaw_b, double pitch_b, double w_b, double h_b) {
+    const double dx = std::abs(angle_diff(yaw_a, yaw_b));
+    const double dy = std::abs(pitch_a - pitch_b);
+    const double overlap_w = std::max(0.0, std::min(dx + w_b / 2, w_a / 2) - std::max(dx - w_b / 2, -w_a / 2));
+    const double overlap_h = std::max(0.0, std::min(dy + h_b / 2, h_a / 2) - std::max(dy - h_b / 2, -h_a / 2));
+    const double intersection = overlap_w * overlap_h;
+    const double area = w_a * h_a + w_b * h_b - intersection;
+    return area > 0.0 ? intersection / area : 0.0;
+}
+
+} // namespace
+
+void GoalkeeperTracker::Axis::predict(double q) {
+    position += velocity;
+    p00 += 2.0 * p01 + p11 + q / 4.0;
+    p01 += p11 + q / 2.0;
+    p11 += q;
+}
+
+void GoalkeeperTracker::Axis::update(double measured, double r, bool wraps) {
+    const double innovation = wraps ? angle_diff(measured, position) : measured - position;
+    const double s = p00 + r;
+    const double k0 = p00 / s;
+    const double k1 = p01 / s;
+
+    position += k0 * innovation;
+    velocity += k1 * innovation;
+    p11 -= k1 * p01;
+    p01 *= 1.0 - k0;
+    p00 *= 1.0 - k0;
+}
+
+// The detector's confidence, lowered as the predicted position gets uncertain next to the target size
+double GoalkeeperTracker::Track::confidence() const {
+    if (!active) return 0.0;
+    const double sigma = std::sqrt(yaw.p00 + pitch.p00);
+    const double size = std::max(height_deg, 1.0);
+    return detection_confidence * std::exp(-0.5 * (sigma / size) * (sigma / size));
+}
+
+GoalkeeperTracker::GoalkeeperTracker(TrackerSettings settings)
+    : settings_(settings), interval_(std::max(settings.min_interval, settings.max_interval / 2)) {}
+
+bool GoalkeeperTracker::is_keyframe(uint64_t frame) const {
+    if (!started_ || frame >= next_keyframe_) return true;
+
+    // Don't wait for the planned keyframe once the goalkeeper track became unreliable
+    return frame >= last_keyframe_ + static_cast<uint64_t>(std::max(settings_.min_interval, 1)) &&
+           goalkeeper_.active && goalkeeper_.confidence() < settings_.min_confidence;
+}
+
+void GoalkeeperTracker::predict() {
+    for (Track* track : { &goalkeeper_, &ball_ }) {
+        if (!track->active) continue;
+        track->yaw.predict(settings_.process_noise);
+        track->pitch.predict(settings_.process_noise);
+    }
+}
+
+void GoalkeeperTracker::follow(Track& track, const Detection* detection) {
+    if (!detection) {
+        track.misses++;
+        return;
+    }
+
+    const bool matches = track.active &&
+        (angular_iou(track.yaw.position, track.pitch.position, track.width_deg, track.height_deg,
+                     detection->yaw_deg, detection->pitch_deg, detection->width_deg, detection->height_deg) >= settings_.association_iou ||
+         std::hypot(angle_diff(track.yaw.position, detection->yaw_deg), track.pitch.position - detection->pitch_deg) <= settings_.association_gate_deg);
+
+    const double r = settings_.measurement_noise;
+    if (matches) {
+        track.yaw.update(detection->yaw_deg, r, true);
+        track.pitch.update(detection->pitch_deg, r, false);
+    }
+    else {
+        // A different target (or the first one): start over from the detection
+        track.yaw = Axis{ detection->yaw_deg, 0.0, r, 0.0, INITIAL_VELOCITY_VARIANCE };
+        track.pitch = Axis{ detection->pitch_deg, 0.0, r, 0.0, INITIAL_VELOCITY_VARIANCE };
+    }
+
+    track.active = true;
+    track.width_deg = detection->width_deg;
+    track.height_deg = detection->height_deg;
+    track.detection_confidence = detection->confidence;
+    track.distance = distance_of(*detection);
+    track.misses = 0;
+}
+
+CameraDirection GoalkeeperTracker::step(uint64_t frame, const std::vector<Detection>& detections) {
+    predict();
+
+    // Weighted selection of get_goalkeeper_view: 90% closeness, 10% confidence for the goalkeeper,
+    // 80% / 20% for the ball
+    const Detection* best_person = nullptr;
+    const Detection* best_ball = nullptr;
+    double best_person_score = 0.0;
+    double best_ball_score = 0.0;
+    for (const auto& detection : detections) {
+        if (detection.class_id == COCO_PERSON) {
+            const double score = (1.0 / distance_of(detection)) * 0.9 + detection.confidence * 0.1;
+            if (!best_person || score > best_person_score) {
+                best_person = &detection;
+                best_person_score = score;
+            }
+        }
+        else if (detection.class_id == COCO_SPORTS_BALL) {
+            const double score = (1.0 / distance_of(detection)) * 0.8 + detection.confidence * 0.2;
+            if (!best_ball || score > best_ball_score) {
+                best_ball = &detection;
+                best_ball_score = score;
+            }
+        }
+    }
+
+    follow(goalkeeper_, best_person);
+    if (!best_person && goalkeeper_.active) {
+        // An unseen goalkeeper stays where it was last seen instead of drifting away
+        goalkeeper_.yaw.velocity = 0.0;
+        goalkeeper_.pitch.velocity = 0.0;
+    }
+
+    follow(ball_, best_ball);
+    if (ball_.misses > settings_.max_ball_misses) {
+        ball_.active = false;
+    }
+
+    started_ = true;
+    last_keyframe_ = frame;
+    adapt_interval(frame);
+    return direction(frame, true);
+}
+
+CameraDirection GoalkeeperTracker::step(uint64_t frame) {
+    predict();
+    return direction(frame, false);
+}
+
+void GoalkeeperTracker::adapt_interval(uint64_t frame) {
+    if (!goalkeeper_.active || goalkeeper_.misses > 0 || goalkeeper_.confidence() < settings_.min_confidence) {
+        interval_ = std::max(settings_.min_interval, interval_ / 2);
+    }
+    else {
+        interval_ = std::min(settings_.max_interval, interval_ + 1);
+    }
+
+    // A fast ball has to be looked at again before it moved too far from its prediction
+    int interval = interval_;
+    if (ball_.active) {
+        const double speed = std::hypot(ball_.yaw.velocity, ball_.pitch.velocity);
+        if (speed > 0.0) {
+            interval = std::min(interval, std::max(settings_.min_interval, static_cast<int>(settings_.max_ball_step_deg / speed)));
+        }
+    }
+
+    next_keyframe_ = frame + static_cast<uint64_t>(std::max(interval, 1));
+}
+
+bool GoalkeeperTracker::window_for(const Track& track, double aspect, AttentionWindow& window) const {
+    // Where the step() of the keyframe predicts it, plus what it can have moved since the last
+    // keyframe at its current speed, plus 3 sigma of the prediction
+    const double frames = static_cast<double>(std::max(interval_, 1));
+    const double half_width = track.width_deg / 2.0 + std::abs(track.yaw.velocity) * frames +
+                              3.0 * std::sqrt(track.yaw.p00) + settings_.window_margin_deg;
+    const double half_height = track.height_deg / 2.0 + std::abs(track.pitch.velocity) * frames +
+                               3.0 * std::sqrt(track.pitch.p00) + settings_.window_margin_deg;
+
+    double fov = std::max(2.0 * half_width, 2.0 * half_height / aspect);
+    fov = std::max(settings_.window_min_fov, std::ceil(fov / WINDOW_FOV_STEP) * WINDOW_FOV_STEP);
+    if (fov > settings_.window_max_fov) return false;
+
+    window.yaw_deg = normalize_yaw(track.yaw.position + track.yaw.velocity);
+    window.pitch_deg = std::round(-std::clamp(track.pitch.position + track.pitch.velocity, -90.0, 90.0));
+    window.fov_deg = fov;
+    return true;
+}
+
+bool GoalkeeperTracker::plan_views(double aspect, std::vector<AttentionWindow>& windows) {
+    windows.clear();
+
+    AttentionWindow goalkeeper;
+    // The prediction uncertainty is in the window size, only the last detection has to be convincing
+    const bool locked = goalkeeper_.active && goalkeeper_.misses == 0 && goalkeeper_.detection_confidence >= settings_.min_confidence;
+    if (!locked || windowed_keyframes_ >= settings_.full_sweep_interval || !window_for(goalkeeper_, aspect, goalkeeper)) {
+        windowed_keyframes_ = 0;
+        return true;
+    }
+    windows.push_back(goalkeeper);
+
+    // A ball the goalkeeper window doesn't hold widens it when both fit in window_max_fov and gets its
+    // own window otherwise. A ball too fast for a window is left to the next sweep
+    AttentionWindow ball;
+    if (ball_.active && window_for(ball_, aspect, ball)) {
+        const double yaw_to_ball = angle_diff(ball.yaw_deg, goalkeeper.yaw_deg);
+        const double left = std::min(-goalkeeper.fov_deg, 2.0 * yaw_to_ball - ball.fov_deg) / 2.0;
+        const double right = std::max(goalkeeper.fov_deg, 2.0 * yaw_to_ball + ball.fov_deg) / 2.0;
+        const double top = std::min(goalkeeper.pitch_deg - goalkeeper.fov_deg * aspect / 2.0, ball.pitch_deg - ball.fov_deg * aspect / 2.0);
+        const double bottom = std::max(goalkeeper.pitch_deg + goalkeeper.fov_deg * aspect / 2.0, ball.pitch_deg + ball.fov_deg * aspect / 2.0);
+
+        const double fov = std::ceil(std::max(right - left, (bottom - top) / aspect) / WINDOW_FOV_STEP) * WINDOW_FOV_STEP;
+        if (fov <= goalkeeper.fov_deg) {
+            // Already inside
+        }
+        else if (fov <= settings_.window_max_fov) {
+            windows[0].yaw_deg = normalize_yaw(goalkeeper.yaw_deg + (left + right) / 2.0);
+            windows[0].pitch_deg = std::round((top + bottom) / 2.0);
+            windows[0].fov_deg = fov;
+        }
+        else {
+            windows.push_back(ball);
+        }
+    }
+
+    ++windowed_keyframes_;
+    return false;
+}
+
+CameraDirection GoalkeeperTracker::direction(uint64_t frame, bool keyframe) {
+    CameraDirection result;
+    result.frame = frame;
+    result.keyframe = keyframe;
+    result.goalkeeper = goalkeeper_.active;
+    result.ball = ball_.active;
+    result.confidence = goalkeeper_.confidence();
+
+    if (!goalkeeper_.active) {
+        // Nobody found yet: keep looking where the camera already looks (the front view at first)
+        result.yaw_deg = output_yaw_;
+        result.pitch_deg = output_pitch_;
+        return result;
+    }
+
+    const double base_yaw = goalkeeper_.yaw.position;
+    const double base_pitch = goalkeeper_.pitch.position;
+    double target_yaw = base_yaw;
+    double target_pitch = base_pitch;
+
+    if (ball_.active) {
+        // At most 40% towards the ball, half of that when the ball is next to the goalkeeper
+        double ball_weight = std::min(0.4, 1.0 / (ball_.distance + 1.0));
+        const double yaw_to_ball = angle_diff(ball_.yaw.position, base_yaw);
+        const double pitch_to_ball = ball_.pitch.position - base_pitch;
+        if (std::hypot(yaw_to_ball, pitch_to_ball) < 20.0) {
+            ball_weight *= 0.5;
+        }
+
+        target_yaw = base_yaw + yaw_to_ball * ball_weight;
+        target_pitch = base_pitch + pitch_to_ball * ball_weight;
+        result.ball_influence = ball_weight;
+    }
+
+    if (has_output_) {
+        const double yaw_change = std::clamp(angle_diff(target_yaw, output_yaw_), -settings_.max_yaw_change, settings_.max_yaw_change);
+        const double pitch_change = std::clamp(target_pitch - output_pitch_, -settings_.max_pitch_change, settings_.max_pitch_change);
+        target_yaw = output_yaw_ + yaw_change * (1.0 - settings_.smoothing_factor);
+        target_pitch = output_pitch_ + pitch_change * (1.0 - settings_.smoothing_factor);
+    }
+
+    output_yaw_ = normalize_yaw(target_yaw);
+    output_pitch_ = std::clamp(target_pitch, -90.0, 90.0);
+    has_output_ = true;
+
+    result.yaw_deg = output_yaw_;
+    result.pitch_deg = output_pitch_;
+    return result;
+}
+
+TrackingResult run_goalkeeper_tracking(EquirectFrameSource& source, ObjectDetector& detector,
+                                       const TrackerSettings& settings, const std::string& csv_path) {
+    TrackingResult result;
+    auto start_time = steady_clock::now();
+
+    if (!detector.ok()) {
+        result.error_info = detector.error();
+        return result;
+    }
+    if (!source.open()) {
+        result.error_info = "failed to open the frame source: " + source.error();
+        return result;
+    }
+    const SourceInfo info = source.info();
+
+    std::error_code ec;
+    const std::filesystem::path csv(csv_path);
+    if (!csv.parent_path().empty()) {
+        std::filesystem::create_directories(csv.parent_path(), ec);
+    }
+    std::ofstream out(csv_path, std::ios::trunc);
+    if (!out) {
+        result.error_info = "can't write " + csv_path;
+        return result;
+    }
+    out << "frame,yaw,pitch\n";
+
+    const auto& views = default_views();
+    EquirectRemapper remapper(views, FACE_FOV, FACE_WIDTH, FACE_HEIGHT);
+    std::vector<Image> faces(views.size());
+    std::vector<ImageView> face_views;
+    std::vector<DetectorInput> inputs(views.size());
+    for (size_t v = 0; v < views.size(); ++v) {
+        faces[v].resize(FACE_WIDTH, FACE_HEIGHT);
+        face_views.push_back(faces[v].view());
+        inputs[v].image = face_views[v];
+        inputs[v].fov_deg = FACE_FOV;
+        inputs[v].yaw_deg = views[v].yaw_deg;
+        inputs[v].pitch_deg = views[v].pitch_deg;
+    }
+
+    // Windows move with the targets, their maps are kept per pitch and fov and turned while sampling
+    ViewMapCache window_maps(16, 1.0);
+    std::vector<AttentionWindow> windows;
+    std::vector<DetectorInput> window_inputs;
+    const double aspect = static_cast<double>(FACE_HEIGHT) / FACE_WIDTH;
+    const size_t window_bands = (FACE_HEIGHT + WINDOW_BAND_ROWS - 1) / WINDOW_BAND_ROWS;
+
+    GoalkeeperTracker tracker(settings);
+    Image frame(info.width, info.height);
+
+    uint64_t previous = 0;
+    for (uint64_t index = 0; source.read(frame.view()); ++index) {
+        // Sources stitching an export list (the active ranges) skip frames, rows keep the recording's numbers
+        uint64_t number = index;
+        source.frame_number(number);
+        // Nothing seen before a skipped stretch tells where the goalkeeper is after it
+        if (index > 0 && number > previous + 1) tracker = GoalkeeperTracker(settings);
+        previous = number;
+
+        CameraDirection direction;
+        if (tracker.is_keyframe(number)) {
+            auto detect_start = steady_clock::now();
+            const bool full_sweep = tracker.plan_views(aspect, windows);
+            if (full_sweep) {
+                remapper.process(frame.view(), face_views);
+                for (auto& input : inputs) input.frame = number;
+                result.full_sweeps++;
+            }
+            else {
+                // The windows go into the first faces, there are never more windows than default views
+                const ImageView src = frame.view();
+                std::vector<std::shared_ptr<const ViewMap>> maps;
+                window_inputs.resize(windows.size());
+                for (size_t w = 0; w < windows.size(); ++w) {
+                    maps.push_back(window_maps.get(src.width, src.height, src.stride, windows[w].fov_deg,
+                                                   windows[w].pitch_deg, FACE_WIDTH, FACE_HEIGHT));
+                    window_inputs[w].image = face_views[w];
+                    window_inputs[w].frame = number;
+                    window_inputs[w].fov_deg = windows[w].fov_deg;
+                    window_inputs[w].yaw_deg = windows[w].yaw_deg;
+                    window_inputs[w].pitch_deg = windows[w].pitch_deg;
+                }
+                remapper.pool().parallel_for(windows.size() * window_bands, [&](size_t band) {
+                    const size_t w = band / window_bands;
+                    const int y_begin = static_cast<int>(band % window_bands) * WINDOW_BAND_ROWS;
+                    remap_rows_yaw(src, *maps[w], windows[w].yaw_deg, face_views[w], y_begin, std::min(FACE_HEIGHT, y_begin + WINDOW_BAND_ROWS));
+                });
+            }
+            const std::vector<DetectorInput>& batch = full_sweep ? inputs : window_inputs;
+
+            const std::vector<Detection> detections = detector.detect(batch);
+            if (!detector.ok()) {
+                result.error_info = detector.error();
+                return result;
+            }
+            result.detect_seconds += seconds_since(detect_start);
+            result.keyframes++;
+            result.views += batch.size();
+            result.detector_runs += (batch.size() + detector.batch_size() - 1) / detector.batch_size();
+            direction = tracker.step(number, detections);
+        }
+        else {
+            direction = tracker.step(number);
+        }
+
+        // The remap looks down for a positive pitch
+        out << number << ',' << direction.yaw_deg << ',' << -direction.pitch_deg << '\n';
+        result.frames++;
+    }
+
+    if (!source.error().empty()) {
+        result.error_info = source.error();
+        return result;
+    }
+
+    result.ok = static_cast<bool>(out);
+    if (!result.ok) result.error_info = "failed writing " + csv_path;
+    result.wall_seconds = seconds_since(start_time);
+    return result;
+}
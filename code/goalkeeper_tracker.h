@@ -0,0 +1,154 @@
+#pragma once
+
+#include "frame_source.h"
+#include "object_detector.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct TrackerSettings {
+    // Keyframes: frames the detector runs on. The interval adapts between these two
+    int min_interval = 1;
+    int max_interval = 12;
+    double min_confidence = 0.5;   // a track less sure than this forces a keyframe and halves the interval
+    double max_ball_step_deg = 8.0; // the interval is kept short enough for the ball to move less than this
+
+    // Association of a detection with the track it predicts, in yaw/pitch space
+    double association_iou = 0.1;
+    double association_gate_deg = 10.0; // centres this close match even without overlap (small balls)
+    int max_ball_misses = 2;            // keyframes without a ball before its track is dropped
+
+    // Constant velocity Kalman filter of every track, in degrees and frames
+    double process_noise = 0.05;
+    double measurement_noise = 0.5;
+
+    // get_goalkeeper_view in Algorithm.py
+    double smoothing_factor = 0.7;
+    double max_yaw_change = 15.0;
+    double max_pitch_change = 10.0;
+
+    // Attention windows: while the goalkeeper is locked, keyframes only render views around it (and
+    // the ball) instead of every default view
+    int full_sweep_interval = 10;  // windowed keyframes between two full sweeps, 0 -> always sweep
+    double window_min_fov = 50.0;
+    double window_max_fov = 90.0;  // a target needing a wider window gets a full sweep
+    double window_margin_deg = 4.0;
+};
+
+// Perspective view the detector looks at on a windowed keyframe, remap convention (positive pitch
+// looks down)
+struct AttentionWindow {
+    double yaw_deg = 0.0;
+    double pitch_deg = 0.0;
+    double fov_deg = 90.0;
+};
+
+// Where the reframed camera looks on one frame
+struct CameraDirection {
+    uint64_t frame = 0;
+    double yaw_deg = 0.0;
+    double pitch_deg = 0.0;   // latitude, up positive. The remap takes -pitch_deg
+    bool keyframe = false;    // the detector ran on this frame
+    bool goalkeeper = false;  // a goalkeeper track exists
+    bool ball = false;        // a ball track exists
+    double ball_influence = 0.0;
+    double confidence = 0.0;  // of the goalkeeper track, drops while it's only predicted
+};
+
+// Goalkeeper (and ball) tracking with the detector on keyframes only. Between keyframes both targets
+// are carried forward by a constant velocity Kalman filter in yaw/pitch space, and on keyframes the
+// chosen detections update the track they overlap (IoU of the angular boxes) or restart it.
+//
+// The camera direction of every frame follows get_goalkeeper_view: the closest, most confident person
+// is the goalkeeper, the ball pulls the view up to 40% towards it, and the change per frame is clamped
+// and smoothed with an EMA. The keyframe interval grows by one while the goalkeeper track stays
+// confident and halves when it doesn't, when the goalkeeper is lost or when the ball speeds up.
+//
+// Keyframes of a locked goalkeeper only look at one or two attention windows around the predicted
+// targets, the full sweep comes back on a fixed schedule and as soon as the lock is lost
+class GoalkeeperTracker {
+public:
+    explicit GoalkeeperTracker(TrackerSettings settings = TrackerSettings());
+
+    // Whether the detector should run on this frame. Frames have to be stepped in order
+    bool is_keyframe(uint64_t frame) const;
+
+    // Keyframe: detections of every view of the frame
+    CameraDirection step(uint64_t frame, const std::vector<Detection>& detections);
+    // Any other frame: the tracks are only predicted
+    CameraDirection step(uint64_t frame);
+
+    // Views of the coming keyframe, called right before its step(). Returns true for a full sweep of
+    // default_views(): nothing locked, the goalkeeper missed or found unsure, too uncertain for a window or
+    // full_sweep_interval windowed keyframes in a row. Otherwise windows gets one view on the predicted
+    // goalkeeper, widened to the ball when both fit and with a second one on the ball when they don't.
+    // Each is sized for its target, its uncertainty and its motion since the last keyframe. aspect is
+    // the height / width of the views
+    bool plan_views(double aspect, std::vector<AttentionWindow>& windows);
+
+    int interval() const { return interval_; }
+
+private:
+    struct Axis {
+        double position = 0.0; // degrees
+        double velocity = 0.0; // degrees per frame
+        double p00 = 0.0, p01 = 0.0, p11 = 0.0; // covariance
+
+        void predict(double q);
+        void update(double measured, double r, bool wraps);
+    };
+
+    struct Track {
+        bool active = false;
+        Axis yaw;
+        Axis pitch;
+        double width_deg = 0.0;
+        double height_deg = 0.0;
+        double detection_confidence = 0.0;
+        double distance = 0.0;
+        int misses = 0;
+
+        double confidence() const;
+    };
+
+    void predict();
+    void follow(Track& track, const Detection* detection);
+    CameraDirection direction(uint64_t frame, bool keyframe);
+    void adapt_interval(uint64_t frame);
+    bool window_for(const Track& track, double aspect, AttentionWindow& window) const;
+
+    TrackerSettings settings_;
+    Track goalkeeper_;
+    Track ball_;
+
+    bool has_output_ = false;
+    double output_yaw_ = 0.0;
+    double output_pitch_ = 0.0;
+
+    int interval_;
+    bool started_ = false;
+    uint64_t next_keyframe_ = 0;
+    uint64_t last_keyframe_ = 0;
+    int windowed_keyframes_ = 0; // since the last full sweep
+};
+
+struct TrackingResult {
+    bool ok = false;
+    std::string error_info;
+    uint64_t frames = 0;
+    uint64_t keyframes = 0;
+    uint64_t detector_runs = 0; // inference runs, all the views of a keyframe are one batch
+    uint64_t full_sweeps = 0;   // keyframes that rendered every default view, the others used windows
+    uint64_t views = 0;         // remapped and detected over all keyframes
+    double wall_seconds = 0.0;
+    double detect_seconds = 0.0;
+
+    double fps() const { return wall_seconds > 0.0 ? static_cast<double>(frames) / wall_seconds : 0.0; }
+};
+
+// Runs the tracker over the whole source: on keyframes the cube faces of default_views() or the
+// attention windows the tracker planned are rendered and detected in one batch. Writes one
+// "frame,yaw,pitch" row per frame to csv_path, in the remap convention load_view_path() and -view_path expect
+TrackingResult run_goalkeeper_tracking(EquirectFrameSource& source, ObjectDetector& detector,
+                                       const TrackerSettings& settings, const std::string& csv_path);
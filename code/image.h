@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Non owning view over an interleaved BGR24 image, the same layout as an OpenCV CV_8UC3 Mat
+struct ImageView {
+    uint8_t* data = nullptr;
+    int width = 0;
+    int height = 0;
+    size_t stride = 0; // bytes per row
+
+    uint8_t* row(int y) const { return data + static_cast<size_t>(y) * stride; }
+    size_t size_bytes() const { return static_cast<size_t>(height) * stride; }
+    bool empty() const { return data == nullptr || width <= 0 || height <= 0; }
+};
+
+// Owning BGR24 image. The buffer has a few bytes of padding after the last row so
+// SIMD kernels can read a whole 32 bit word for the last pixel
+class Image {
+public:
+    static constexpr size_t PADDING = 16;
+
+    Image() = default;
+    Image(int width, int height) { resize(width, height); }
+
+    void resize(int width, int height) {
+        width_ = width;
+        height_ = height;
+        pixels_.resize(static_cast<size_t>(width) * height * 3 + PADDING);
+    }
+
+    ImageView view() {
+        return { pixels_.data(), width_, height_, static_cast<size_t>(width_) * 3 };
+    }
+
+    int width() const { return width_; }
+    int height() const { return height_; }
+
+private:
+    std::vector<uint8_t> pixels_;
+    int width_ = 0;
+    int height_ = 0;
+};
@@ -0,0 +1,65 @@
+#include "ins_stitch_backend.h"
+
+using namespace ins;
+
+namespace {
+
+STITCH_TYPE to_sdk(StitchType type) {
+    switch (type) {
+    case StitchType::TEMPLATE: return STITCH_TYPE::TEMPLATE;
+    case StitchType::DYNAMICSTITCH: return STITCH_TYPE::DYNAMICSTITCH;
+    case StitchType::AIFLOW: return STITCH_TYPE::AIFLOW;
+    case StitchType::OPTFLOW: break;
+    }
+    return STITCH_TYPE::OPTFLOW;
+}
+
+} // namespace
+
+void InsStitchBackend::start(const std::vector<std::string>& input_paths, const std::string& output_path,
+                             const StitchOptions& options, ProgressCallback on_progress, ErrorCallback on_error) {
+    video_stitcher_ = std::make_shared<VideoStitcher>();
+    video_stitcher_->SetInputPath(input_paths);
+    if (options.image_sequence_dir.empty()) {
+        video_stitcher_->SetOutputPath(output_path);
+    }
+    else {
+        if (!options.export_frame_nums.empty()) {
+            video_stitcher_->SetExportFrameSequence(options.export_frame_nums);
+        }
+
+        video_stitcher_->SetImageSequenceInfo(options.image_sequence_dir,
+                                             options.image_type == ImageType::PNG ? IMAGE_TYPE::PNG : IMAGE_TYPE::JPEG);
+    }
+    video_stitcher_->SetStitchType(to_sdk(options.stitch_type));
+    video_stitcher_->EnableCuda(options.enable_cuda);
+    video_stitcher_->EnableStitchFusion(options.enalbe_stitchfusion);
+    video_stitcher_->EnableColorPlus(options.enable_colorplus, options.color_plus_model_path);
+    video_stitcher_->SetOutputSize(options.output_width, options.output_height);
+    video_stitcher_->SetOutputBitRate(options.output_bitrate);
+    video_stitcher_->EnableFlowState(options.enable_flowstate);
+    video_stitcher_->SetAiStitchModelFile(options.ai_stitching_model);
+    video_stitcher_->EnableDenoise(options.enable_sequence_denoise);
+    video_stitcher_->EnableDirectionLock(options.enable_directionlock);
+    video_stitcher_->SetCameraAccessoryType(static_cast<CameraAccessoryType>(options.accessory_type));
+    video_stitcher_->SetSoftwareCodecUsage(options.enable_soft_encode, options.enable_soft_decode);
+    if (options.enable_H265_encoder) {
+        video_stitcher_->EnableH265Encoder();
+    }
+    video_stitcher_->EnableDeflicker(options.enable_deflicker, options.deflicker_model_path);
+
+    video_stitcher_->SetStitchProgressCallback([on_progress](int process, int error) {
+        on_progress(process);
+    });
+    video_stitcher_->SetStitchStateCallback([on_error](int error, const char* err_info) {
+        on_error(error, err_info ? err_info : "");
+    });
+
+    video_stitcher_->StartStitch();
+}
+
+void InsStitchBackend::cancel() {
+    if (video_stitcher_) {
+        video_stitcher_->CancelStitch();
+    }
+}
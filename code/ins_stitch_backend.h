@@ -0,0 +1,18 @@
+#pragma once
+
+#include "stitch_backend.h"
+
+#include <ins_stitcher.h>
+
+#include <memory>
+
+// The insta360 SDK VideoStitcher
+class InsStitchBackend : public StitchBackend {
+public:
+    void start(const std::vector<std::string>& input_paths, const std::string& output_path,
+               const StitchOptions& options, ProgressCallback on_progress, ErrorCallback on_error) override;
+    void cancel() override;
+
+private:
+    std::shared_ptr<ins::VideoStitcher> video_stitcher_;
+};
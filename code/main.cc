@@ -1,13 +1,28 @@
 #include <iostream>
 #include <ins_stitcher.h>
 
+#include "activity_index.h"
+#include "auto_tune.h"
+#include "batch.h"
+#include "chunked_output.h"
+#include "conversion_cache.h"
+#include "goalkeeper_tracker.h"
+#include "pipeline.h"
+#include "range_stitch.h"
+#include "recording_catalog.h"
+#include "segment_stitch.h"
+#include "stitch_options.h"
+#include "stitch_job.h"
+#include "stitch_runner.h"
+#include "stitch_telemetry.h"
+#include "watch_daemon.h"
+
 #include <iostream>
 #include <algorithm>
 #include <condition_variable>
 #include <mutex>
 #include <chrono>
 #include <ostream>
-#include <set>
 #include <vector>
 #include <sstream>
 #include <filesystem>
@@ -47,7 +62,44 @@ const std::string helpstr =
 "{-image_type             | jpg                   | jpg                                 }\n"
 "{                                                | png                                 }\n"
 "{-camera_accessory_type  | default 0             | refer to 'common.h'                 }\n"
-"{-export_frame_index     |                       | Derived frame number sequence, example: 20-50-30 }\n";
+"{-export_frame_index     |                       | Exported frames, <frame> or <begin>:<end>[:<step>] joined with ',', example: 100:900:5,2000:2300 }\n"
+"{-batch                  | OFF                   | stitch every pair in the sources dir}\n"
+"{-jobs                   | 2                     | stitch jobs running at the same time}\n"
+"{-max_hw_sessions        | 1                     | jobs using hardware codecs at once  }\n"
+"{-pipeline               | OFF                   | stitch and reframe without the mp4  }\n"
+"{-pipeline_synthetic     | 0                     | frames of the fake stitcher to use  }\n"
+"{-view_path              | front                 | frame,yaw,pitch csv to reframe with }\n"
+"{-encoder                | libx264               | libx264, libx265 or mp4v (-pipeline)}\n"
+"{-crf                    | 23                    | quality of the -pipeline encoder    }\n"
+"{-force                  | OFF                   | stitch even if the output is cached }\n"
+"{-segments               | 1                     | split the recording in N parallel jobs}\n"
+"{-segment_overlap        | auto                  | pre-roll frames of every segment    }\n"
+"{-segment_baseline       | OFF                   | also run and compare the single job }\n"
+"{-timeout                | 0                     | cancel a stitch running longer (s)  }\n"
+"{-list                   | OFF                   | print the recordings and exit       }\n"
+"{-date                   | None                  | only recordings of this YYYYMMDD    }\n"
+"{-recording              | None                  | VID_date_id or id, skips the picker }\n"
+"{-watch                  | OFF                   | stitch pairs as they are copied in  }\n"
+"{-settle_seconds         | 10                    | unchanged time of a finished copy   }\n"
+"{-auto_tune              | OFF                   | pick the fastest codec settings     }\n"
+"{-auto_tune_frames       | 300                   | frames of the calibration window    }\n"
+"{-auto_tune_min_bitrate  | 80% -bitrate or ref/2 | bitrate floor of the candidates     }\n"
+"{-auto_tune_recalibrate  | OFF                   | ignore the cached tuning            }\n"
+"{-proxy                  | OFF                   | cheap template stitch for detection }\n"
+"{-proxy_size             | 1024x512              | the resolution of the proxy         }\n"
+"{-frame_plan             | None                  | stitch only these frames (begin-end per line)}\n"
+"{-activity               | OFF                   | skip the idle stretches of the recording}\n"
+"{-activity_threshold     | auto                  | frame difference of an active frame }\n"
+"{-track                  | OFF                   | write the goalkeeper view path csv  }\n"
+"{-detector_model         | yolov8n.onnx          | YOLOv8 ONNX model used by -track    }\n"
+"{-full_sweep_interval    | 10                    | windowed keyframes between 360 sweeps, 0 -> always sweep}\n"
+"{-chunk_seconds          | 0                     | publish the output in N s chunks    }\n"
+"{-chunk_manifest         | None                  | -track follows these chunks instead }\n"
+"{-telemetry              | None                  | JSON lines file of stitch telemetry }\n"
+"{-telemetry_prom         | None                  | Prometheus textfile of the same data}\n"
+"{-telemetry_interval     | 5                     | seconds between heartbeat records   }\n";
+
+const std::string AUTO_TUNE_CACHE_PATH = "./sources/autotune.tsv";
 
 const std::string RAW_SOURCES_BASE_PATH = "./sources/rawFootage";
 
@@ -85,6 +137,48 @@ std::string get_output_path(const std::string& filename) {
     return newPath.string();
 }
 
+// Same recording name as get_output_path, in the directory of the edited (reframed) videos
+std::string get_edited_output_path(const std::string& filename) {
+    std::filesystem::path p(filename);
+    std::filesystem::path newPath = p.parent_path().parent_path() / "edited" / p.stem();
+    newPath += ".mp4";
+
+    return newPath.string();
+}
+
+// Low resolution proxy of an output, in a proxy directory next to it
+std::string get_proxy_path(const std::string& output_path) {
+    std::filesystem::path p(output_path);
+    return (p.parent_path() / "proxy" / p.filename()).string();
+}
+
+// Camera path of the tracked goalkeeper, next to the edited video it is meant for
+std::string get_view_path_csv_path(const std::string& filename) {
+    std::filesystem::path p(filename);
+    std::filesystem::path newPath = p.parent_path().parent_path() / "edited" / p.stem();
+    newPath += ".csv";
+
+    return newPath.string();
+}
+
+// Directory of the clips of the planned frame ranges of a recording
+std::string get_ranges_output_dir(const std::string& filename) {
+    std::filesystem::path p(filename);
+    return (p.parent_path().parent_path() / "convertedFootage" / (p.stem().string() + "_ranges")).string();
+}
+
+// Directory of the chunks and their manifest, next to the output they replace
+std::string get_chunks_output_dir(const std::string& output_path) {
+    std::filesystem::path p(output_path);
+    return (p.parent_path() / (p.stem().string() + "_chunks")).string();
+}
+
+// Activity scores of a recording, next to its output so later runs don't scan it again
+std::string get_activity_index_path(const std::string& output_path) {
+    std::filesystem::path p(output_path);
+    return (p.parent_path() / (p.stem().string() + ".activity.tsv")).string();
+}
+
 bool are_insta360_pairs(const std::string& file1, const std::string& file2) {
     // Sanity check: lengths must be equal
     if (file1.length() != file2.length()) return false;
@@ -159,78 +253,64 @@ std::vector<std::string> split(const std::string& s, char delimiter) {
     return tokens;
 }
 
-std::string pick_inputs() {
-    std::vector<std::string> files;
-    
-    try {
-        // Check if directory exists
-        if (!std::filesystem::exists(RAW_SOURCES_BASE_PATH) || !std::filesystem::is_directory(RAW_SOURCES_BASE_PATH)) {
-            std::cout << "Directory does not exist: " << RAW_SOURCES_BASE_PATH << std::endl;
-            return "";
-        }
-
-        std::set<std::string> seen_recordings;
-        
-        // Read all files from directory and filter the relevant ones
-        for (const auto& entry : std::filesystem::directory_iterator(RAW_SOURCES_BASE_PATH)) {
-            if (entry.is_regular_file()) {
-                std::string filename = entry.path().filename().string();
-                
-                // Check if file ends with ".insv" and starts with "VID"
-                if (filename.length() >= 5 && filename.substr(filename.length() - 5) == ".insv" &&
-                    filename.length() >= 3 && filename.substr(0, 3) == "VID") {
-                    
-                    // The video names are formatted like "VID_{date}_{unique_id}_{lense_pattern_id}_{num_video}.insv"
-                    // In order to not include two videos with the same date, unique_id and num_video but different lense_pattern_id
-                    // Grab the unique id and push it to the already seen recording to keep track of which recording have already been pushed
-                    std::vector<std::string> filename_tokens = split(filename, '_');
-                    const std::string filename_id = filename_tokens[2];
-
-                    // The videos need to be sorted (first the _00_, then t he _10_) which is why we will only show the _00_ pattern to pick
-                    const int pos = filename.find(PATTERN_10);
-                    if (pos != std::string::npos) {
-                        filename.replace(pos, 4, PATTERN_00);
-                    }
-
-                    if (seen_recordings.find(filename_id) == seen_recordings.end()) {
-                        seen_recordings.insert(filename_id);
-                        files.push_back(filename);
-                    }
-                }
-            }
-        }
-        
-        // Check if any files were found
-        if (files.empty()) {
-            std::cout << "No files found in directory." << std::endl;
-            return "";
-        }
-        
-        // Display numbered list
-        std::cout << "Files in directory:" << std::endl;
-        for (size_t i = 0; i < files.size(); ++i) {
-            std::cout << i + 1 << ". " << files[i] << std::endl;
-        }
-        
-        // Get user selection
-        int selection;
-        std::cout << "Enter the number of the file you want to select (1-" << files.size() << "): ";
-        std::cin >> selection;
-        
-        // Validate selection
-        if (selection < 1 || selection > static_cast<int>(files.size())) {
-            std::cout << "Invalid selection." << std::endl;
-            return "";
-        }
-        
-        // Return full path of selected file
-        std::filesystem::path fullPath = std::filesystem::path(RAW_SOURCES_BASE_PATH) / files[selection - 1];
-        return fullPath.string();
-        
-    } catch (const std::filesystem::filesystem_error& ex) {
-        std::cout << "Filesystem error: " << ex.what() << std::endl;
-        return "";
+// Output of a recording the camera split in several files, the segments are joined into it
+std::string get_joined_output_path(const Recording& recording) {
+    std::filesystem::path p(recording.segments.front().lens00);
+    std::filesystem::path newPath = p.parent_path().parent_path() / "convertedFootage" / recording.name();
+    newPath += ".mp4";
+
+    return newPath.string();
+}
+
+// One job per file segment of the recording. Segments of a long recording are joined once stitched
+std::vector<BatchJob> get_recording_jobs(const Recording& recording) {
+    std::vector<BatchJob> jobs;
+    for (const auto& segment : recording.segments) {
+        BatchJob job;
+        job.input_paths = { segment.lens00, segment.lens10 };
+        job.output_path = get_output_path(segment.lens00);
+        if (recording.segments.size() > 1) {
+            job.joined_path = get_joined_output_path(recording);
+            job.segment = segment.number;
+        }
+        jobs.push_back(std::move(job));
+    }
+    return jobs;
+}
+
+void print_recording(const Recording& recording) {
+    std::cout << recording.name() << "  " << recording.segments.size() << (recording.segments.size() == 1 ? " file" : " files");
+    if (!recording.complete()) {
+        std::cout << "  (missing lens files)";
+    }
+    std::cout << std::endl;
+}
+
+const Recording* pick_recording(const std::vector<Recording>& recordings) {
+    if (recordings.empty()) {
+        std::cout << "No files found in directory." << std::endl;
+        return nullptr;
+    }
+
+    // Display numbered list
+    std::cout << "Recordings in directory:" << std::endl;
+    for (size_t i = 0; i < recordings.size(); ++i) {
+        std::cout << i + 1 << ". ";
+        print_recording(recordings[i]);
+    }
+
+    // Get user selection
+    int selection;
+    std::cout << "Enter the number of the recording you want to select (1-" << recordings.size() << "): ";
+    std::cin >> selection;
+
+    // Validate selection
+    if (selection < 1 || selection > static_cast<int>(recordings.size())) {
+        std::cout << "Invalid selection." << std::endl;
+        return nullptr;
     }
+
+    return &recordings[selection - 1];
 }
 
 int main(int argc, char* argv[]) {
@@ -238,31 +318,52 @@ int main(int argc, char* argv[]) {
     ins::InitEnv();
 
     std::vector<std::string> input_paths;
-    std::string image_sequence_dir;
-    std::string ai_stitching_model;
-    std::string color_plus_model_path;
-    std::string denoise_model_path;
     std::string exported_frame_number_sequence;
-    std::string deflicker_model_path;
-
-    STITCH_TYPE stitch_type = STITCH_TYPE::OPTFLOW;
-    IMAGE_TYPE image_type = IMAGE_TYPE::JPEG;
-    CameraAccessoryType accessory_type = CameraAccessoryType::kNormal;
-
-    int output_width = 1920;
-    int output_height = 960;
-    int output_bitrate = 0;
-
-    bool enable_flowstate = false;
-    bool enable_cuda = true;
-    bool enable_soft_encode = false;
-    bool enable_soft_decode = false;
-    bool enalbe_stitchfusion = true;
-    bool enable_colorplus = false;
-    bool enable_directionlock = false;
-    bool enable_sequence_denoise = false;
-    bool enable_H265_encoder = false;
-    bool enable_deflicker = false;
+
+    StitchOptions options;
+
+    bool batch_mode = false;
+    bool force = false;
+    BatchSettings batch_settings;
+
+    SegmentSettings segment_settings;
+    segment_settings.segments = 1;
+
+    bool pipeline_mode = false;
+    uint64_t synthetic_frames = 0;
+    std::string view_path_csv;
+    PipelineSettings pipeline_settings;
+
+    TelemetrySettings telemetry_settings;
+    double timeout_seconds = 0.0;
+
+    bool list_mode = false;
+    std::string date_filter;
+    std::string recording_key;
+
+    bool watch_mode = false;
+    WatchSettings watch_settings;
+    watch_settings.dir = RAW_SOURCES_BASE_PATH;
+
+    bool auto_tune_mode = false;
+    AutoTuneSettings auto_tune_settings;
+    auto_tune_settings.cache_path = AUTO_TUNE_CACHE_PATH;
+
+    bool proxy_mode = false;
+    int proxy_width = 1024;
+    int proxy_height = 512;
+    std::string frame_plan_path;
+
+    bool activity_mode = false;
+    ActivitySettings activity_settings;
+
+    bool track_mode = false;
+    DetectorSettings detector_settings;
+    TrackerSettings tracker_settings;
+
+    bool chunk_mode = false;
+    ChunkSettings chunk_settings;
+    std::string chunk_manifest_path;
 
     for (int i = 1; i < argc; i++) {
         if (std::string("-inputs") == std::string(argv[i])) {
@@ -276,100 +377,351 @@ int main(int argc, char* argv[]) {
         }
 
         if (std::string("-colorplus_model") == std::string(argv[i])) {
-            color_plus_model_path = stringToUtf8(argv[++i]);
+            options.color_plus_model_path = stringToUtf8(argv[++i]);
         }
         else if (std::string("-stitch_type") == std::string(argv[i])) {
             std::string stitchType = argv[++i];
-            if (stitchType == std::string("optflow")) {
-                stitch_type = STITCH_TYPE::OPTFLOW;
+            if (stitchType == std::string("template")) {
+                options.stitch_type = StitchType::TEMPLATE;
+            }
+            else if (stitchType == std::string("optflow")) {
+                options.stitch_type = StitchType::OPTFLOW;
             }
             else if (stitchType == std::string("dynamicstitch")) {
-                stitch_type = STITCH_TYPE::DYNAMICSTITCH;
+                options.stitch_type = StitchType::DYNAMICSTITCH;
             }
             else if (stitchType == std::string("aistitch")) {
-                stitch_type = STITCH_TYPE::AIFLOW;
+                options.stitch_type = StitchType::AIFLOW;
             }
         }
         else if (std::string("-enable_flowstate") == std::string(argv[i])) {
-            enable_flowstate = true;
+            options.enable_flowstate = true;
         }
         else if (std::string("-disable_cuda") == std::string(argv[i])) {
-            enable_cuda = false;
+            options.enable_cuda = false;
         }
         else if (std::string("-enable_stitchfusion") == std::string(argv[i])) {
-            enalbe_stitchfusion = true;
+            options.enalbe_stitchfusion = true;
         }
         else if (std::string("-enable_denoise") == std::string(argv[i])) {
-            enable_sequence_denoise = true;
+            options.enable_sequence_denoise = true;
         }
         else if (std::string("-enable_colorplus") == std::string(argv[i])) {
-            enable_colorplus = true;
+            options.enable_colorplus = true;
         }
         else if (std::string("-enable_directionlock") == std::string(argv[i])) {
-            enable_directionlock = true;
+            options.enable_directionlock = true;
         }
         else if (std::string("-enable_h265_encoder") == std::string(argv[i])) {
-            enable_H265_encoder = true;
+            options.enable_H265_encoder = true;
         }
         else if (std::string("-bitrate") == std::string(argv[i])) {
-            output_bitrate = atoi(argv[++i]);
+            options.output_bitrate = atoi(argv[++i]);
         }
         else if (std::string("-output_size") == std::string(argv[i])) {
             auto res = split(std::string(argv[++i]), 'x');
             if (res.size() == 2) {
-                output_width = std::atoi(res[0].c_str());
-                output_height = std::atoi(res[1].c_str());
+                options.output_width = std::atoi(res[0].c_str());
+                options.output_height = std::atoi(res[1].c_str());
             }
         }
         else if (std::string("-image_sequence_dir") == std::string(argv[i])) {
-            image_sequence_dir = std::string(argv[++i]);
+            options.image_sequence_dir = std::string(argv[++i]);
         }
         else if (std::string("-image_type") == std::string(argv[i])) {
             std::string type = argv[++i];
             if (type == std::string("jpg")) {
-                image_type = IMAGE_TYPE::JPEG;
+                options.image_type = ImageType::JPEG;
             }
             else if (type == std::string("png")) {
-                image_type = IMAGE_TYPE::PNG;
+                options.image_type = ImageType::PNG;
             }
         }
         else if (std::string("-camera_accessory_type") == std::string(argv[i])) {
-            accessory_type = static_cast<CameraAccessoryType>(std::atoi(argv[++i]));
+            options.accessory_type = std::atoi(argv[++i]);
         }
         else if (std::string("-ai_stitching_model") == std::string(argv[i])) {
-            ai_stitching_model = stringToUtf8(argv[++i]);
+            options.ai_stitching_model = stringToUtf8(argv[++i]);
         }
         else if (std::string("-image_denoise_model") == std::string(argv[i])) {
-            denoise_model_path = stringToUtf8(argv[++i]);
+            options.denoise_model_path = stringToUtf8(argv[++i]);
         }
         else if (std::string("-export_frame_index") == std::string(argv[i])) {
             exported_frame_number_sequence = argv[++i];
         }
         else if (std::string("-deflicker_model") == std::string(argv[i])) {
-            deflicker_model_path = stringToUtf8(argv[++i]);
+            options.deflicker_model_path = stringToUtf8(argv[++i]);
         }
         else if (std::string("-enable_deflicker") == std::string(argv[i])) {
-            enable_deflicker = true;
+            options.enable_deflicker = true;
         }
         else if (std::string("-enable_soft_encode") == std::string(argv[i])) {
-            enable_soft_encode = true;
+            options.enable_soft_encode = true;
         }
         else if (std::string("-enable_soft_decode") == std::string(argv[i])) {
-            enable_soft_decode = true;
+            options.enable_soft_decode = true;
+        }
+        else if (std::string("-batch") == std::string(argv[i])) {
+            batch_mode = true;
+        }
+        else if (std::string("-jobs") == std::string(argv[i])) {
+            batch_settings.max_jobs = std::atoi(argv[++i]);
+            segment_settings.max_jobs = batch_settings.max_jobs;
+        }
+        else if (std::string("-max_hw_sessions") == std::string(argv[i])) {
+            batch_settings.max_hw_sessions = std::atoi(argv[++i]);
+        }
+        else if (std::string("-pipeline") == std::string(argv[i])) {
+            pipeline_mode = true;
+        }
+        else if (std::string("-pipeline_synthetic") == std::string(argv[i])) {
+            pipeline_mode = true;
+            synthetic_frames = std::strtoull(argv[++i], nullptr, 10);
+        }
+        else if (std::string("-view_path") == std::string(argv[i])) {
+            view_path_csv = stringToUtf8(argv[++i]);
+        }
+        else if (std::string("-encoder") == std::string(argv[i])) {
+            pipeline_settings.encoder.codec = argv[++i];
+        }
+        else if (std::string("-crf") == std::string(argv[i])) {
+            pipeline_settings.encoder.crf = std::atoi(argv[++i]);
+        }
+        else if (std::string("-force") == std::string(argv[i])) {
+            force = true;
+        }
+        else if (std::string("-segments") == std::string(argv[i])) {
+            segment_settings.segments = std::atoi(argv[++i]);
+        }
+        else if (std::string("-segment_overlap") == std::string(argv[i])) {
+            segment_settings.overlap_frames = std::atoll(argv[++i]);
+        }
+        else if (std::string("-segment_baseline") == std::string(argv[i])) {
+            segment_settings.measure_baseline = true;
+        }
+        else if (std::string("-list") == std::string(argv[i])) {
+            list_mode = true;
+        }
+        else if (std::string("-date") == std::string(argv[i])) {
+            date_filter = argv[++i];
+        }
+        else if (std::string("-recording") == std::string(argv[i])) {
+            recording_key = stringToUtf8(argv[++i]);
+        }
+        else if (std::string("-watch") == std::string(argv[i])) {
+            watch_mode = true;
+        }
+        else if (std::string("-settle_seconds") == std::string(argv[i])) {
+            watch_settings.settle_seconds = std::atof(argv[++i]);
+        }
+        else if (std::string("-auto_tune") == std::string(argv[i])) {
+            auto_tune_mode = true;
+        }
+        else if (std::string("-auto_tune_frames") == std::string(argv[i])) {
+            auto_tune_settings.calibration_frames = std::strtoull(argv[++i], nullptr, 10);
+        }
+        else if (std::string("-auto_tune_min_bitrate") == std::string(argv[i])) {
+            auto_tune_settings.min_bitrate = std::atoll(argv[++i]);
+        }
+        else if (std::string("-auto_tune_recalibrate") == std::string(argv[i])) {
+            auto_tune_settings.recalibrate = true;
+        }
+        else if (std::string("-proxy") == std::string(argv[i])) {
+            proxy_mode = true;
+        }
+        else if (std::string("-proxy_size") == std::string(argv[i])) {
+            auto res = split(std::string(argv[++i]), 'x');
+            if (res.size() == 2) {
+                proxy_width = std::atoi(res[0].c_str());
+                proxy_height = std::atoi(res[1].c_str());
+            }
+        }
+        else if (std::string("-frame_plan") == std::string(argv[i])) {
+            frame_plan_path = stringToUtf8(argv[++i]);
+        }
+        else if (std::string("-activity") == std::string(argv[i])) {
+            activity_mode = true;
+        }
+        else if (std::string("-activity_threshold") == std::string(argv[i])) {
+            activity_settings.threshold = std::atof(argv[++i]);
+        }
+        else if (std::string("-track") == std::string(argv[i])) {
+            track_mode = true;
+        }
+        else if (std::string("-detector_model") == std::string(argv[i])) {
+            detector_settings.model_path = stringToUtf8(argv[++i]);
+        }
+        else if (std::string("-full_sweep_interval") == std::string(argv[i])) {
+            tracker_settings.full_sweep_interval = std::atoi(argv[++i]);
+        }
+        else if (std::string("-chunk_seconds") == std::string(argv[i])) {
+            chunk_settings.chunk_seconds = std::atof(argv[++i]);
+            chunk_mode = chunk_settings.chunk_seconds > 0.0;
+        }
+        else if (std::string("-chunk_manifest") == std::string(argv[i])) {
+            chunk_manifest_path = stringToUtf8(argv[++i]);
+        }
+        else if (std::string("-timeout") == std::string(argv[i])) {
+            timeout_seconds = std::atof(argv[++i]);
+            batch_settings.timeout_seconds = timeout_seconds;
+            segment_settings.timeout_seconds = timeout_seconds;
+        }
+        else if (std::string("-telemetry") == std::string(argv[i])) {
+            telemetry_settings.jsonl_path = stringToUtf8(argv[++i]);
+        }
+        else if (std::string("-telemetry_prom") == std::string(argv[i])) {
+            telemetry_settings.prom_path = stringToUtf8(argv[++i]);
+        }
+        else if (std::string("-telemetry_interval") == std::string(argv[i])) {
+            telemetry_settings.interval_seconds = std::atof(argv[++i]);
         }
         else if (std::string("-help") == std::string(argv[i])) {
             std::cout << helpstr << std::endl;
         }
     }
 
-    if (!input_paths.size()) {
-        input_paths.resize(1);
-        input_paths[0] = pick_inputs();
+    std::vector<FrameSpan> export_spans;
+    if (!options.image_sequence_dir.empty()) {
+        std::string selection_error;
+        if (!parse_frame_selection(exported_frame_number_sequence, export_spans, selection_error)) {
+            std::cout << "error: " << selection_error << std::endl;
+            return -1;
+        }
+    }
+
+    if (options.color_plus_model_path.empty()) {
+        options.enable_colorplus = false;
+    }
+
+    if (proxy_mode) {
+        if (!options.image_sequence_dir.empty() || !frame_plan_path.empty()) {
+            std::cout << "-proxy makes the low resolution video of the first pass, it can't be used with -image_sequence_dir or -frame_plan" << std::endl;
+            return -1;
+        }
+        options = proxy_stitch_options(options, proxy_width, proxy_height);
+    }
 
-        if (input_paths[0].empty()) {
-            std::cout << "Failed to get the chosen input";
+    StitchTelemetry telemetry(telemetry_settings);
+    if (telemetry_settings.enabled()) {
+        batch_settings.telemetry = &telemetry;
+        segment_settings.telemetry = &telemetry;
+    }
+
+    batch_settings.force = force;
+
+    if (watch_mode) {
+        if (!options.image_sequence_dir.empty()) {
+            std::cout << "Watch mode only supports video output, -image_sequence_dir can't be used with -watch" << std::endl;
+            return -1;
+        }
+
+        watch_settings.batch = batch_settings;
+        if (proxy_mode) {
+            return run_watch(watch_settings, options, [](const std::string& lens00) { return get_proxy_path(get_output_path(lens00)); });
+        }
+        return run_watch(watch_settings, options, get_output_path);
+    }
+
+    // The catalog is only needed when the inputs aren't given
+    RecordingCatalog catalog(RAW_SOURCES_BASE_PATH);
+    std::vector<Recording> recordings;
+    if (input_paths.empty()) {
+        if (!catalog.open()) return -1;
+        recordings = date_filter.empty() ? catalog.recordings() : catalog.on_date(date_filter);
+    }
+
+    if (list_mode) {
+        for (const auto& recording : recordings) {
+            print_recording(recording);
+        }
+        return 0;
+    }
+
+    if (batch_mode) {
+        if (!options.image_sequence_dir.empty() || !frame_plan_path.empty() || chunk_mode || activity_mode) {
+            std::cout << "Batch mode only supports whole video output, -image_sequence_dir, -frame_plan, -chunk_seconds and -activity can't be used with -batch" << std::endl;
+            return -1;
+        }
+
+        std::vector<BatchJob> jobs;
+        for (const auto& recording : recordings) {
+            if (!recording.complete()) {
+                std::cout << "Skipping " << recording.name() << ": some of its _00_/_10_ lens files are missing" << std::endl;
+                continue;
+            }
+            for (auto& job : get_recording_jobs(recording)) {
+                jobs.push_back(std::move(job));
+            }
+        }
+
+        if (proxy_mode) {
+            for (auto& job : jobs) {
+                job.output_path = get_proxy_path(job.output_path);
+                if (!job.joined_path.empty()) job.joined_path = get_proxy_path(job.joined_path);
+            }
+        }
+
+        if (auto_tune_mode && !jobs.empty()) {
+            auto_tune(jobs[0].input_paths, options, auto_tune_settings);
+        }
+        return run_batch(std::move(jobs), options, batch_settings);
+    }
+
+    ViewPath view_path;
+    if (!view_path_csv.empty()) {
+        view_path = load_view_path(view_path_csv);
+    }
+
+    // Fake stitcher, exercises the pipeline without the SDK or footage
+    if (pipeline_mode && synthetic_frames > 0) {
+        SyntheticEquirectSource source(options.output_width, options.output_height, 30.0, synthetic_frames);
+        const std::string output_path = get_edited_output_path(std::string(RAW_SOURCES_BASE_PATH) + "/synthetic.insv");
+
+        PipelineResult result = run_reframe_pipeline(source, view_path, output_path, pipeline_settings);
+        std::cout << "Output: " << output_path << std::endl;
+        if (!result.ok) {
+            std::cout << "error: " << result.error_info << std::endl;
+        }
+        std::cout << result.frames << " frames, cost = " << result.wall_seconds << " (" << result.fps() << " fps)" << std::endl;
+        std::cout << "encoder: " << result.encoder.fps() << " fps, " << result.encoder.bitrate_kbps() << " kbit/s" << std::endl;
+        return result.ok ? 0 : -1;
+    }
+
+    if (!input_paths.size()) {
+        const Recording* recording = recording_key.empty() ? pick_recording(recordings) : catalog.find(recording_key);
+        if (!recording) {
+            std::cout << "Failed to get the chosen input" << (recording_key.empty() ? "" : ": unknown recording " + recording_key) << std::endl;
+            return -1;
+        }
+        if (!recording->complete()) {
+            std::cout << "Some of the _00_/_10_ lens files of " << recording->name() << " are missing" << std::endl;
             return -1;
         }
+
+        // Recordings the camera split in several files are stitched file by file and joined
+        if (recording->segments.size() > 1) {
+            if (pipeline_mode || track_mode || chunk_mode || activity_mode || !options.image_sequence_dir.empty() || !frame_plan_path.empty() || segment_settings.segments > 1) {
+                std::cout << recording->name() << " spans " << recording->segments.size()
+                          << " files, only plain video output is supported for it" << std::endl;
+                return -1;
+            }
+            std::vector<BatchJob> jobs = get_recording_jobs(*recording);
+            if (proxy_mode) {
+                for (auto& job : jobs) {
+                    job.output_path = get_proxy_path(job.output_path);
+                    job.joined_path = get_proxy_path(job.joined_path);
+                }
+            }
+
+            std::cout << "Output: \n";
+            std::cout << jobs[0].joined_path << std::endl;
+            if (auto_tune_mode) {
+                auto_tune(jobs[0].input_paths, options, auto_tune_settings);
+            }
+            return run_batch(std::move(jobs), options, batch_settings);
+        }
+
+        input_paths = { recording->segments[0].lens00, recording->segments[0].lens10 };
     }
 
     // either the user only specified 1 input file or no inputs file and used the interactive selector
@@ -385,7 +737,7 @@ int main(int argc, char* argv[]) {
 
     // check for incorrect input parameters
     if (input_paths.size() != 2) {
-        std::cout << "You need to specify a single pair of .insv videos. Multiple files stitching not yet supported" << std::endl;
+        std::cout << "You need to specify a single pair of .insv videos. Use -batch to stitch every pair in " << RAW_SOURCES_BASE_PATH << std::endl;
         std::cout << helpstr << std::endl;
         return -1;
     }
@@ -400,7 +752,11 @@ int main(int argc, char* argv[]) {
         return -1;
     }
 
-    const std::string output_path = get_output_path(input_paths[0]);
+    if (auto_tune_mode) {
+        auto_tune(input_paths, options, auto_tune_settings);
+    }
+
+    const std::string output_path = proxy_mode ? get_proxy_path(get_output_path(input_paths[0])) : get_output_path(input_paths[0]);
     if (output_path.empty()) {
         // this should never happend actually because we have previously checked
         std::cout << "Failed to get the output filename" << std::endl;
@@ -408,95 +764,223 @@ int main(int argc, char* argv[]) {
         return -1;
     }
 
-    std::cout << "Output: \n";
-    std::cout << output_path << std::endl;
+    // Idle stretches (warm-up, breaks) are found once on a tiny template stitch, every later pass
+    // only stitches and tracks the active ranges
+    std::vector<FrameRange> active;
+    if (activity_mode) {
+        if (proxy_mode || pipeline_mode || chunk_mode || !chunk_manifest_path.empty() || !frame_plan_path.empty() || !export_spans.empty()) {
+            std::cout << "-activity picks the frames itself, it can't be used with -proxy, -pipeline, -chunk_seconds, -chunk_manifest, -frame_plan or -export_frame_index" << std::endl;
+            return -1;
+        }
 
-    std::vector<uint64_t> export_frame_nums;
-    if (!image_sequence_dir.empty()) {
-        auto frame_index_vec = split(exported_frame_number_sequence, '-');
-        for (auto& frame_index : frame_index_vec) {
-            int index = atoi(frame_index.c_str());
-            export_frame_nums.push_back(index);
+        ActivityIndex index;
+        if (!load_or_scan_activity(input_paths, options, activity_settings, get_activity_index_path(output_path), force, index)) {
+            return -1;
         }
+
+        double threshold = 0.0;
+        active = active_ranges(index, activity_settings, &threshold);
+        uint64_t active_frames = 0;
+        for (const auto& range : active) active_frames += range.end - range.begin;
+        std::cout << active.size() << " active ranges, " << active_frames << " of " << index.scores.size() << " frames ("
+                  << 100 * active_frames / std::max<size_t>(index.scores.size(), 1) << "% of the recording, threshold "
+                  << threshold << ")" << std::endl;
+        if (active.empty()) {
+            std::cout << "Nothing happens in the recording above the threshold, nothing to stitch" << std::endl;
+            return -1;
+        }
+    }
+
+    // Keyframe detection over the stitched frames, the view path csv is what -pipeline -view_path takes
+    if (track_mode) {
+        if (!options.image_sequence_dir.empty() || !frame_plan_path.empty()) {
+            std::cout << "-track reads the whole recording, -image_sequence_dir and -frame_plan can't be used with it" << std::endl;
+            return -1;
+        }
+
+        const std::string csv_path = get_view_path_csv_path(input_paths[0]);
+        std::cout << "Output: \n";
+        std::cout << csv_path << std::endl;
+
+        // With a chunk manifest another process stitches, the frames are taken as its chunks show up
+        std::unique_ptr<EquirectFrameSource> source;
+        if (!chunk_manifest_path.empty()) {
+            source = std::make_unique<ChunkManifestSource>(chunk_manifest_path);
+        }
+        else if (!active.empty()) {
+            // The rows keep the recording's frame numbers, the reframe holds the view over the gaps
+            source = std::make_unique<StitcherSpoolSource>(input_paths, options, active);
+        }
+        else {
+            source = std::make_unique<StitcherSpoolSource>(input_paths, options);
+        }
+
+        ObjectDetector detector(detector_settings);
+        TrackingResult result = run_goalkeeper_tracking(*source, detector, tracker_settings, csv_path);
+        if (!result.ok) {
+            std::cout << "error: " << result.error_info << std::endl;
+        }
+        std::cout << result.frames << " frames, cost = " << result.wall_seconds << " (" << result.fps() << " fps)" << std::endl;
+        std::cout << "detector ran on " << result.keyframes << " keyframes (" << result.detector_runs << " runs, "
+                  << result.detect_seconds << " s)" << std::endl;
+        std::cout << result.full_sweeps << " full sweeps, " << result.keyframes - result.full_sweeps << " windowed keyframes, "
+                  << (result.keyframes > 0 ? static_cast<double>(result.views) / result.keyframes : 0.0) << " views per keyframe" << std::endl;
+        return result.ok ? 0 : -1;
     }
 
-    if (color_plus_model_path.empty()) {
-        enable_colorplus = false;
+    if (pipeline_mode) {
+        if (!options.image_sequence_dir.empty()) {
+            std::cout << "-pipeline feeds the frames straight to the reframe stage, -image_sequence_dir can't be used with it" << std::endl;
+            return -1;
+        }
+        if (!frame_plan_path.empty()) {
+            std::cout << "-pipeline reframes the whole recording, -frame_plan can't be used with it" << std::endl;
+            return -1;
+        }
+
+        // Only the reframed video is written, the full resolution equirect never hits the disk
+        const std::string edited_path = get_edited_output_path(input_paths[0]);
+        std::cout << "Output: \n";
+        std::cout << edited_path << std::endl;
+
+        StitcherSpoolSource source(input_paths, options);
+        PipelineResult result = run_reframe_pipeline(source, view_path, edited_path, pipeline_settings);
+        if (!result.ok) {
+            std::cout << "error: " << result.error_info << std::endl;
+        }
+        std::cout << result.frames << " frames, cost = " << result.wall_seconds << " (" << result.fps() << " fps)" << std::endl;
+        std::cout << "stitch stage blocked " << result.producer_wait_seconds << " s, reframe stage idle "
+                  << result.consumer_wait_seconds << " s" << std::endl;
+        std::cout << "encoder: " << result.encoder.fps() << " fps, " << result.encoder.bitrate_kbps() << " kbit/s" << std::endl;
+        return result.ok ? 0 : -1;
     }
 
-    int count = 1;
-    while (count--) {
-        std::mutex mutex;
-        std::condition_variable cond;
-        bool is_finished = false;
-        bool has_error = false;
-        int stitch_progress = 0;
-        std::string suffix = input_paths[0].substr(input_paths[0].find_last_of(".") + 1);
-        std::transform(suffix.begin(), suffix.end(), suffix.begin(), ::tolower);
+    // Second pass of the proxy workflow, only the frames the planner picked are stitched.
+    // The active ranges take the same way
+    if (!frame_plan_path.empty() || !active.empty()) {
+        const std::vector<FrameRange> plan = active.empty() ? load_frame_plan(frame_plan_path) : active;
+        if (plan.empty()) {
+            std::cout << "No frames found in the frame plan " << frame_plan_path << std::endl;
+            return -1;
+        }
 
-        auto start_time = steady_clock::now();
-        auto video_stitcher = std::make_shared<VideoStitcher>();
-        video_stitcher->SetInputPath(input_paths);
-        if (image_sequence_dir.empty()) {
-            video_stitcher->SetOutputPath(output_path);
+        if (!options.image_sequence_dir.empty()) {
+            // The planned frames replace -export_frame_index
+            export_spans = frame_plan_spans(plan);
         }
         else {
-            if (!export_frame_nums.empty()) {
-                video_stitcher->SetExportFrameSequence(export_frame_nums);
-            }
+            const std::string ranges_dir = get_ranges_output_dir(input_paths[0]);
+            std::cout << "Output: \n";
+            std::cout << ranges_dir << std::endl;
+
+            RangeStitchSettings range_settings;
+            range_settings.max_jobs = batch_settings.max_jobs;
+            range_settings.max_hw_sessions = batch_settings.max_hw_sessions;
+            range_settings.overlap_frames = segment_settings.overlap_frames;
+            range_settings.timeout_seconds = timeout_seconds;
+            range_settings.telemetry = batch_settings.telemetry;
+            return run_range_stitch(input_paths, plan, ranges_dir, options, range_settings) ? 0 : -1;
+        }
+    }
 
-            video_stitcher->SetImageSequenceInfo(image_sequence_dir, image_type);
-        }
-        video_stitcher->SetStitchType(stitch_type);
-        video_stitcher->EnableCuda(enable_cuda);
-        video_stitcher->EnableStitchFusion(enalbe_stitchfusion);
-        video_stitcher->EnableColorPlus(enable_colorplus, color_plus_model_path);
-        video_stitcher->SetOutputSize(output_width, output_height);
-        video_stitcher->SetOutputBitRate(output_bitrate);
-        video_stitcher->EnableFlowState(enable_flowstate);
-        video_stitcher->SetAiStitchModelFile(ai_stitching_model);
-        video_stitcher->EnableDenoise(enable_sequence_denoise);
-        video_stitcher->EnableDirectionLock(enable_directionlock);
-        video_stitcher->SetCameraAccessoryType(accessory_type);
-        video_stitcher->SetSoftwareCodecUsage(enable_soft_encode, enable_soft_decode);
-        if (enable_H265_encoder) {
-            video_stitcher->EnableH265Encoder();
-        }
-        video_stitcher->EnableDeflicker(enable_deflicker, deflicker_model_path);
-        video_stitcher->SetStitchProgressCallback([&](int process, int error) {
-            if (stitch_progress != process) {
-                const std::string process_desc = "process = " + std::to_string(process) + std::string("%");
-                std::cout << "\r" << process_desc << std::flush;
-                stitch_progress = process;
-            }
+    // Streaming output: every finished chunk shows up in the manifest while the rest is still stitching
+    if (chunk_mode) {
+        if (!export_spans.empty()) {
+            std::cout << "-chunk_seconds publishes the whole recording, -export_frame_index and -frame_plan can't be used with it" << std::endl;
+            return -1;
+        }
 
-            if (stitch_progress == 100) {
-                std::cout << std::endl;
-                std::unique_lock<std::mutex> lck(mutex);
-                cond.notify_one();
-                is_finished = true;
-            }
-        });
+        const std::string chunks_dir = options.image_sequence_dir.empty() ? get_chunks_output_dir(output_path) : options.image_sequence_dir;
+        std::cout << "Output: \n";
+        std::cout << chunks_dir << std::endl;
 
-        video_stitcher->SetStitchStateCallback([&](int error, const char* err_info) {
-            std::cout << "error: " << err_info << std::endl;
-            has_error = true;
-            cond.notify_one();
-        });
+        chunk_settings.max_jobs = batch_settings.max_jobs;
+        chunk_settings.max_hw_sessions = batch_settings.max_hw_sessions;
+        chunk_settings.overlap_frames = segment_settings.overlap_frames;
+        chunk_settings.timeout_seconds = timeout_seconds;
+        chunk_settings.telemetry = batch_settings.telemetry;
+        return run_chunked_stitch(input_paths, chunks_dir, options, chunk_settings) ? 0 : -1;
+    }
 
-        std::cout << "start stitch " << std::endl;
-        video_stitcher->StartStitch();
+    // Selected frames only: every group of nearby spans is exported by its own job, cut out unless
+    // stabilisation needs the whole lens files
+    if (!options.image_sequence_dir.empty() && !export_spans.empty()) {
+        std::cout << "Output: \n";
+        std::cout << options.image_sequence_dir << std::endl;
+
+        RangeStitchSettings range_settings;
+        range_settings.max_jobs = batch_settings.max_jobs;
+        range_settings.max_hw_sessions = batch_settings.max_hw_sessions;
+        range_settings.overlap_frames = segment_settings.overlap_frames;
+        range_settings.timeout_seconds = timeout_seconds;
+        range_settings.telemetry = batch_settings.telemetry;
+        return run_range_export(input_paths, export_spans, options, range_settings) ? 0 : -1;
+    }
 
-        std::unique_lock<std::mutex> lck(mutex);
-        cond.wait(lck, [&] {
-            std::cout << "progress: " << video_stitcher->GetStitchProgress() << "; finished: " << is_finished << std::endl;
-            return is_finished || has_error;
-        });
+    std::cout << "Output: \n";
+    std::cout << output_path << std::endl;
+
+    if (segment_settings.segments > 1 && options.image_sequence_dir.empty()) {
+        segment_settings.max_hw_sessions = batch_settings.max_hw_sessions;
 
-        std::cout << "end stitch " << std::endl;
+        ConversionCache cache(default_manifest_path(output_path));
+        const std::string key = ConversionCache::make_key(input_paths, options);
+        if (!force && cache.lookup(key, output_path)) {
+            std::cout << "Up to date: " << output_path << std::endl;
+            return 0;
+        }
 
-        auto end_time = steady_clock::now();
-        std::cout << "cost = " << duration_cast<duration<double>>(end_time - start_time).count() << std::endl;
+        if (!run_segmented_stitch(input_paths, output_path, options, segment_settings)) {
+            std::cout << "Segmented stitch failed" << std::endl;
+            return -1;
+        }
+        cache.store(key, output_path);
+        return 0;
     }
-    return 0;
+
+    const std::string job_name = std::filesystem::path(output_path).filename().string();
+    auto print_progress = [&](int process) {
+        const std::string process_desc = "process = " + std::to_string(process) + std::string("%");
+        std::cout << "\r" << process_desc << std::flush;
+        if (process == 100) {
+            std::cout << std::endl;
+        }
+        if (telemetry_settings.enabled()) {
+            telemetry.progress(job_name, process);
+        }
+    };
+
+    std::cout << "start stitch " << std::endl;
+    if (telemetry_settings.enabled()) {
+        telemetry.begin_job(job_name, stitch_frame_count(input_paths, options));
+    }
+    StitchJobSpec spec;
+    spec.input_paths = input_paths;
+    spec.output_path = output_path;
+    spec.options = options;
+    spec.timeout_seconds = timeout_seconds;
+    spec.on_progress = print_progress;
+
+    StitchExecutor executor(1, 1);
+    StitchResult result;
+    if (options.image_sequence_dir.empty()) {
+        ConversionCache cache(default_manifest_path(output_path));
+        result = submit_stitch_cached(executor, cache, std::move(spec), force)->wait();
+    }
+    else {
+        // image sequences aren't tracked by the manifest
+        result = executor.submit(std::move(spec))->wait();
+    }
+
+    if (telemetry_settings.enabled()) {
+        telemetry.end_job(job_name, result);
+    }
+
+    if (!result.ok) {
+        std::cout << std::endl << "error: " << result.error_info << std::endl;
+    }
+    std::cout << "end stitch " << std::endl;
+    std::cout << "cost = " << result.wall_seconds << std::endl;
+
+    return result.ok ? 0 : -1;
 }
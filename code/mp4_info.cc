@@ -0,0 +1,258 @@
+#include "mp4_info.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <set>
+
+namespace {
+
+// The last bytes of an .insv file: ..., trailer size (little endian u32 at offset 38), ..., magic
+const size_t INSTA360_TAIL_SIZE = 78;
+const size_t INSTA360_SIZE_OFFSET = 38;
+const char INSTA360_MAGIC[] = "8db42d694ccc418790edff439fe026bf";
+
+struct Box {
+    std::string type;
+    uint64_t payload_start = 0; // offset right after the box header
+    uint64_t end = 0;           // offset of the first byte after the box
+};
+
+uint32_t read_u32(std::istream& in) {
+    unsigned char b[4] = {0};
+    in.read(reinterpret_cast<char*>(b), 4);
+    return (uint32_t(b[0]) << 24) | (uint32_t(b[1]) << 16) | (uint32_t(b[2]) << 8) | uint32_t(b[3]);
+}
+
+uint64_t read_u64(std::istream& in) {
+    uint64_t high = read_u32(in);
+    return (high << 32) | read_u32(in);
+}
+
+bool read_box(std::istream& in, uint64_t offset, uint64_t limit, Box& box) {
+    if (offset + 8 > limit) return false;
+
+    in.clear();
+    in.seekg(offset);
+    uint64_t size = read_u32(in);
+    char type[4];
+    in.read(type, 4);
+    if (!in) return false;
+
+    box.type.assign(type, 4);
+    box.payload_start = offset + 8;
+
+    // size == 1 -> 64 bit size follows the type, size == 0 -> box extends to the end of its parent
+    if (size == 1) {
+        size = read_u64(in);
+        box.payload_start += 8;
+    }
+    else if (size == 0) {
+        size = limit - offset;
+    }
+
+    if (size < box.payload_start - offset || offset + size > limit) return false;
+    box.end = offset + size;
+    return true;
+}
+
+// Finds the first child of the given type inside [start, end)
+bool find_child(std::istream& in, uint64_t start, uint64_t end, const std::string& type, Box& result) {
+    Box box;
+    for (uint64_t offset = start; read_box(in, offset, end, box); offset = box.end) {
+        if (box.type == type) {
+            result = box;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool find_path(std::istream& in, Box parent, const std::vector<std::string>& path, Box& result) {
+    for (const auto& type : path) {
+        if (!find_child(in, parent.payload_start, parent.end, type, parent)) return false;
+    }
+    result = parent;
+    return true;
+}
+
+bool is_video_track(std::istream& in, const Box& trak) {
+    Box hdlr;
+    if (!find_path(in, trak, {"mdia", "hdlr"}, hdlr)) return false;
+
+    // version/flags (4) + pre_defined (4) + handler_type (4)
+    in.seekg(hdlr.payload_start + 8);
+    char handler[4];
+    in.read(handler, 4);
+    return in && std::string(handler, 4) == "vide";
+}
+
+void read_track(std::istream& in, const Box& trak, Mp4Info& info) {
+    Box box;
+
+    if (find_path(in, trak, {"tkhd"}, box)) {
+        // width and height are the last 8 bytes of tkhd as 16.16 fixed point
+        in.seekg(box.end - 8);
+        info.width = static_cast<int>(read_u32(in) >> 16);
+        info.height = static_cast<int>(read_u32(in) >> 16);
+    }
+
+    uint64_t timescale = 0;
+    uint64_t duration = 0;
+    if (find_path(in, trak, {"mdia", "mdhd"}, box)) {
+        in.seekg(box.payload_start);
+        const uint32_t version = read_u32(in) >> 24;
+        if (version == 1) {
+            read_u64(in); // creation time
+            read_u64(in); // modification time
+            timescale = read_u32(in);
+            duration = read_u64(in);
+        }
+        else {
+            read_u32(in);
+            read_u32(in);
+            timescale = read_u32(in);
+            duration = read_u32(in);
+        }
+    }
+
+    if (find_path(in, trak, {"mdia", "minf", "stbl", "stsz"}, box)) {
+        // version/flags (4) + sample_size (4) + sample_count (4)
+        in.seekg(box.payload_start + 8);
+        info.frame_count = read_u32(in);
+    }
+
+    if (find_path(in, trak, {"mdia", "minf", "stbl", "stss"}, box)) {
+        in.seekg(box.payload_start + 4);
+        const uint32_t entries = read_u32(in);
+        info.keyframes.reserve(entries);
+        for (uint32_t i = 0; i < entries && in; ++i) {
+            // sync sample numbers are 1 based in the container
+            info.keyframes.push_back(read_u32(in) - 1);
+        }
+    }
+
+    if (find_path(in, trak, {"mdia", "minf", "stbl", "stts"}, box)) {
+        in.seekg(box.payload_start + 4);
+        const uint32_t entries = read_u32(in);
+        for (uint32_t i = 0; i < entries && in; ++i) {
+            const uint32_t count = read_u32(in);
+            info.sample_durations.emplace_back(count, read_u32(in));
+        }
+    }
+
+    if (find_path(in, trak, {"mdia", "minf", "stbl", "ctts"}, box)) {
+        // Offsets are signed in version 1, version 0 ones never use the top bit in practice
+        in.seekg(box.payload_start + 4);
+        const uint32_t entries = read_u32(in);
+        for (uint32_t i = 0; i < entries && in; ++i) {
+            const uint32_t count = read_u32(in);
+            info.composition_offsets.emplace_back(count, static_cast<int32_t>(read_u32(in)));
+        }
+    }
+
+    info.timescale = static_cast<uint32_t>(timescale);
+    if (timescale > 0 && duration > 0) {
+        info.duration_seconds = static_cast<double>(duration) / static_cast<double>(timescale);
+        if (info.frame_count > 0) {
+            info.fps = static_cast<double>(info.frame_count) / info.duration_seconds;
+        }
+    }
+
+    info.valid = info.frame_count > 0;
+}
+
+// Decode time (sum of the durations before it) plus the composition offset of the frame
+int64_t composition_time(const Mp4Info& info, uint64_t frame) {
+    int64_t time = 0;
+    uint64_t remaining = frame;
+    for (const auto& [count, delta] : info.sample_durations) {
+        const uint64_t samples = std::min<uint64_t>(count, remaining);
+        time += static_cast<int64_t>(samples * delta);
+        remaining -= samples;
+        if (remaining == 0) break;
+    }
+
+    remaining = frame;
+    for (const auto& [count, offset] : info.composition_offsets) {
+        if (remaining < count) {
+            time += offset;
+            break;
+        }
+        remaining -= count;
+    }
+    return time;
+}
+
+} // namespace
+
+Mp4Info read_mp4_info(const std::string& path) {
+    Mp4Info info;
+
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return info;
+
+    in.seekg(0, std::ios::end);
+    const uint64_t file_size = static_cast<uint64_t>(in.tellg());
+
+    Box moov;
+    if (!find_child(in, 0, file_size, "moov", moov)) return info;
+
+    Box trak;
+    for (uint64_t offset = moov.payload_start; read_box(in, offset, moov.end, trak); offset = trak.end) {
+        if (trak.type == "trak" && is_video_track(in, trak)) {
+            read_track(in, trak, info);
+            break;
+        }
+    }
+
+    return info;
+}
+
+std::vector<uint64_t> common_keyframes(const Mp4Info& a, const Mp4Info& b, uint64_t frames) {
+    auto all_frames = [&](const Mp4Info& info) { return info.keyframes.empty(); };
+    std::vector<uint64_t> result;
+
+    if (all_frames(a) && all_frames(b)) {
+        for (uint64_t i = 0; i < frames; ++i) result.push_back(i);
+        return result;
+    }
+
+    const std::set<uint64_t> other(b.keyframes.begin(), b.keyframes.end());
+    const std::vector<uint64_t>& base = all_frames(a) ? b.keyframes : a.keyframes;
+    for (uint64_t frame : base) {
+        if (frame < frames && (all_frames(b) || all_frames(a) || other.count(frame))) {
+            result.push_back(frame);
+        }
+    }
+    return result;
+}
+
+uint64_t keyframe_at_or_before(const std::vector<uint64_t>& keyframes, uint64_t frame) {
+    auto it = std::upper_bound(keyframes.begin(), keyframes.end(), frame);
+    return it == keyframes.begin() ? 0 : *std::prev(it);
+}
+
+uint64_t frame_time_ticks(const Mp4Info& info, uint64_t frame) {
+    const int64_t time = composition_time(info, frame) - composition_time(info, 0);
+    return time > 0 ? static_cast<uint64_t>(time) : 0;
+}
+
+uint64_t insta360_trailer_size(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return 0;
+
+    in.seekg(0, std::ios::end);
+    const uint64_t file_size = static_cast<uint64_t>(in.tellg());
+    if (file_size < INSTA360_TAIL_SIZE) return 0;
+
+    unsigned char tail[INSTA360_TAIL_SIZE];
+    in.seekg(file_size - INSTA360_TAIL_SIZE);
+    in.read(reinterpret_cast<char*>(tail), INSTA360_TAIL_SIZE);
+    const size_t magic_size = sizeof(INSTA360_MAGIC) - 1;
+    if (!in || std::memcmp(tail + INSTA360_TAIL_SIZE - magic_size, INSTA360_MAGIC, magic_size) != 0) return 0;
+
+    const unsigned char* size = tail + INSTA360_SIZE_OFFSET;
+    const uint64_t trailer_size = uint64_t(size[0]) | (uint64_t(size[1]) << 8) | (uint64_t(size[2]) << 16) | (uint64_t(size[3]) << 24);
+    return trailer_size >= INSTA360_TAIL_SIZE && trailer_size <= file_size ? trailer_size : 0;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Basic information about the first video track of an mp4 based container (.mp4 and .insv)
+struct Mp4Info {
+    bool valid = false;
+    int width = 0;
+    int height = 0;
+    uint64_t frame_count = 0;
+    double fps = 0.0;
+    double duration_seconds = 0.0;
+    // 0 based indices of the sync samples (keyframes). Empty when every frame is a keyframe
+    std::vector<uint64_t> keyframes;
+
+    // Sample timing, stts and ctts as they are stored: runs of <count> samples sharing a duration or
+    // a composition offset, in ticks of timescale
+    uint32_t timescale = 0;
+    std::vector<std::pair<uint32_t, uint32_t>> sample_durations;
+    std::vector<std::pair<uint32_t, int32_t>> composition_offsets;
+};
+
+// Walks the mp4 boxes (moov -> trak -> mdia -> minf -> stbl) without decoding anything,
+// so it is cheap enough to call on every file of a card dump
+Mp4Info read_mp4_info(const std::string& path);
+
+// Frames below `frames` where both lens files have a keyframe. An empty stss means every frame is one
+std::vector<uint64_t> common_keyframes(const Mp4Info& a, const Mp4Info& b, uint64_t frames);
+
+// Last keyframe <= frame, 0 when there is none
+uint64_t keyframe_at_or_before(const std::vector<uint64_t>& keyframes, uint64_t frame);
+
+// Presentation time of a frame in ticks of info.timescale, counted from the presentation time of the
+// first frame, which is where ffmpeg puts 0 for -ss
+uint64_t frame_time_ticks(const Mp4Info& info, uint64_t frame);
+
+// Size of the Insta360 trailer of an .insv file: the calibration, gyro and exposure records the camera
+// appends after the mp4 boxes, found through the magic at the very end. 0 when the file has none
+uint64_t insta360_trailer_size(const std::string& path);
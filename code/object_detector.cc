@@ -0,0 +1,246 @@
+#include "object_detector.h"
+#include "equirect_remap.h"
+
+#ifndef NO_ONNXRUNTIME
+#include <onnxruntime_cxx_api.h>
+#endif
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <filesystem>
+
+namespace {
+
+// Padding colour of the ultralytics letterbox
+const float PAD_VALUE = 114.0f / 255.0f;
+
+struct Letterbox {
+    float scale = 1.0f; // network pixels per view pixel
+    int width = 0;      // size of the scaled view inside the square
+    int height = 0;
+    int pad_x = 0;
+    int pad_y = 0;
+};
+
+Letterbox letterbox_of(int width, int height, int size) {
+    Letterbox box;
+    box.scale = std::min(static_cast<float>(size) / width, static_cast<float>(size) / height);
+    box.width = std::min(size, static_cast<int>(std::lround(width * box.scale)));
+    box.height = std::min(size, static_cast<int>(std::lround(height * box.scale)));
+    box.pad_x = (size - box.width) / 2;
+    box.pad_y = (size - box.height) / 2;
+    return box;
+}
+
+const std::array<float, 256>& unit_table() {
+    static const std::array<float, 256> table = [] {
+        std::array<float, 256> values{};
+        for (int i = 0; i < 256; ++i) values[i] = i / 255.0f;
+        return values;
+    }();
+    return table;
+}
+
+float overlap(const Detection& a, const Detection& b) {
+    const float w = std::max(0.0f, std::min(a.x2, b.x2) - std::max(a.x1, b.x1));
+    const float h = std::max(0.0f, std::min(a.y2, b.y2) - std::max(a.y1, b.y1));
+    const float intersection = w * h;
+    const float area = (a.x2 - a.x1) * (a.y2 - a.y1) + (b.x2 - b.x1) * (b.y2 - b.y1) - intersection;
+    return area > 0.0f ? intersection / area : 0.0f;
+}
+
+} // namespace
+
+#ifndef NO_ONNXRUNTIME
+struct ObjectDetector::Session {
+    Ort::Env env{ ORT_LOGGING_LEVEL_WARNING, "insv-detector" };
+    std::unique_ptr<Ort::Session> session;
+    std::string input_name;
+    std::string output_name;
+    Ort::MemoryInfo memory = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
+};
+#else
+struct ObjectDetector::Session {};
+#endif
+
+ObjectDetector::ObjectDetector(DetectorSettings settings) : settings_(std::move(settings)) {
+#ifndef NO_ONNXRUNTIME
+    std::error_code ec;
+    if (!std::filesystem::exists(settings_.model_path, ec)) {
+        error_ = "model not found: " + settings_.model_path;
+        return;
+    }
+
+    try {
+        session_ = std::make_unique<Session>();
+
+        Ort::SessionOptions options;
+        options.SetGraphOptimizationLevel(ORT_ENABLE_ALL);
+        if (settings_.threads > 0) {
+            options.SetIntraOpNumThreads(settings_.threads);
+        }
+        const std::filesystem::path model(settings_.model_path);
+        session_->session = std::make_unique<Ort::Session>(session_->env, model.c_str(), options);
+
+        Ort::AllocatorWithDefaultOptions allocator;
+        session_->input_name = session_->session->GetInputNameAllocated(0, allocator).get();
+        session_->output_name = session_->session->GetOutputNameAllocated(0, allocator).get();
+
+        // NCHW, -1 for the dynamic axes
+        const std::vector<int64_t> shape = session_->session->GetInputTypeInfo(0).GetTensorTypeAndShapeInfo().GetShape();
+        if (shape.size() == 4) {
+            dynamic_batch_ = shape[0] <= 0;
+            batch_size_ = dynamic_batch_ ? std::max(settings_.max_batch, 1) : static_cast<int>(shape[0]);
+            if (shape[2] > 0) input_size_ = static_cast<int>(shape[2]);
+        }
+    } catch (const Ort::Exception& ex) {
+        error_ = std::string("failed to load ") + settings_.model_path + ": " + ex.what();
+        session_.reset();
+    }
+#else
+    error_ = "built without ONNX Runtime (NO_ONNXRUNTIME)";
+#endif
+}
+
+ObjectDetector::~ObjectDetector() = default;
+
+void ObjectDetector::preprocess(const ImageView& image, float* slot) const {
+    const size_t plane = static_cast<size_t>(input_size_) * input_size_;
+    std::fill(slot, slot + plane * 3, PAD_VALUE);
+
+    const Letterbox box = letterbox_of(image.width, image.height, input_size_);
+    const auto& unit = unit_table();
+
+    // Source column of every network column, nearest neighbour. The usual 640x480 view goes in 1:1
+    std::vector<int> columns(box.width);
+    for (int x = 0; x < box.width; ++x) {
+        columns[x] = std::min(image.width - 1, static_cast<int>(x / box.scale));
+    }
+
+    for (int y = 0; y < box.height; ++y) {
+        const uint8_t* src = image.row(std::min(image.height - 1, static_cast<int>(y / box.scale)));
+        const size_t offset = static_cast<size_t>(y + box.pad_y) * input_size_ + box.pad_x;
+        float* r = slot + offset;
+        float* g = slot + plane + offset;
+        float* b = slot + 2 * plane + offset;
+        for (int x = 0; x < box.width; ++x) {
+            const uint8_t* pixel = src + columns[x] * 3;
+            b[x] = unit[pixel[0]];
+            g[x] = unit[pixel[1]];
+            r[x] = unit[pixel[2]];
+        }
+    }
+}
+
+// YOLOv8 head: 4 box values (cx, cy, w, h) and one score per COCO class for every anchor, stored
+// either channel major [4 + classes, anchors] (the stock export) or anchor major
+void ObjectDetector::decode(const float* output, int64_t channels, int64_t anchors, bool channels_first,
+                            const DetectorInput& input, size_t index, std::vector<Detection>& detections) const {
+    const Letterbox box = letterbox_of(input.image.width, input.image.height, input_size_);
+    auto value = [&](int64_t channel, int64_t anchor) {
+        return channels_first ? output[channel * anchors + anchor] : output[anchor * channels + channel];
+    };
+
+    std::vector<Detection> found;
+    for (int64_t a = 0; a < anchors; ++a) {
+        for (int class_id : settings_.classes) {
+            if (4 + class_id >= channels) continue;
+            const float score = value(4 + class_id, a);
+            if (score < settings_.confidence) continue;
+
+            const float cx = value(0, a), cy = value(1, a), w = value(2, a), h = value(3, a);
+            Detection detection;
+            detection.input = index;
+            detection.frame = input.frame;
+            detection.class_id = class_id;
+            detection.confidence = score;
+            detection.x1 = std::clamp((cx - w / 2 - box.pad_x) / box.scale, 0.0f, static_cast<float>(input.image.width));
+            detection.y1 = std::clamp((cy - h / 2 - box.pad_y) / box.scale, 0.0f, static_cast<float>(input.image.height));
+            detection.x2 = std::clamp((cx + w / 2 - box.pad_x) / box.scale, 0.0f, static_cast<float>(input.image.width));
+            detection.y2 = std::clamp((cy + h / 2 - box.pad_y) / box.scale, 0.0f, static_cast<float>(input.image.height));
+            found.push_back(detection);
+        }
+    }
+
+    suppress_overlaps(found, settings_.iou);
+    for (auto& detection : found) {
+        view_point_to_yaw_pitch(input.fov_deg, input.yaw_deg, input.pitch_deg, input.image.width, input.image.height,
+                                (detection.x1 + detection.x2) / 2, (detection.y1 + detection.y2) / 2,
+                                detection.yaw_deg, detection.pitch_deg);
+        detection.width_deg = (detection.x2 - detection.x1) / input.image.width * input.fov_deg;
+        detection.height_deg = (detection.y2 - detection.y1) / input.image.height * input.fov_deg;
+        detections.push_back(detection);
+    }
+}
+
+std::vector<Detection> ObjectDetector::detect(const std::vector<DetectorInput>& inputs) {
+    std::vector<Detection> detections;
+#ifndef NO_ONNXRUNTIME
+    if (!session_) return detections;
+
+    const size_t batch = static_cast<size_t>(batch_size_);
+    const size_t image_floats = static_cast<size_t>(3) * input_size_ * input_size_;
+    tensor_.resize(batch * image_floats);
+
+    for (size_t first = 0; first < inputs.size(); first += batch) {
+        const size_t count = std::min(batch, inputs.size() - first);
+        for (size_t i = 0; i < count; ++i) {
+            preprocess(inputs[first + i].image, tensor_.data() + i * image_floats);
+        }
+
+        // A fixed batch model always gets a full tensor, the unused slots are just ignored
+        const int64_t run_batch = dynamic_batch_ ? static_cast<int64_t>(count) : batch_size_;
+        const std::array<int64_t, 4> shape = { run_batch, 3, input_size_, input_size_ };
+
+        try {
+            Ort::Value tensor = Ort::Value::CreateTensor<float>(session_->memory, tensor_.data(),
+                                                                static_cast<size_t>(run_batch) * image_floats, shape.data(), shape.size());
+            const char* input_name = session_->input_name.c_str();
+            const char* output_name = session_->output_name.c_str();
+            std::vector<Ort::Value> outputs = session_->session->Run(Ort::RunOptions{ nullptr }, &input_name, &tensor, 1, &output_name, 1);
+
+            const std::vector<int64_t> out_shape = outputs[0].GetTensorTypeAndShapeInfo().GetShape();
+            if (out_shape.size() != 3) {
+                error_ = "unexpected output shape of " + settings_.model_path;
+                return {};
+            }
+
+            // The class axis is the short one: [N, 84, 8400] or [N, 8400, 84]
+            const bool channels_first = out_shape[1] < out_shape[2];
+            const int64_t channels = channels_first ? out_shape[1] : out_shape[2];
+            const int64_t anchors = channels_first ? out_shape[2] : out_shape[1];
+            const float* output = outputs[0].GetTensorMutableData<float>();
+
+            for (size_t i = 0; i < count; ++i) {
+                decode(output + i * channels * anchors, channels, anchors, channels_first, inputs[first + i], first + i, detections);
+            }
+        } catch (const Ort::Exception& ex) {
+            error_ = std::string("inference failed: ") + ex.what();
+            return {};
+        }
+    }
+#else
+    (void)inputs;
+#endif
+    return detections;
+}
+
+void suppress_overlaps(std::vector<Detection>& detections, float iou) {
+    std::sort(detections.begin(), detections.end(), [](const Detection& a, const Detection& b) {
+        return a.confidence > b.confidence;
+    });
+
+    std::vector<Detection> kept;
+    for (const auto& detection : detections) {
+        bool suppressed = false;
+        for (const auto& other : kept) {
+            if (other.input == detection.input && other.class_id == detection.class_id && overlap(other, detection) > iou) {
+                suppressed = true;
+                break;
+            }
+        }
+        if (!suppressed) kept.push_back(detection);
+    }
+    detections = std::move(kept);
+}
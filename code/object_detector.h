@@ -0,0 +1,83 @@
+#pragma once
+
+#include "image.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// COCO class ids of a stock YOLOv8 export
+const int COCO_PERSON = 0;
+const int COCO_SPORTS_BALL = 32;
+
+struct DetectorSettings {
+    std::string model_path = "yolov8n.onnx";
+    std::vector<int> classes = { COCO_PERSON, COCO_SPORTS_BALL }; // everything else is dropped before the NMS
+    float confidence = 0.75f; // same threshold as track-goalkeeper.py
+    float iou = 0.45f;        // boxes of the same class overlapping more are suppressed
+    int max_batch = 16;       // images per inference run, capped by the batch size of the model
+    int threads = 0;          // ONNX Runtime intra op threads, 0 -> one per core
+};
+
+// One perspective view to look at, straight out of the remap output buffer
+struct DetectorInput {
+    ImageView image;  // BGR24
+    uint64_t frame = 0;
+    double fov_deg = 90.0;
+    double yaw_deg = 0.0;   // direction the view was rendered with (compute_view_map convention)
+    double pitch_deg = 0.0;
+};
+
+struct Detection {
+    size_t input = 0;  // index into the inputs given to detect()
+    uint64_t frame = 0;
+    int class_id = 0;
+    float confidence = 0.0f;
+    float x1 = 0.0f, y1 = 0.0f, x2 = 0.0f, y2 = 0.0f; // pixels of the view
+    double yaw_deg = 0.0;   // direction of the box centre, like yolo_box_to_yaw_pitch
+    double pitch_deg = 0.0; // latitude, up positive
+    double width_deg = 0.0; // angular size, from the part of the field of view the box covers
+    double height_deg = 0.0;
+};
+
+// YOLOv8 on ONNX Runtime (CPU). The views of one or more frames are letterboxed into a single
+// NCHW tensor and run together, the class filter, the confidence threshold and the NMS are done
+// here, and every box comes back as a yaw/pitch of the equirectangular frame.
+//
+// Models exported with a fixed batch size are run in chunks of that size. Built with
+// NO_ONNXRUNTIME the detector never loads and ok() is false
+class ObjectDetector {
+public:
+    explicit ObjectDetector(DetectorSettings settings);
+    ~ObjectDetector();
+
+    bool ok() const { return error_.empty(); }
+    const std::string& error() const { return error_; }
+
+    int input_size() const { return input_size_; }  // square side of the network input
+    int batch_size() const { return batch_size_; }  // images per inference run
+
+    // Detections of every input, in input order. Empty on error (see error())
+    std::vector<Detection> detect(const std::vector<DetectorInput>& inputs);
+
+private:
+    struct Session;
+
+    // Letterboxes image into the slot of the tensor, converting BGR24 to planar RGB in [0, 1]
+    void preprocess(const ImageView& image, float* slot) const;
+    void decode(const float* output, int64_t channels, int64_t anchors, bool channels_first,
+                const DetectorInput& input, size_t index, std::vector<Detection>& detections) const;
+
+    DetectorSettings settings_;
+    std::unique_ptr<Session> session_;
+    std::string error_;
+    int input_size_ = 640;
+    int batch_size_ = 1;
+    bool dynamic_batch_ = false;
+    std::vector<float> tensor_;
+};
+
+// Greedy per class non maximum suppression, keeps the highest confidence boxes
+void suppress_overlaps(std::vector<Detection>& detections, float iou);
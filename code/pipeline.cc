@@ -0,0 +1,143 @@
+#include "pipeline.h"
+#include "equirect_remap.h"
+#include "frame_ring.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <thread>
+
+using namespace std::chrono;
+
+namespace {
+
+const int BAND_ROWS = 32;
+
+double seconds_since(steady_clock::time_point start) {
+    return duration_cast<duration<double>>(steady_clock::now() - start).count();
+}
+
+} // namespace
+
+ViewPath load_view_path(const std::string& csv_path) {
+    auto path = std::make_shared<std::map<uint64_t, ViewAngles>>();
+
+    std::ifstream file(csv_path);
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream row(line);
+        std::string frame, yaw, pitch;
+        if (!std::getline(row, frame, ',') || !std::getline(row, yaw, ',') || !std::getline(row, pitch, ',')) continue;
+
+        try {
+            (*path)[std::stoull(frame)] = { std::stod(yaw), std::stod(pitch) };
+        } catch (const std::exception&) {
+            // header or malformed row
+        }
+    }
+
+    if (path->empty()) {
+        std::cout << "No camera directions found in " << csv_path << ", using the front view" << std::endl;
+    }
+
+    return [path](uint64_t frame) {
+        auto it = path->upper_bound(frame);
+        if (it == path->begin()) return ViewAngles{};
+        return std::prev(it)->second;
+    };
+}
+
+PipelineResult run_reframe_pipeline(EquirectFrameSource& source, const ViewPath& view_path,
+                                    const std::string& output_path, const PipelineSettings& settings) {
+    PipelineResult result;
+    auto start_time = steady_clock::now();
+
+    if (!source.open()) {
+        result.error_info = "failed to open the frame source";
+        return result;
+    }
+    const SourceInfo info = source.info();
+
+    VideoEncoder encoder(output_path, settings.output_width, settings.output_height, info.fps, settings.encoder);
+    if (!encoder.ok()) {
+        result.error_info = encoder.error();
+        return result;
+    }
+
+    FrameRing ring(std::max<size_t>(2, settings.ring_capacity), info.width, info.height);
+
+    // Stitch side: fill free slots in place until the source runs out
+    double producer_wait = 0.0;
+    std::thread producer([&] {
+        for (uint64_t index = 0;; ++index) {
+            auto wait_start = steady_clock::now();
+            FrameSlot* slot = ring.acquire_write();
+            producer_wait += seconds_since(wait_start);
+            if (!slot) break;
+
+            if (!source.read(slot->image.view())) {
+                ring.discard_write(slot);
+                break;
+            }
+            slot->index = index;
+            ring.commit_write(slot);
+        }
+        ring.close();
+    });
+
+    // Reframe side
+    ThreadPool pool(settings.threads);
+
+    ViewMapCache view_maps;
+    const size_t bands = (settings.output_height + BAND_ROWS - 1) / BAND_ROWS;
+
+    while (true) {
+        auto wait_start = steady_clock::now();
+        FrameSlot* slot = ring.acquire_read();
+        result.consumer_wait_seconds += seconds_since(wait_start);
+        if (!slot) break;
+
+        // Rendered straight into a frame of the encoder pool, blocks only if the encoder is behind
+        FrameSlot* output = encoder.acquire();
+        if (!output) {
+            ring.release_read(slot);
+            ring.abort();
+            break;
+        }
+        const ImageView output_view = output->image.view();
+
+        const ImageView frame = slot->image.view();
+        const ViewAngles angles = view_path ? view_path(slot->index) : ViewAngles{};
+
+        // The yaw is applied while sampling, only a new (quantized) pitch builds a map
+        const std::shared_ptr<const ViewMap> map = view_maps.get(frame.width, frame.height, frame.stride, settings.fov_deg,
+                                                                 angles.pitch_deg, settings.output_width, settings.output_height);
+
+        pool.parallel_for(bands, [&](size_t band) {
+            const int y_begin = static_cast<int>(band) * BAND_ROWS;
+            remap_rows_yaw(frame, *map, angles.yaw_deg, output_view, y_begin, std::min(settings.output_height, y_begin + BAND_ROWS));
+        });
+
+        // The equirect frame isn't needed anymore, give the slot back before encoding
+        ring.release_read(slot);
+
+        encoder.submit(output);
+        ++result.frames;
+    }
+
+    producer.join();
+    encoder.finish();
+
+    result.producer_wait_seconds = producer_wait;
+    result.encoder = encoder.stats();
+    result.wall_seconds = seconds_since(start_time);
+    result.error_info = encoder.ok() ? source.error() : encoder.error();
+    result.ok = result.frames > 0 && result.error_info.empty();
+    return result;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "frame_source.h"
+#include "video_encoder.h"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+struct ViewAngles {
+    double yaw_deg = 0.0;
+    double pitch_deg = 0.0;
+};
+
+// Camera direction of the reframed output for every frame
+using ViewPath = std::function<ViewAngles(uint64_t frame)>;
+
+// Reads a "frame,yaw,pitch" csv (one row per frame, or per change of direction).
+// Frames without a row keep the direction of the previous one
+ViewPath load_view_path(const std::string& csv_path);
+
+struct PipelineSettings {
+    size_t ring_capacity = 4; // equirect frames in flight between the stitch and reframe stages
+    int output_width = 640;
+    int output_height = 480;
+    double fov_deg = 90;
+    unsigned threads = 0;     // remap threads, 0 -> one per hardware thread
+    EncoderSettings encoder;
+};
+
+struct PipelineResult {
+    bool ok = false;
+    std::string error_info;
+    uint64_t frames = 0;
+    double wall_seconds = 0.0;
+    double producer_wait_seconds = 0.0; // time the stitch side was blocked on a full ring
+    double consumer_wait_seconds = 0.0; // time the reframe side was waiting for frames
+    EncoderStats encoder;
+
+    double fps() const { return wall_seconds > 0.0 ? static_cast<double>(frames) / wall_seconds : 0.0; }
+};
+
+// stitch -> reframe -> encode in a single process. The source fills a bounded ring of reused
+// equirect frames on its own thread, the reframe stage renders the view chosen by view_path straight
+// out of the ring slot into a frame of the encoder pool, and only the reframed video is encoded
+PipelineResult run_reframe_pipeline(EquirectFrameSource& source, const ViewPath& view_path,
+                                    const std::string& output_path, const PipelineSettings& settings);
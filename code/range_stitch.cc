@@ -0,0 +1,484 @@
+#include "range_stitch.h"
+#include "ffmpeg.h"
+#include "mp4_info.h"
+#include "stitch_job.h"
+#include "stitch_telemetry.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+
+namespace {
+
+struct RangeJob {
+    FrameRange range;
+    uint64_t input_begin = 0; // first stitched frame, a keyframe of both lenses
+    std::string dir;          // stream copied pieces of the lens files
+    std::string clip;
+    StitchResult result;
+};
+
+std::string range_name(const FrameRange& range) {
+    return std::to_string(range.begin) + "-" + std::to_string(range.end - 1);
+}
+
+// One stitch job of an image sequence export: spans close enough to be exported together
+struct ExportJob {
+    std::vector<FrameSpan> spans;
+    uint64_t first = 0;
+    uint64_t last = 0;
+    uint64_t input_begin = 0; // first frame of the cut pieces, 0 when exported from the whole lens files
+    std::string dir;          // stream copied pieces of the lens files
+    std::string frames_dir;   // where the SDK writes the frames of this job
+    std::vector<uint64_t> frames; // in frames of the recording
+    StitchResult result;
+};
+
+// Where both lens files can be cut by stream copy
+struct CutPoints {
+    double fps = 0.0;
+    uint64_t frames = 0;
+    std::vector<uint64_t> keyframes; // common to both lenses
+};
+
+bool read_cut_points(const std::vector<std::string>& input_paths, CutPoints& cuts) {
+    const Mp4Info lens0 = read_mp4_info(input_paths[0]);
+    const Mp4Info lens1 = read_mp4_info(input_paths[1]);
+    if (!lens0.valid || !lens1.valid || lens0.fps <= 0.0) {
+        std::cout << "Failed to read the frame count of the inputs, can't cut the planned ranges" << std::endl;
+        return false;
+    }
+
+    cuts.fps = lens0.fps;
+    cuts.frames = std::min(lens0.frame_count, lens1.frame_count);
+    cuts.keyframes = common_keyframes(lens0, lens1, cuts.frames);
+    if (cuts.keyframes.empty()) {
+        std::cout << "The lens files have no keyframe in common, can't cut the planned ranges" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Pre-roll stitched before every cut so the temporal filters have settled on the first wanted frame
+int64_t cut_overlap(const StitchOptions& options, const RangeStitchSettings& settings, double fps) {
+    if (settings.overlap_frames >= 0) return settings.overlap_frames;
+    return (options.enable_flowstate || options.enable_deflicker || options.enable_directionlock)
+        ? static_cast<int64_t>(std::ceil(fps)) : 0;
+}
+
+uint64_t cut_begin(const CutPoints& cuts, uint64_t first, int64_t overlap) {
+    return keyframe_at_or_before(cuts.keyframes, first > static_cast<uint64_t>(overlap) ? first - overlap : 0);
+}
+
+// The lens files as cut into dir, keeping the lens pattern in the names
+std::vector<std::string> cut_pieces(const std::vector<std::string>& input_paths, const std::string& dir) {
+    std::vector<std::string> pieces;
+    for (const auto& input : input_paths) {
+        pieces.push_back((std::filesystem::path(dir) / std::filesystem::path(input).filename()).string());
+    }
+    return pieces;
+}
+
+// Frames [begin, end) of every lens file stream copied into dir, as .insv pieces with their trailer
+bool cut_inputs(const std::vector<std::string>& input_paths, const std::string& dir, uint64_t begin, uint64_t end) {
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    const std::vector<std::string> pieces = cut_pieces(input_paths, dir);
+    for (size_t i = 0; i < input_paths.size(); ++i) {
+        if (!ffmpeg_copy_range(input_paths[i], pieces[i], begin, end - begin)) return false;
+    }
+    return true;
+}
+
+bool parse_frame_number(const std::string& text, uint64_t& value) {
+    if (text.empty() || text.find_first_not_of("0123456789") != std::string::npos) return false;
+    try {
+        value = std::stoull(text);
+    } catch (const std::exception&) {
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+std::vector<FrameRange> load_frame_plan(const std::string& path) {
+    std::vector<FrameRange> ranges;
+    std::ifstream file(path);
+    if (!file) {
+        std::cout << "Failed to open the frame plan " << path << std::endl;
+        return ranges;
+    }
+
+    std::string line;
+    while (std::getline(file, line)) {
+        line = line.substr(0, line.find(','));
+        if (line.empty() || line[0] == '#') continue;
+
+        std::istringstream row(line);
+        std::string first, last;
+        std::getline(row, first, '-');
+        std::getline(row, last);
+
+        try {
+            FrameRange range;
+            range.begin = std::stoull(first);
+            range.end = (last.empty() ? range.begin : std::stoull(last)) + 1;
+            if (range.end > range.begin) ranges.push_back(range);
+        } catch (const std::exception&) {
+            // header or malformed row
+        }
+    }
+    return ranges;
+}
+
+std::vector<FrameRange> merge_frame_ranges(std::vector<FrameRange> ranges, uint64_t frames, uint64_t min_gap) {
+    std::sort(ranges.begin(), ranges.end(), [](const FrameRange& a, const FrameRange& b) { return a.begin < b.begin; });
+
+    std::vector<FrameRange> merged;
+    for (FrameRange range : ranges) {
+        range.end = std::min(range.end, frames);
+        if (range.begin >= range.end) continue;
+
+        if (!merged.empty() && range.begin <= merged.back().end + min_gap) {
+            merged.back().end = std::max(merged.back().end, range.end);
+        }
+        else {
+            merged.push_back(range);
+        }
+    }
+    return merged;
+}
+
+bool parse_frame_selection(const std::string& text, std::vector<FrameSpan>& spans, std::string& error) {
+    spans.clear();
+    if (text.empty()) return true;
+
+    // "20-50-30" from before spans existed: single frames
+    const bool legacy = text.find(':') == std::string::npos && text.find(',') == std::string::npos;
+    std::istringstream items(text);
+    std::string item;
+    while (std::getline(items, item, legacy ? '-' : ',')) {
+        item.erase(0, item.find_first_not_of(' '));
+        item.erase(item.find_last_not_of(' ') + 1);
+
+        std::vector<std::string> fields;
+        std::istringstream parts(item);
+        std::string part;
+        while (std::getline(parts, part, ':')) fields.push_back(part);
+        if (!item.empty() && item.back() == ':') fields.push_back("");
+
+        uint64_t first = 0;
+        uint64_t last = 0;
+        uint64_t step = 1;
+        const bool valid = (fields.size() >= 1 && fields.size() <= 3)
+            && parse_frame_number(fields[0], first)
+            && (fields.size() < 2 || parse_frame_number(fields[1], last))
+            && (fields.size() < 3 || parse_frame_number(fields[2], step));
+        if (!valid) {
+            error = "bad frame selection '" + item + "', expected <frame> or <begin>:<end>[:<step>]";
+            return false;
+        }
+        if (fields.size() == 1) last = first;
+        if (last < first || step == 0) {
+            error = "bad frame selection '" + item + "', the end is before the begin or the step is 0";
+            return false;
+        }
+
+        FrameSpan span;
+        span.begin = first;
+        span.end = last + 1;
+        span.step = step;
+        spans.push_back(span);
+    }
+    return true;
+}
+
+std::vector<FrameSpan> frame_plan_spans(const std::vector<FrameRange>& ranges) {
+    std::vector<FrameSpan> spans;
+    for (const auto& range : ranges) {
+        FrameSpan span;
+        span.begin = range.begin;
+        span.end = range.end;
+        spans.push_back(span);
+    }
+    return spans;
+}
+
+bool run_range_stitch(const std::vector<std::string>& input_paths, const std::vector<FrameRange>& ranges,
+                      const std::string& output_dir, const StitchOptions& options, const RangeStitchSettings& settings) {
+    auto start_time = std::chrono::steady_clock::now();
+
+    if (options.uses_recording_motion()) {
+        std::cout << "Flowstate and direction lock need the gyro on the recording's timeline, the ranges can't be cut out "
+                     "of the lens files. Export them with -image_sequence_dir instead" << std::endl;
+        return false;
+    }
+
+    CutPoints cuts;
+    if (!read_cut_points(input_paths, cuts)) return false;
+
+    const double fps = cuts.fps;
+    const uint64_t frames = cuts.frames;
+    const int64_t overlap = cut_overlap(options, settings, fps);
+
+    const std::vector<FrameRange> merged = merge_frame_ranges(ranges, frames, static_cast<uint64_t>(settings.merge_gap_seconds * fps));
+    if (merged.empty()) {
+        std::cout << "The frame plan has no frame inside the recording (" << frames << " frames)" << std::endl;
+        return false;
+    }
+
+    std::error_code ec;
+    const std::filesystem::path out_dir(output_dir);
+    const std::filesystem::path work_dir = out_dir / ".work";
+    std::filesystem::remove_all(out_dir, ec);
+    std::filesystem::create_directories(work_dir, ec);
+
+    std::vector<RangeJob> jobs(merged.size());
+    uint64_t planned_frames = 0;
+    uint64_t stitched_frames = 0;
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        RangeJob& job = jobs[i];
+        job.range = merged[i];
+        job.input_begin = cut_begin(cuts, job.range.begin, overlap);
+        job.dir = (work_dir / range_name(job.range)).string();
+        job.clip = (out_dir / (range_name(job.range) + ".mp4")).string();
+        planned_frames += job.range.end - job.range.begin;
+        stitched_frames += job.range.end - job.input_begin;
+    }
+
+    std::cout << "Stitching " << planned_frames << " of " << frames << " frames in " << jobs.size() << " ranges, "
+              << stitched_frames - planned_frames << " frames of pre-roll" << std::endl;
+
+    for (auto& job : jobs) {
+        if (!cut_inputs(input_paths, job.dir, job.input_begin, job.range.end)) {
+            std::filesystem::remove_all(work_dir, ec);
+            return false;
+        }
+    }
+
+    std::mutex output_mutex;
+    {
+        StitchExecutor executor(std::max(settings.max_jobs, 1), settings.max_hw_sessions);
+        std::vector<std::shared_ptr<StitchJob>> submitted;
+
+        for (size_t i = 0; i < jobs.size(); ++i) {
+            RangeJob& job = jobs[i];
+            const std::string name = out_dir.filename().string() + "#" + range_name(job.range);
+
+            StitchJobSpec spec;
+            spec.input_paths = cut_pieces(input_paths, job.dir);
+            spec.output_path = job.clip;
+            spec.options = options;
+            spec.options.image_sequence_dir.clear();
+            spec.options.export_frame_nums.clear();
+            spec.timeout_seconds = settings.timeout_seconds;
+
+            if (settings.telemetry) {
+                spec.on_start = [&, name, frames = job.range.end - job.input_begin] {
+                    settings.telemetry->begin_job(name, frames);
+                };
+                spec.on_progress = [&, name](int progress) { settings.telemetry->progress(name, progress); };
+            }
+            spec.on_finished = [&, i, name](StitchResult& result) {
+                if (settings.telemetry) {
+                    settings.telemetry->end_job(name, result);
+                }
+                std::lock_guard<std::mutex> lck(output_mutex);
+                std::cout << "range " << range_name(jobs[i].range) << " "
+                          << (result.ok ? "done" : "failed: " + result.error_info)
+                          << " in " << result.wall_seconds << " s" << std::endl;
+            };
+
+            submitted.push_back(executor.submit(std::move(spec)));
+        }
+
+        for (size_t i = 0; i < submitted.size(); ++i) {
+            jobs[i].result = submitted[i]->wait();
+        }
+    }
+
+    std::filesystem::remove_all(work_dir, ec);
+
+    bool ok = true;
+    {
+        std::ofstream index(out_dir / "ranges.tsv", std::ios::trunc);
+        for (const auto& job : jobs) {
+            if (!job.result.ok) {
+                ok = false;
+                continue;
+            }
+            index << std::filesystem::path(job.clip).filename().string() << '\t' << job.input_begin << '\t'
+                  << job.range.begin << '\t' << job.range.end << '\n';
+        }
+    }
+
+    const double wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "range stitch: " << wall_seconds << " s, " << stitched_frames << " frames stitched instead of "
+              << frames << " (" << 100.0 * stitched_frames / frames << "%)" << std::endl;
+    return ok;
+}
+
+bool run_range_export(const std::vector<std::string>& input_paths, const std::vector<FrameSpan>& spans,
+                      const StitchOptions& options, const RangeStitchSettings& settings) {
+    auto start_time = std::chrono::steady_clock::now();
+
+    CutPoints cuts;
+    if (!read_cut_points(input_paths, cuts)) return false;
+
+    const double fps = cuts.fps;
+    const uint64_t frames = cuts.frames;
+    const int64_t overlap = cut_overlap(options, settings, fps);
+    // A cut piece restarts the timeline the trailer's gyro is on
+    const bool cut = !options.uses_recording_motion();
+    const uint64_t min_gap = static_cast<uint64_t>(settings.merge_gap_seconds * fps);
+
+    // Clamped to the recording, sorted, and grouped while the next span starts close to the group
+    std::vector<FrameSpan> sorted;
+    for (FrameSpan span : spans) {
+        span.end = std::min(span.end, frames);
+        if (span.count() > 0) sorted.push_back(span);
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const FrameSpan& a, const FrameSpan& b) { return a.begin < b.begin; });
+    if (sorted.empty()) {
+        std::cout << "The frame selection has no frame inside the recording (" << frames << " frames)" << std::endl;
+        return false;
+    }
+
+    std::vector<ExportJob> jobs;
+    for (const auto& span : sorted) {
+        if (!jobs.empty() && span.begin <= jobs.back().last + min_gap) {
+            jobs.back().spans.push_back(span);
+            jobs.back().last = std::max(jobs.back().last, span.last());
+            continue;
+        }
+        ExportJob job;
+        job.spans.push_back(span);
+        job.first = span.begin;
+        job.last = span.last();
+        jobs.push_back(std::move(job));
+    }
+
+    std::error_code ec;
+    const std::filesystem::path out_dir(options.image_sequence_dir);
+    const std::filesystem::path work_dir = out_dir / ".export";
+    std::filesystem::remove_all(work_dir, ec);
+    std::filesystem::create_directories(work_dir, ec);
+
+    uint64_t exported_frames = 0;
+    uint64_t decoded_frames = 0;
+    for (auto& job : jobs) {
+        const std::filesystem::path job_dir = work_dir / (std::to_string(job.first) + "-" + std::to_string(job.last));
+        job.input_begin = cut ? cut_begin(cuts, job.first, overlap) : 0;
+        job.dir = (job_dir / "lens").string();
+        job.frames_dir = (job_dir / "frames").string();
+        std::filesystem::create_directories(job.frames_dir, ec);
+        decoded_frames += job.last + 1 - job.input_begin;
+
+        // Only the frames of one job are ever listed, the SDK wants them one by one
+        for (const auto& span : job.spans) {
+            for (uint64_t frame = span.begin; frame < span.end; frame += span.step) {
+                job.frames.push_back(frame);
+            }
+        }
+        std::sort(job.frames.begin(), job.frames.end());
+        job.frames.erase(std::unique(job.frames.begin(), job.frames.end()), job.frames.end());
+        exported_frames += job.frames.size();
+    }
+
+    std::cout << "Exporting " << exported_frames << " of " << frames << " frames in " << jobs.size() << " jobs, "
+              << decoded_frames << " frames decoded" << std::endl;
+    if (!cut) {
+        std::cout << "Flowstate and direction lock need the gyro on the recording's timeline, every job reads the "
+                     "whole lens files" << std::endl;
+    }
+
+    for (auto& job : jobs) {
+        if (cut && !cut_inputs(input_paths, job.dir, job.input_begin, job.last + 1)) {
+            std::filesystem::remove_all(work_dir, ec);
+            return false;
+        }
+    }
+
+    const char* extension = options.image_type == ImageType::PNG ? ".png" : ".jpg";
+    std::mutex output_mutex;
+    {
+        StitchExecutor executor(std::max(settings.max_jobs, 1), settings.max_hw_sessions);
+        std::vector<std::shared_ptr<StitchJob>> submitted;
+
+        for (size_t i = 0; i < jobs.size(); ++i) {
+            ExportJob& job = jobs[i];
+            const std::string name = out_dir.filename().string() + "#" + std::to_string(job.first) + "-" + std::to_string(job.last);
+
+            // SetExportFrameSequence picks the frames, numbered from the first frame of the pieces
+            StitchJobSpec spec;
+            spec.input_paths = cut ? cut_pieces(input_paths, job.dir) : input_paths;
+            spec.output_path = (std::filesystem::path(job.frames_dir) / "unused.mp4").string();
+            spec.options = options;
+            spec.options.image_sequence_dir = job.frames_dir;
+            spec.options.export_frame_nums.clear();
+            for (uint64_t frame : job.frames) {
+                spec.options.export_frame_nums.push_back(frame - job.input_begin);
+            }
+            spec.timeout_seconds = settings.timeout_seconds;
+
+            if (settings.telemetry) {
+                spec.on_start = [&, name, frames = job.frames.size()] {
+                    settings.telemetry->begin_job(name, frames);
+                };
+                spec.on_progress = [&, name](int progress) { settings.telemetry->progress(name, progress); };
+            }
+            spec.on_finished = [&, i, name](StitchResult& result) {
+                // Next to the frames of the other jobs, renamed to their number in the recording
+                ExportJob& done = jobs[i];
+                if (result.ok) {
+                    for (uint64_t frame : done.frames) {
+                        const std::string file = std::to_string(frame - done.input_begin) + extension;
+                        std::error_code move_ec;
+                        std::filesystem::rename(std::filesystem::path(done.frames_dir) / file,
+                                                out_dir / (std::to_string(frame) + extension), move_ec);
+                        if (move_ec) {
+                            result.ok = false;
+                            result.error_info = "frame " + std::to_string(frame) + " missing: " + move_ec.message();
+                            break;
+                        }
+                    }
+                }
+                if (settings.telemetry) {
+                    settings.telemetry->end_job(name, result);
+                }
+
+                std::lock_guard<std::mutex> lck(output_mutex);
+                std::cout << "frames " << done.first << "-" << done.last << " "
+                          << (result.ok ? "done" : "failed: " + result.error_info)
+                          << " in " << result.wall_seconds << " s" << std::endl;
+            };
+
+            submitted.push_back(executor.submit(std::move(spec)));
+        }
+
+        for (size_t i = 0; i < submitted.size(); ++i) {
+            jobs[i].result = submitted[i]->wait();
+        }
+    }
+
+    std::filesystem::remove_all(work_dir, ec);
+
+    bool ok = true;
+    for (const auto& job : jobs) {
+        ok = ok && job.result.ok;
+    }
+
+    const double wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "range export: " << wall_seconds << " s, " << exported_frames << " of " << frames << " frames ("
+              << 100.0 * exported_frames / frames << "%), " << decoded_frames << " decoded" << std::endl;
+    return ok;
+}
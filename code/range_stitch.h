@@ -0,0 +1,69 @@
+#pragma once
+
+#include "stitch_options.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class StitchTelemetry;
+
+struct FrameRange {
+    uint64_t begin = 0; // first frame
+    uint64_t end = 0;   // one past the last one
+};
+
+// Reads the frames the camera path planner asked for: one "begin-end" range (both ends included)
+// or a single frame number per line. Anything after a ',' and lines starting with '#' are ignored
+std::vector<FrameRange> load_frame_plan(const std::string& path);
+
+// Sorted, clamped to [0, frames) and with ranges closer than min_gap frames merged into one
+std::vector<FrameRange> merge_frame_ranges(std::vector<FrameRange> ranges, uint64_t frames, uint64_t min_gap);
+
+// Frames begin, begin + step, ... below end. Selections are kept as spans, never expanded for the
+// whole recording
+struct FrameSpan {
+    uint64_t begin = 0;
+    uint64_t end = 0; // one past the last candidate
+    uint64_t step = 1;
+
+    uint64_t count() const { return end > begin ? (end - begin + step - 1) / step : 0; }
+    uint64_t last() const { return begin + (count() - 1) * step; }
+};
+
+// Parses an export selection such as "100:900:5,2000:2300": comma separated single frames or
+// begin:end[:step] spans, with end included like the frame plan. The old single frame list joined
+// with '-' ("20-50-30") is still accepted. Returns false and the reason on a malformed selection
+bool parse_frame_selection(const std::string& text, std::vector<FrameSpan>& spans, std::string& error);
+
+// The ranges of a frame plan as step 1 spans
+std::vector<FrameSpan> frame_plan_spans(const std::vector<FrameRange>& ranges);
+
+struct RangeStitchSettings {
+    int max_jobs = 2;              // ranges stitched at the same time
+    int max_hw_sessions = 1;       // ranges holding a hardware codec at the same time
+    int64_t overlap_frames = -1;   // pre-roll stitched before every range, < 0 -> automatic
+    double merge_gap_seconds = 2.0; // ranges closer than this are stitched as one, a cut costs a pre-roll
+    double timeout_seconds = 0.0;  // a range stitching for longer is cancelled, 0 -> no limit
+    StitchTelemetry* telemetry = nullptr; // records every range as its own job when set
+};
+
+// Second pass of the proxy workflow: stitches only the planned frame ranges at full quality.
+//
+// Both lens files are cut by stream copy from the common keyframe before every range (minus the
+// overlap the temporal filters need) to its end, and the pieces are stitched in parallel into
+// output_dir/<begin>-<end>.mp4. The clips keep their pre-roll, output_dir/ranges.tsv maps them back:
+// "clip \t first frame of the clip \t begin \t end", all in frames of the recording.
+// Refused with flowstate or direction lock, a cut piece doesn't line up with its gyro
+bool run_range_stitch(const std::vector<std::string>& input_paths, const std::vector<FrameRange>& ranges,
+                      const std::string& output_dir, const StitchOptions& options, const RangeStitchSettings& settings);
+
+// Image sequence export of a sparse selection: spans closer than merge_gap_seconds are grouped, and
+// every group is cut out of the lens files like a range (from the common keyframe before it, minus the
+// overlap) and exported as its own stitch job, in parallel, with only its selected frames in
+// SetExportFrameSequence. The frames of every job are renamed to their number in the recording and
+// moved into options.image_sequence_dir, so the result looks like one export of the whole selection.
+// A job decodes its group from the keyframe on, whatever the step. With flowstate or direction lock
+// nothing is cut and every job reads the whole lens files
+bool run_range_export(const std::vector<std::string>& input_paths, const std::vector<FrameSpan>& spans,
+                      const StitchOptions& options, const RangeStitchSettings& settings);
@@ -0,0 +1,202 @@
+#include "recording_catalog.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+
+namespace {
+
+const char* INDEX_HEADER = "recording-catalog 1";
+
+bool all_digits(const std::string& text) {
+    return !text.empty() && std::all_of(text.begin(), text.end(), [](char c) { return c >= '0' && c <= '9'; });
+}
+
+int64_t dir_mtime(const std::string& dir, std::error_code& ec) {
+    const auto time = std::filesystem::last_write_time(dir, ec);
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+std::string file_name(const std::string& path) {
+    return std::filesystem::path(path).filename().string();
+}
+
+} // namespace
+
+bool parse_recording_file_name(const std::string& filename, RecordingFileName& result) {
+    const std::string extension = ".insv";
+    if (filename.size() <= extension.size() || filename.compare(filename.size() - extension.size(), extension.size(), extension) != 0) {
+        return false;
+    }
+
+    std::vector<std::string> tokens;
+    std::istringstream stem(filename.substr(0, filename.size() - extension.size()));
+    std::string token;
+    while (std::getline(stem, token, '_')) {
+        tokens.push_back(token);
+    }
+
+    if (tokens.size() != 5 || tokens[0] != "VID" || !all_digits(tokens[1]) || !all_digits(tokens[2]) ||
+        (tokens[3] != "00" && tokens[3] != "10") || !all_digits(tokens[4])) {
+        return false;
+    }
+
+    result.date = tokens[1];
+    result.id = tokens[2];
+    result.lens = tokens[3];
+    result.number = std::atoi(tokens[4].c_str());
+    return true;
+}
+
+bool Recording::complete() const {
+    return !segments.empty() && std::all_of(segments.begin(), segments.end(), [](const RecordingSegment& s) { return s.complete(); });
+}
+
+RecordingCatalog::RecordingCatalog(std::string dir) : dir_(std::move(dir)) {}
+
+std::string RecordingCatalog::index_path() const {
+    std::filesystem::path dir = std::filesystem::path(dir_).lexically_normal();
+    if (dir.filename().empty()) dir = dir.parent_path();
+    std::filesystem::path index = dir.parent_path() / dir.filename();
+    index += ".catalog";
+    return index.string();
+}
+
+bool RecordingCatalog::open() {
+    std::error_code ec;
+    if (!std::filesystem::is_directory(dir_, ec)) {
+        std::cout << "Directory does not exist: " << dir_ << std::endl;
+        return false;
+    }
+
+    const int64_t mtime = dir_mtime(dir_, ec);
+    if (!ec && load_index(mtime)) {
+        loaded_from_index_ = true;
+        return true;
+    }
+
+    loaded_from_index_ = false;
+    if (!scan()) return false;
+    if (!ec) {
+        save_index(mtime);
+    }
+    return true;
+}
+
+bool RecordingCatalog::scan() {
+    // (date, id) -> segment number -> segment. The maps keep everything in order
+    std::map<std::pair<std::string, std::string>, std::map<int, RecordingSegment>> found;
+
+    try {
+        for (const auto& entry : std::filesystem::directory_iterator(dir_)) {
+            RecordingFileName name;
+            if (!parse_recording_file_name(entry.path().filename().string(), name)) continue;
+            if (!entry.is_regular_file()) continue;
+
+            RecordingSegment& segment = found[{ name.date, name.id }][name.number];
+            segment.number = name.number;
+            (name.lens == "00" ? segment.lens00 : segment.lens10) = entry.path().string();
+        }
+    } catch (const std::filesystem::filesystem_error& ex) {
+        std::cout << "Filesystem error: " << ex.what() << std::endl;
+        return false;
+    }
+
+    recordings_.clear();
+    for (auto& [key, segments] : found) {
+        Recording recording;
+        recording.date = key.first;
+        recording.id = key.second;
+        for (auto& entry : segments) {
+            recording.segments.push_back(std::move(entry.second));
+        }
+        recordings_.push_back(std::move(recording));
+    }
+    return true;
+}
+
+// date \t id \t number \t lens00 file \t lens10 file, one line per segment. File names only, the
+// directory is added back on load so the index survives moving the whole dump
+bool RecordingCatalog::load_index(int64_t mtime) {
+    std::ifstream file(index_path());
+    std::string line;
+    if (!std::getline(file, line)) return false;
+
+    std::istringstream header(line);
+    std::string magic;
+    int64_t saved_mtime = 0;
+    if (!std::getline(header, magic, '\t') || magic != INDEX_HEADER || !(header >> saved_mtime) || saved_mtime != mtime) {
+        return false;
+    }
+
+    std::vector<Recording> recordings;
+    while (std::getline(file, line)) {
+        std::istringstream row(line);
+        std::string date, id, number, lens00, lens10;
+        if (!std::getline(row, date, '\t') || !std::getline(row, id, '\t') || !std::getline(row, number, '\t') ||
+            !std::getline(row, lens00, '\t')) return false;
+        std::getline(row, lens10);
+
+        if (recordings.empty() || recordings.back().date != date || recordings.back().id != id) {
+            Recording recording;
+            recording.date = date;
+            recording.id = id;
+            recordings.push_back(recording);
+        }
+
+        RecordingSegment segment;
+        segment.number = std::atoi(number.c_str());
+        if (!lens00.empty()) segment.lens00 = (std::filesystem::path(dir_) / lens00).string();
+        if (!lens10.empty()) segment.lens10 = (std::filesystem::path(dir_) / lens10).string();
+        recordings.back().segments.push_back(segment);
+    }
+
+    recordings_ = std::move(recordings);
+    return true;
+}
+
+void RecordingCatalog::save_index(int64_t mtime) const {
+    const std::string path = index_path();
+    const std::string temp_path = path + ".tmp";
+    {
+        std::ofstream file(temp_path, std::ios::trunc);
+        file << INDEX_HEADER << '\t' << mtime << '\n';
+        for (const auto& recording : recordings_) {
+            for (const auto& segment : recording.segments) {
+                file << recording.date << '\t' << recording.id << '\t' << segment.number << '\t'
+                     << (segment.lens00.empty() ? "" : file_name(segment.lens00)) << '\t'
+                     << (segment.lens10.empty() ? "" : file_name(segment.lens10)) << '\n';
+            }
+        }
+        if (!file) return;
+    }
+
+    // Not being able to save only costs a rescan next time
+    std::error_code ec;
+    std::filesystem::rename(temp_path, path, ec);
+}
+
+std::vector<Recording> RecordingCatalog::on_date(const std::string& date) const {
+    std::vector<Recording> result;
+    for (const auto& recording : recordings_) {
+        if (recording.date == date) result.push_back(recording);
+    }
+    return result;
+}
+
+const Recording* RecordingCatalog::find(const std::string& key) const {
+    const std::string name = file_name(key);
+    RecordingFileName parsed;
+    const bool is_file = parse_recording_file_name(name, parsed);
+
+    for (const auto& recording : recordings_) {
+        if (recording.name() == name || recording.id == name) return &recording;
+        if (is_file && recording.date == parsed.date && recording.id == parsed.id) return &recording;
+    }
+    return nullptr;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Parts of a "VID_{date}_{id}_{lens}_{num}.insv" file name
+struct RecordingFileName {
+    std::string date;
+    std::string id;
+    std::string lens; // "00" or "10"
+    int number = 0;   // file segment of a long recording, counting from 1
+};
+
+// false for anything that isn't an insta360 lens file
+bool parse_recording_file_name(const std::string& filename, RecordingFileName& result);
+
+// One file of a long recording: the _00_ and _10_ lens files with the same segment number
+struct RecordingSegment {
+    int number = 0;
+    std::string lens00; // full paths, empty when that lens file is missing
+    std::string lens10;
+
+    bool complete() const { return !lens00.empty() && !lens10.empty(); }
+};
+
+// Everything the camera wrote for one recording. Long recordings are split by the camera in
+// several segments, ordered by number
+struct Recording {
+    std::string date;
+    std::string id;
+    std::vector<RecordingSegment> segments;
+
+    std::string name() const { return "VID_" + date + "_" + id; }
+    bool complete() const;
+};
+
+// Index of the recordings of a card dump directory. The file names are parsed once and the
+// result is saved next to the directory (<dir>.catalog); as long as the directory mtime doesn't
+// change, opening the catalog again only reads that file instead of listing the directory
+class RecordingCatalog {
+public:
+    explicit RecordingCatalog(std::string dir);
+
+    // Loads the saved index or rescans the directory if it changed. false if the directory can't be read
+    bool open();
+
+    const std::vector<Recording>& recordings() const { return recordings_; }
+    bool loaded_from_index() const { return loaded_from_index_; }
+
+    // Recordings of one date (YYYYMMDD), in order
+    std::vector<Recording> on_date(const std::string& date) const;
+
+    // By name (VID_{date}_{id}), by id, or by the name of any of its lens files. nullptr if unknown
+    const Recording* find(const std::string& key) const;
+
+private:
+    bool scan();
+    bool load_index(int64_t dir_mtime);
+    void save_index(int64_t dir_mtime) const;
+    std::string index_path() const;
+
+    std::string dir_;
+    std::vector<Recording> recordings_;
+    bool loaded_from_index_ = false;
+};
@@ -0,0 +1,290 @@
+#include "segment_stitch.h"
+#include "activity_index.h"
+#include "ffmpeg.h"
+#include "mp4_info.h"
+#include "stitch_job.h"
+#include "stitch_runner.h"
+#include "stitch_telemetry.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+
+#include <opencv2/videoio.hpp>
+
+namespace {
+
+// How far past its own range a segment is stitched, enough to reach the next keyframe of the encoder
+const double TAIL_SECONDS = 2.0;
+
+// Mean absolute difference per byte above which a segment doesn't match the single job, well above
+// what two encodes of the same frames differ by
+const double MATCH_THRESHOLD = 3.0;
+
+struct Segment {
+    uint64_t begin = 0;       // first frame this segment contributes to the output
+    uint64_t end = 0;         // one past the last one
+    uint64_t input_begin = 0; // first stitched frame, a keyframe of both lenses at or before begin - overlap
+    uint64_t input_end = 0;   // one past the last stitched frame
+    std::string dir;
+    std::string output;
+    StitchResult result;
+    std::vector<uint64_t> output_keyframes; // global frame numbers
+};
+
+// Mean absolute difference per byte of frames [begin, end) of the recording in two stitched clips,
+// each starting at the given frame of the recording. < 0 when they can't be read
+double clip_difference(const std::string& a, uint64_t a_first, const std::string& b, uint64_t b_first, uint64_t begin, uint64_t end) {
+    cv::VideoCapture clips[2];
+    const uint64_t firsts[2] = { a_first, b_first };
+    if (!clips[0].open(a) || !clips[1].open(b)) return -1.0;
+
+    // Decoded in order up to begin, seeking isn't frame exact with every backend
+    for (int i = 0; i < 2; ++i) {
+        for (uint64_t frame = firsts[i]; frame < begin; ++frame) {
+            if (!clips[i].grab()) return -1.0;
+        }
+    }
+
+    double sum = 0.0;
+    uint64_t compared = 0;
+    cv::Mat frames[2];
+    for (uint64_t frame = begin; frame < end; ++frame) {
+        if (!clips[0].read(frames[0]) || !clips[1].read(frames[1])) break;
+        ImageView views[2];
+        for (int i = 0; i < 2; ++i) {
+            views[i].data = frames[i].data;
+            views[i].width = frames[i].cols;
+            views[i].height = frames[i].rows;
+            views[i].stride = frames[i].step[0];
+        }
+        sum += frame_difference(views[0], views[1]);
+        ++compared;
+    }
+    return compared > 0 ? sum / compared : -1.0;
+}
+
+} // namespace
+
+bool run_segmented_stitch(const std::vector<std::string>& input_paths, const std::string& output_path,
+                          const StitchOptions& options, const SegmentSettings& settings) {
+    auto start_time = std::chrono::steady_clock::now();
+
+    const Mp4Info lens0 = read_mp4_info(input_paths[0]);
+    const Mp4Info lens1 = read_mp4_info(input_paths[1]);
+    if (!lens0.valid || !lens1.valid || lens0.fps <= 0.0) {
+        std::cout << "Failed to read the frame count of the inputs, can't split them in segments" << std::endl;
+        return false;
+    }
+
+    const double fps = lens0.fps;
+    const uint64_t frames = std::min(lens0.frame_count, lens1.frame_count);
+    const std::vector<uint64_t> keyframes = common_keyframes(lens0, lens1, frames);
+    if (keyframes.empty()) {
+        std::cout << "The lens files have no keyframe in common, can't split them in segments" << std::endl;
+        return false;
+    }
+
+    if (options.uses_recording_motion() && !settings.measure_baseline) {
+        std::cout << "Flowstate and direction lock need the gyro on the recording's timeline, stitching as one job" << std::endl;
+        const StitchResult single = run_stitch(input_paths, output_path, options);
+        if (!single.ok) {
+            std::cout << "error: " << single.error_info << std::endl;
+        }
+        return single.ok;
+    }
+
+    // Temporal filters need a pre-roll, plain stitching doesn't
+    int64_t overlap = settings.overlap_frames;
+    if (overlap < 0) {
+        overlap = (options.enable_flowstate || options.enable_deflicker || options.enable_directionlock)
+            ? static_cast<int64_t>(std::ceil(fps)) : 0;
+    }
+    const uint64_t tail = static_cast<uint64_t>(std::ceil(TAIL_SECONDS * fps));
+
+    // Cut at the keyframe closest to every 1/N of the recording
+    std::vector<uint64_t> cuts = { 0 };
+    for (int i = 1; i < settings.segments; ++i) {
+        const uint64_t cut = keyframe_at_or_before(keyframes, frames * i / settings.segments);
+        if (cut > cuts.back()) cuts.push_back(cut);
+    }
+    cuts.push_back(frames);
+
+    const std::filesystem::path output(output_path);
+    const std::filesystem::path work_dir = output.parent_path() / ("." + output.stem().string() + ".segments");
+    std::error_code ec;
+    std::filesystem::remove_all(work_dir, ec);
+
+    std::vector<Segment> segments(cuts.size() - 1);
+    for (size_t i = 0; i < segments.size(); ++i) {
+        Segment& segment = segments[i];
+        segment.begin = cuts[i];
+        segment.end = cuts[i + 1];
+        segment.input_begin = i == 0 ? 0 : keyframe_at_or_before(keyframes, segment.begin > static_cast<uint64_t>(overlap) ? segment.begin - overlap : 0);
+        segment.input_end = i + 1 == segments.size() ? frames : std::min(frames, segment.end + tail);
+        segment.dir = (work_dir / ("segment_" + std::to_string(i))).string();
+        segment.output = (std::filesystem::path(segment.dir) / "stitched.mp4").string();
+    }
+
+    std::cout << "Stitching " << frames << " frames in " << segments.size() << " segments, "
+              << overlap << " frames of overlap" << std::endl;
+
+    // Split both lens files by stream copy, keeping the lens pattern in the names. Every piece gets the
+    // Insta360 trailer of its lens file back
+    for (auto& segment : segments) {
+        std::filesystem::create_directories(segment.dir, ec);
+        for (const auto& input : input_paths) {
+            const std::string piece = (std::filesystem::path(segment.dir) / std::filesystem::path(input).filename()).string();
+            if (!ffmpeg_copy_range(input, piece, segment.input_begin, segment.input_end - segment.input_begin)) {
+                std::filesystem::remove_all(work_dir, ec);
+                return false;
+            }
+        }
+    }
+
+    const int jobs = settings.max_jobs > 0 ? settings.max_jobs : static_cast<int>(segments.size());
+    std::mutex output_mutex;
+    {
+        StitchExecutor executor(jobs, settings.max_hw_sessions);
+        std::vector<std::shared_ptr<StitchJob>> submitted;
+
+        for (size_t i = 0; i < segments.size(); ++i) {
+            Segment& segment = segments[i];
+            const std::string name = output.filename().string() + "#" + std::to_string(i);
+
+            StitchJobSpec spec;
+            for (const auto& input : input_paths) {
+                spec.input_paths.push_back((std::filesystem::path(segment.dir) / std::filesystem::path(input).filename()).string());
+            }
+            spec.output_path = segment.output;
+            spec.options = options;
+            spec.timeout_seconds = settings.timeout_seconds;
+
+            if (settings.telemetry) {
+                spec.on_start = [&, name, frames = segment.input_end - segment.input_begin] {
+                    settings.telemetry->begin_job(name, frames);
+                };
+                spec.on_progress = [&, name](int progress) { settings.telemetry->progress(name, progress); };
+            }
+            spec.on_finished = [&, i, name](StitchResult& result) {
+                if (settings.telemetry) {
+                    settings.telemetry->end_job(name, result);
+                }
+                std::lock_guard<std::mutex> lck(output_mutex);
+                std::cout << "segment " << i << " [" << segments[i].begin << ", " << segments[i].end << ") "
+                          << (result.ok ? "done" : "failed: " + result.error_info)
+                          << " in " << result.wall_seconds << " s" << std::endl;
+            };
+
+            submitted.push_back(executor.submit(std::move(spec)));
+        }
+
+        for (size_t i = 0; i < submitted.size(); ++i) {
+            segments[i].result = submitted[i]->wait();
+        }
+    }
+
+    for (auto& segment : segments) {
+        if (!segment.result.ok) {
+            std::filesystem::remove_all(work_dir, ec);
+            return false;
+        }
+
+        const Mp4Info stitched = read_mp4_info(segment.output);
+        if (stitched.keyframes.empty()) {
+            for (uint64_t f = segment.input_begin; f < segment.input_end; ++f) segment.output_keyframes.push_back(f);
+        }
+        for (uint64_t local : stitched.keyframes) {
+            segment.output_keyframes.push_back(segment.input_begin + local);
+        }
+    }
+
+    // Join points: the first output keyframe of the next segment once its overlap is over. If the
+    // previous segment doesn't reach that far take the last keyframe it does reach (shorter warm up)
+    std::vector<uint64_t> joins(segments.size(), 0);
+    for (size_t i = 1; i < segments.size(); ++i) {
+        const auto& kf = segments[i].output_keyframes;
+        auto it = std::lower_bound(kf.begin(), kf.end(), segments[i].begin);
+        uint64_t join = it != kf.end() ? *it : segments[i].input_end;
+
+        if (join >= segments[i - 1].input_end) {
+            join = keyframe_at_or_before(kf, segments[i - 1].input_end - 1);
+            std::cout << "segment " << i << ": no encoder keyframe after the overlap, joining at frame " << join
+                      << " with " << (join > segments[i].input_begin ? join - segments[i].input_begin : 0) << " frames of warm up" << std::endl;
+        }
+        if (join < joins[i - 1] || join < segments[i].input_begin) {
+            std::cout << "segment " << i << " can't be joined without re-encoding, increase the overlap" << std::endl;
+            std::filesystem::remove_all(work_dir, ec);
+            return false;
+        }
+        joins[i] = join;
+    }
+
+    std::vector<ConcatPart> parts;
+    for (size_t i = 0; i < segments.size(); ++i) {
+        ConcatPart part;
+        part.path = segments[i].output;
+        if (i > 0) part.inpoint = (joins[i] - segments[i].input_begin) / fps;
+        if (i + 1 < segments.size()) part.outpoint = (joins[i + 1] - segments[i].input_begin) / fps;
+        parts.push_back(part);
+    }
+
+    const std::string joined = (work_dir / "joined.mp4").string();
+    if (!ffmpeg_concat(parts, joined)) {
+        std::filesystem::remove_all(work_dir, ec);
+        return false;
+    }
+    std::filesystem::rename(joined, output_path, ec);
+    if (ec) {
+        std::cout << "Failed to move the joined output to " << output_path << ": " << ec.message() << std::endl;
+        std::filesystem::remove_all(work_dir, ec);
+        return false;
+    }
+
+    const double wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    double serial_seconds = 0.0;
+    uint64_t stitched_frames = 0;
+    for (const auto& segment : segments) {
+        serial_seconds += segment.result.wall_seconds;
+        stitched_frames += segment.input_end - segment.input_begin;
+    }
+
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "segmented stitch: " << wall_seconds << " s, " << frames / wall_seconds << " fps, "
+              << stitched_frames - frames << " overlap frames stitched twice" << std::endl;
+    std::cout << "sum of segment jobs: " << serial_seconds << " s (estimated speedup " << serial_seconds / wall_seconds << "x)" << std::endl;
+
+    if (settings.measure_baseline) {
+        const std::string baseline = (work_dir / "baseline.mp4").string();
+        StitchResult single = run_stitch(input_paths, baseline, options);
+        if (single.ok) {
+            std::cout << "single job: " << single.wall_seconds << " s, " << single.fps() << " fps (speedup "
+                      << single.wall_seconds / wall_seconds << "x)" << std::endl;
+
+            // Every segment against the single job on its own frames, pre-roll excluded
+            bool matches = true;
+            for (size_t i = 0; i < segments.size(); ++i) {
+                const double difference = clip_difference(segments[i].output, segments[i].input_begin, baseline, 0,
+                                                          segments[i].begin, std::min(segments[i].end, segments[i].input_end));
+                const bool match = difference >= 0.0 && difference <= MATCH_THRESHOLD;
+                matches = matches && match;
+                std::cout << "segment " << i << " vs single job: " << (difference >= 0.0 ? std::to_string(difference) : "unreadable")
+                          << " mean difference per byte" << (match ? "" : ", does NOT match") << std::endl;
+            }
+            if (!matches && options.uses_recording_motion()) {
+                std::cout << "The stabilised segments don't match the single job, keeping the single job output" << std::endl;
+                std::filesystem::rename(baseline, output_path, ec);
+            }
+        }
+        else {
+            std::cout << "single job baseline failed: " << single.error_info << std::endl;
+        }
+    }
+
+    std::filesystem::remove_all(work_dir, ec);
+    return true;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "stitch_options.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class StitchTelemetry;
+
+struct SegmentSettings {
+    int segments = 4;            // pieces the recording is split in
+    int max_jobs = 0;            // segments stitched at the same time, 0 -> all of them
+    int max_hw_sessions = 1;     // segments holding a hardware codec at the same time
+    int64_t overlap_frames = -1; // pre-roll stitched and thrown away before every segment, < 0 -> automatic
+    bool measure_baseline = false; // also run the whole recording as one job to report the real speedup and compare
+                                   // every segment with it
+    double timeout_seconds = 0.0;  // a segment stitching for longer is cancelled, 0 -> no limit
+    StitchTelemetry* telemetry = nullptr; // records every segment as its own job when set
+};
+
+// Splits one recording in keyframe aligned frame ranges, stitches them in parallel and joins the
+// encoded segments into output_path without re-encoding.
+//
+// Every segment but the first starts `overlap_frames` early so temporal filters (flowstate, deflicker)
+// are warmed up by the time its own range begins, and every segment but the last runs a bit past its
+// end. The join point is then moved to the first keyframe of the stitched output after the overlap,
+// which is what lets the concat be a plain stream copy.
+//
+// With flowstate or direction lock the segments would be stabilised with the gyro of the wrong part of
+// the recording (see ffmpeg_copy_range), so the recording is stitched as one job instead. With
+// measure_baseline the segments are stitched anyway and compared with the single job on the frames
+// they share: when a segment differs, the single job output is kept
+bool run_segmented_stitch(const std::vector<std::string>& input_paths, const std::string& output_path,
+                          const StitchOptions& options, const SegmentSettings& settings);
@@ -0,0 +1,31 @@
+#include "stitch_backend.h"
+
+#ifndef NO_INSTA360_SDK
+#include "ins_stitch_backend.h"
+#endif
+
+#include <mutex>
+
+namespace {
+
+std::mutex factory_mutex;
+StitchBackendFactory backend_factory;
+
+} // namespace
+
+std::unique_ptr<StitchBackend> make_stitch_backend() {
+    std::lock_guard<std::mutex> lck(factory_mutex);
+    if (backend_factory) {
+        return backend_factory();
+    }
+#ifndef NO_INSTA360_SDK
+    return std::make_unique<InsStitchBackend>();
+#else
+    return nullptr;
+#endif
+}
+
+void set_stitch_backend_factory(StitchBackendFactory factory) {
+    std::lock_guard<std::mutex> lck(factory_mutex);
+    backend_factory = std::move(factory);
+}
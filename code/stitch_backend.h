@@ -0,0 +1,32 @@
+#pragma once
+
+#include "stitch_options.h"
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// What run_stitch() needs from a stitcher. The real one wraps the SDK VideoStitcher, others
+// (fake_stitch_backend.h) let the orchestration run on machines without the SDK
+class StitchBackend {
+public:
+    using ProgressCallback = std::function<void(int progress)>;
+    using ErrorCallback = std::function<void(int error, const std::string& info)>;
+
+    virtual ~StitchBackend() = default;
+
+    // Starts the job and returns right away. Callbacks may come from any thread:
+    // on_progress up to 100 on success, on_error once on failure
+    virtual void start(const std::vector<std::string>& input_paths, const std::string& output_path,
+                       const StitchOptions& options, ProgressCallback on_progress, ErrorCallback on_error) = 0;
+
+    virtual void cancel() = 0;
+};
+
+using StitchBackendFactory = std::function<std::unique_ptr<StitchBackend>()>;
+
+// Backend used by run_stitch() and everything built on it. Defaults to the SDK (ins_stitch_backend.h)
+// unless the converter is built with NO_INSTA360_SDK, then a factory has to be set first
+std::unique_ptr<StitchBackend> make_stitch_backend();
+void set_stitch_backend_factory(StitchBackendFactory factory);
@@ -0,0 +1,302 @@
+#include "stitch_job.h"
+
+#include <algorithm>
+#include <filesystem>
+
+using namespace std::chrono;
+
+StitchJob::StitchJob(StitchJobSpec spec) : spec_(std::move(spec)), future_(promise_.get_future().share()) {}
+
+std::shared_ptr<StitchJob> StitchJob::completed(StitchJobSpec spec, StitchResult result) {
+    std::shared_ptr<StitchJob> job(new StitchJob(std::move(spec)));
+    job->progress_ = result.ok ? 100 : 0;
+    job->completed_ = true;
+    job->result_ = result;
+    job->promise_.set_value(result);
+    return job;
+}
+
+bool StitchJob::done() const {
+    return future_.wait_for(seconds(0)) == std::future_status::ready;
+}
+
+bool StitchJob::wait_for(double seconds) const {
+    return future_.wait_for(duration<double>(seconds)) == std::future_status::ready;
+}
+
+void StitchJob::cancel() {
+    std::lock_guard<std::mutex> lck(mutex_);
+    if (completed_) return;
+    cancel_requested_ = true;
+    if (executor_) {
+        executor_->wake();
+    }
+}
+
+void StitchJob::on_progress(int progress) {
+    {
+        std::lock_guard<std::mutex> lck(mutex_);
+        if (completed_ || progress_ == progress) return;
+        progress_ = progress;
+    }
+
+    // The hook runs before the job can complete, so a 100% line is printed before the result
+    if (spec_.on_progress) {
+        spec_.on_progress(progress);
+    }
+
+    if (progress == 100) {
+        std::lock_guard<std::mutex> lck(mutex_);
+        if (completed_) return;
+        finished_ = true;
+        if (executor_) {
+            executor_->wake();
+        }
+    }
+}
+
+void StitchJob::on_error(int error, const std::string& info) {
+    std::lock_guard<std::mutex> lck(mutex_);
+    if (completed_ || failed_) return;
+    failed_ = true;
+    result_.error = error;
+    result_.error_info = info;
+    if (executor_) {
+        executor_->wake();
+    }
+}
+
+StitchExecutor::StitchExecutor(int max_jobs, int max_hw_sessions)
+    : max_jobs_(std::max(1, max_jobs)), max_hw_sessions_(std::max(1, max_hw_sessions)) {
+    supervisor_ = std::thread([this] { supervise(); });
+}
+
+StitchExecutor::~StitchExecutor() {
+    {
+        std::lock_guard<std::mutex> lck(mutex_);
+        stopping_ = true;
+        dirty_ = true;
+    }
+    wake_cond_.notify_one();
+    supervisor_.join();
+}
+
+std::shared_ptr<StitchJob> StitchExecutor::submit(StitchJobSpec spec) {
+    std::shared_ptr<StitchJob> job(new StitchJob(std::move(spec)));
+    {
+        std::lock_guard<std::mutex> job_lck(job->mutex_);
+        job->executor_ = this;
+    }
+    {
+        std::lock_guard<std::mutex> lck(mutex_);
+        queued_.push_back(job);
+        dirty_ = true;
+    }
+    wake_cond_.notify_one();
+    return job;
+}
+
+void StitchExecutor::wait_all() {
+    std::unique_lock<std::mutex> lck(mutex_);
+    idle_cond_.wait(lck, [&] { return queued_.empty() && running_.empty(); });
+}
+
+// Lock order is job -> executor: the callbacks and cancel() wake the executor with the job mutex held,
+// so the supervisor never takes a job mutex while holding its own
+void StitchExecutor::wake() {
+    {
+        std::lock_guard<std::mutex> lck(mutex_);
+        dirty_ = true;
+    }
+    wake_cond_.notify_one();
+}
+
+void StitchExecutor::start_job(const std::shared_ptr<StitchJob>& job) {
+    const StitchJobSpec& spec = job->spec_;
+    const auto now = steady_clock::now();
+    {
+        std::lock_guard<std::mutex> lck(job->mutex_);
+        job->start_time_ = now;
+        job->stop_time_ = spec.deadline;
+        if (spec.timeout_seconds > 0.0) {
+            job->stop_time_ = std::min(job->stop_time_, now + duration_cast<steady_clock::duration>(duration<double>(spec.timeout_seconds)));
+        }
+        job->result_.frames = stitch_frame_count(spec.input_paths, spec.options);
+    }
+
+    if (spec.on_start) {
+        spec.on_start();
+    }
+
+    // The SDK doesn't create the output directory by itself
+    std::error_code ec;
+    const std::filesystem::path output_dir = spec.options.image_sequence_dir.empty()
+        ? std::filesystem::path(spec.output_path).parent_path()
+        : std::filesystem::path(spec.options.image_sequence_dir);
+    if (!output_dir.empty()) {
+        std::filesystem::create_directories(output_dir, ec);
+    }
+
+    std::unique_ptr<StitchBackend> backend = make_stitch_backend();
+    if (!backend) {
+        job->on_error(0, "no stitch backend available");
+        return;
+    }
+
+    // The backend is owned by the job, its callbacks only hold a weak reference back
+    std::weak_ptr<StitchJob> weak_job = job;
+    StitchBackend* raw_backend = backend.get();
+    {
+        std::lock_guard<std::mutex> lck(job->mutex_);
+        job->backend_ = std::move(backend);
+    }
+
+    raw_backend->start(spec.input_paths, spec.output_path, spec.options,
+        [weak_job](int progress) {
+            if (auto job = weak_job.lock()) job->on_progress(progress);
+        },
+        [weak_job](int error, const std::string& info) {
+            if (auto job = weak_job.lock()) job->on_error(error, info);
+        });
+}
+
+void StitchExecutor::complete_job(const std::shared_ptr<StitchJob>& job, int error, const std::string& error_info) {
+    std::unique_ptr<StitchBackend> backend;
+    StitchResult result;
+    {
+        std::lock_guard<std::mutex> lck(job->mutex_);
+        backend = std::move(job->backend_);
+        result = job->result_;
+        if (error != 0 && !job->failed_) {
+            result.error = error;
+            result.error_info = error_info;
+        }
+        result.ok = job->finished_ && !job->failed_ && error == 0;
+        if (job->start_time_ != steady_clock::time_point()) {
+            result.wall_seconds = duration_cast<duration<double>>(steady_clock::now() - job->start_time_).count();
+        }
+        job->completed_ = true;
+        job->executor_ = nullptr;
+    }
+
+    // Stopping the backend joins its threads, which is why this never runs from a callback
+    if (backend) {
+        if (error != 0) {
+            backend->cancel();
+        }
+        backend.reset();
+    }
+
+    if (job->spec_.on_finished) {
+        job->spec_.on_finished(result);
+    }
+    job->promise_.set_value(result);
+}
+
+void StitchExecutor::supervise() {
+    std::unique_lock<std::mutex> lck(mutex_);
+
+    while (true) {
+        dirty_ = false;
+        const std::vector<std::shared_ptr<StitchJob>> running = running_;
+        lck.unlock();
+
+        // Reap the running jobs that finished, failed, were cancelled or ran out of time
+        const auto now = steady_clock::now();
+        auto next_wakeup = steady_clock::time_point::max();
+        std::vector<std::shared_ptr<StitchJob>> reaped;
+
+        for (const auto& job : running) {
+            int error = 0;
+            std::string error_info;
+            {
+                std::lock_guard<std::mutex> job_lck(job->mutex_);
+                if (!job->finished_ && !job->failed_) {
+                    if (job->cancel_requested_) {
+                        error = STITCH_CANCELLED;
+                        error_info = "stitch cancelled";
+                    }
+                    else if (now >= job->stop_time_) {
+                        error = STITCH_TIMED_OUT;
+                        error_info = "stitch timed out";
+                    }
+                    else {
+                        next_wakeup = std::min(next_wakeup, job->stop_time_);
+                        continue;
+                    }
+                }
+            }
+
+            complete_job(job, error, error_info);
+            reaped.push_back(job);
+        }
+
+        lck.lock();
+        for (const auto& job : reaped) {
+            running_.erase(std::find(running_.begin(), running_.end(), job));
+            if (job->spec_.options.uses_hardware_codec()) {
+                --hw_sessions_;
+            }
+        }
+
+        // Cancelled and expired jobs are dropped wherever they are in the queue, not only at its front:
+        // a past deadline left behind a job that waits for room would make every wait return at once
+        std::vector<std::shared_ptr<StitchJob>> dropped;
+        for (auto it = queued_.begin(); it != queued_.end();) {
+            if ((*it)->cancel_requested_ || now >= (*it)->spec_.deadline) {
+                dropped.push_back(*it);
+                it = queued_.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+        if (!dropped.empty()) {
+            lck.unlock();
+            for (const auto& job : dropped) {
+                const bool cancelled = job->cancel_requested_;
+                complete_job(job, cancelled ? STITCH_CANCELLED : STITCH_TIMED_OUT,
+                             cancelled ? "stitch cancelled" : "deadline passed before the stitch started");
+            }
+            lck.lock();
+        }
+
+        // Start queued jobs in order while there is room
+        bool started = !dropped.empty();
+        while (!queued_.empty()) {
+            std::shared_ptr<StitchJob> job = queued_.front();
+            const bool needs_hw = job->spec_.options.uses_hardware_codec();
+            if (static_cast<int>(running_.size()) >= max_jobs_ || (needs_hw && hw_sessions_ >= max_hw_sessions_)) break;
+
+            running_.push_back(job);
+            if (needs_hw) {
+                ++hw_sessions_;
+            }
+            queued_.pop_front();
+
+            lck.unlock();
+            start_job(job);
+            lck.lock();
+            started = true;
+        }
+
+        if (queued_.empty() && running_.empty()) {
+            idle_cond_.notify_all();
+            if (stopping_) return;
+        }
+
+        // Anything started or reaped may have changed what is due, go around once more
+        if (started || !reaped.empty() || dirty_) continue;
+
+        // Only deadlines still ahead are left in the queue
+        for (const auto& job : queued_) {
+            next_wakeup = std::min(next_wakeup, job->spec_.deadline);
+        }
+        if (next_wakeup == steady_clock::time_point::max()) {
+            wake_cond_.wait(lck, [&] { return dirty_; });
+        }
+        else {
+            wake_cond_.wait_until(lck, next_wakeup, [&] { return dirty_; });
+        }
+    }
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include "stitch_backend.h"
+#include "stitch_options.h"
+#include "stitch_runner.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Errors of the jobs the executor stopped by itself, the ones coming from the SDK are >= 0
+const int STITCH_CANCELLED = -1001;
+const int STITCH_TIMED_OUT = -1002;
+
+struct StitchJobSpec {
+    std::vector<std::string> input_paths;
+    std::string output_path;
+    StitchOptions options;
+
+    double timeout_seconds = 0.0; // stitching time allowed once the job started, 0 -> no limit
+    // Absolute limit, time spent in the queue included. A job still queued by then never starts
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+
+    // on_progress comes from the stitcher threads every time the percentage changes. The others come
+    // from the executor thread: on_start when the job leaves the queue, on_finished once the backend
+    // is gone and before the result is published, so it can still change the result
+    std::function<void()> on_start;
+    std::function<void(int)> on_progress;
+    std::function<void(StitchResult&)> on_finished;
+};
+
+class StitchExecutor;
+
+// Handle of a submitted job. Shared between the executor and whoever submitted it
+class StitchJob {
+public:
+    // A job that is already finished, for results that didn't need the stitcher (cache hits)
+    static std::shared_ptr<StitchJob> completed(StitchJobSpec spec, StitchResult result);
+
+    const StitchJobSpec& spec() const { return spec_; }
+    int progress() const { return progress_; }
+    bool done() const;
+
+    // Stops a queued job right away and a running one through the backend. No-op once done
+    void cancel();
+
+    // Blocks until the result is ready
+    StitchResult wait() const { return future_.get(); }
+    // false if the job is still not done after `seconds`
+    bool wait_for(double seconds) const;
+    std::shared_future<StitchResult> future() const { return future_; }
+
+private:
+    friend class StitchExecutor;
+
+    explicit StitchJob(StitchJobSpec spec);
+
+    // Called by the backend callbacks
+    void on_progress(int progress);
+    void on_error(int error, const std::string& info);
+
+    StitchJobSpec spec_;
+    std::promise<StitchResult> promise_;
+    std::shared_future<StitchResult> future_;
+    std::atomic<int> progress_{ 0 };
+    std::atomic<bool> cancel_requested_{ false };
+
+    // Everything below is guarded by mutex_. The executor pointer is cleared when the job completes,
+    // which is what lets cancel() and the callbacks wake the executor without outliving it
+    mutable std::mutex mutex_;
+    StitchExecutor* executor_ = nullptr;
+    std::unique_ptr<StitchBackend> backend_;
+    std::chrono::steady_clock::time_point start_time_;
+    std::chrono::steady_clock::time_point stop_time_ = std::chrono::steady_clock::time_point::max();
+    bool finished_ = false;          // the backend reported 100%
+    bool failed_ = false;            // the backend reported an error
+    bool completed_ = false;         // result published, callbacks are ignored from now on
+    StitchResult result_;
+};
+
+// Owns any number of stitch jobs and runs up to max_jobs of them at once, with at most
+// max_hw_sessions of them holding a hardware codec. Jobs start in submission order.
+// A single supervisor thread starts the jobs, enforces the deadlines and reaps the finished
+// ones; it sleeps until a callback, a cancel or the next deadline wakes it, never polls
+class StitchExecutor {
+public:
+    explicit StitchExecutor(int max_jobs = 2, int max_hw_sessions = 1);
+    // Waits for every submitted job
+    ~StitchExecutor();
+
+    StitchExecutor(const StitchExecutor&) = delete;
+    StitchExecutor& operator=(const StitchExecutor&) = delete;
+
+    std::shared_ptr<StitchJob> submit(StitchJobSpec spec);
+
+    // Blocks until every job submitted so far is done
+    void wait_all();
+
+private:
+    friend class StitchJob;
+
+    void wake();
+    void supervise();
+    void start_job(const std::shared_ptr<StitchJob>& job);
+    void complete_job(const std::shared_ptr<StitchJob>& job, int error, const std::string& error_info);
+
+    const int max_jobs_;
+    const int max_hw_sessions_;
+
+    std::mutex mutex_;
+    std::condition_variable wake_cond_;
+    std::condition_variable idle_cond_;
+    std::deque<std::shared_ptr<StitchJob>> queued_;
+    std::vector<std::shared_ptr<StitchJob>> running_;
+    int hw_sessions_ = 0;
+    bool dirty_ = false;
+    bool stopping_ = false;
+    std::thread supervisor_;
+};
@@ -0,0 +1,37 @@
+#include "stitch_options.h"
+
+#include <sstream>
+
+std::string describe_stitch_options(const StitchOptions& options) {
+    std::ostringstream out;
+    out << "stitch_type=" << static_cast<int>(options.stitch_type)
+        << ";output_size=" << options.output_width << "x" << options.output_height
+        << ";bitrate=" << options.output_bitrate
+        << ";h265=" << options.enable_H265_encoder
+        << ";flowstate=" << options.enable_flowstate
+        << ";directionlock=" << options.enable_directionlock
+        << ";stitchfusion=" << options.enalbe_stitchfusion
+        << ";denoise=" << options.enable_sequence_denoise << ":" << options.denoise_model_path
+        << ";colorplus=" << options.enable_colorplus << ":" << options.color_plus_model_path
+        << ";deflicker=" << options.enable_deflicker << ":" << options.deflicker_model_path
+        << ";ai_model=" << options.ai_stitching_model
+        << ";accessory=" << options.accessory_type
+        << ";image_type=" << static_cast<int>(options.image_type);
+    return out.str();
+}
+
+StitchOptions proxy_stitch_options(const StitchOptions& options, int width, int height) {
+    StitchOptions proxy = options;
+    proxy.stitch_type = StitchType::TEMPLATE;
+    proxy.output_width = width;
+    proxy.output_height = height;
+    proxy.output_bitrate = 0;
+    proxy.image_sequence_dir.clear();
+    proxy.export_frame_nums.clear();
+    proxy.ai_stitching_model.clear();
+    proxy.enalbe_stitchfusion = false;
+    proxy.enable_colorplus = false;
+    proxy.enable_sequence_denoise = false;
+    proxy.enable_deflicker = false;
+    return proxy;
+}
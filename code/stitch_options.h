@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Mirrors of the SDK enums so the settings can be used without the SDK headers
+enum class StitchType { TEMPLATE, OPTFLOW, DYNAMICSTITCH, AIFLOW };
+enum class ImageType { JPEG, PNG };
+
+// All the VideoStitcher settings that can be given through the command line.
+// The defaults are the same ones the converter has always used
+struct StitchOptions {
+    std::string image_sequence_dir;
+    std::string ai_stitching_model;
+    std::string color_plus_model_path;
+    std::string denoise_model_path;
+    std::string deflicker_model_path;
+    std::vector<uint64_t> export_frame_nums;
+
+    StitchType stitch_type = StitchType::OPTFLOW;
+    ImageType image_type = ImageType::JPEG;
+    int accessory_type = 0; // ins::CameraAccessoryType, refer to 'common.h'. 0 is kNormal
+
+    int output_width = 1920;
+    int output_height = 960;
+    int output_bitrate = 0;
+
+    bool enable_flowstate = false;
+    bool enable_cuda = true;
+    bool enable_soft_encode = false;
+    bool enable_soft_decode = false;
+    bool enalbe_stitchfusion = true;
+    bool enable_colorplus = false;
+    bool enable_directionlock = false;
+    bool enable_sequence_denoise = false;
+    bool enable_H265_encoder = false;
+    bool enable_deflicker = false;
+
+    // A job holds a hardware codec session unless both decoding and encoding are done in software
+    bool uses_hardware_codec() const { return !(enable_soft_encode && enable_soft_decode); }
+
+    // Flowstate and direction lock read the gyro records of the Insta360 trailer, which are on the
+    // timeline of the whole recording. A piece cut out of it starts at 0 and would get the motion of
+    // the start of the recording, so these can only stitch the lens files as they were recorded
+    bool uses_recording_motion() const { return enable_flowstate || enable_directionlock; }
+};
+
+// Every setting that changes the stitched output, as a stable "key=value;..." string.
+// Codec choices that don't change the result (cuda, soft encode/decode) are left out
+std::string describe_stitch_options(const StitchOptions& options);
+
+// Settings of a cheap low resolution proxy of the same recording: template stitching at the given
+// size, no image models and video output. Everything that moves the picture (flowstate, direction
+// lock, accessory) is kept, so a yaw/pitch found on the proxy points at the same spot in the full stitch
+StitchOptions proxy_stitch_options(const StitchOptions& options, int width, int height);
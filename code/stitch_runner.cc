@@ -0,0 +1,25 @@
+#include "stitch_runner.h"
+#include "mp4_info.h"
+#include "stitch_job.h"
+
+uint64_t stitch_frame_count(const std::vector<std::string>& input_paths, const StitchOptions& options) {
+    if (!options.export_frame_nums.empty() && !options.image_sequence_dir.empty()) {
+        return options.export_frame_nums.size();
+    }
+    if (!input_paths.empty()) {
+        return read_mp4_info(input_paths[0]).frame_count;
+    }
+    return 0;
+}
+
+StitchResult run_stitch(const std::vector<std::string>& input_paths, const std::string& output_path,
+                        const StitchOptions& options, const std::function<void(int)>& on_progress) {
+    StitchJobSpec spec;
+    spec.input_paths = input_paths;
+    spec.output_path = output_path;
+    spec.options = options;
+    spec.on_progress = on_progress;
+
+    StitchExecutor executor(1, 1);
+    return executor.submit(std::move(spec))->wait();
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "stitch_options.h"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+struct StitchResult {
+    bool ok = false;
+    bool cached = false; // the output was already up to date, nothing was stitched
+    int error = 0;
+    std::string error_info;
+    double wall_seconds = 0.0;
+    // Number of frames of the recording, 0 when it couldn't be read from the input
+    uint64_t frames = 0;
+
+    double fps() const { return wall_seconds > 0.0 ? static_cast<double>(frames) / wall_seconds : 0.0; }
+};
+
+// Frames a job with these inputs and options produces, 0 when it can't be read from the input
+uint64_t stitch_frame_count(const std::vector<std::string>& input_paths, const StitchOptions& options);
+
+// Runs a single stitch job on the backend from make_stitch_backend() and blocks until it finishes or fails.
+// on_progress is called from the stitcher thread every time the percentage changes.
+// Shorthand for a one job StitchExecutor (stitch_job.h), which is what to use for cancel and timeouts
+StitchResult run_stitch(const std::vector<std::string>& input_paths, const std::string& output_path,
+                        const StitchOptions& options, const std::function<void(int)>& on_progress = nullptr);
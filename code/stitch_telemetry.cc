@@ -0,0 +1,319 @@
+#include "stitch_telemetry.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#ifndef WIN32
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Weight of the newest rate in the smoothed frames/s
+const double RATE_SMOOTHING = 0.3;
+
+double steady_seconds() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+double unix_seconds() {
+    return std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+std::string json_string(const std::string& text) {
+    std::ostringstream out;
+    out << '"';
+    for (char c : text) {
+        switch (c) {
+        case '"': out << "\\\""; break;
+        case '\\': out << "\\\\"; break;
+        case '\n': out << "\\n"; break;
+        case '\r': out << "\\r"; break;
+        case '\t': out << "\\t"; break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << int(c) << std::dec;
+            }
+            else {
+                out << c;
+            }
+        }
+    }
+    out << '"';
+    return out.str();
+}
+
+std::string prom_label(const std::string& text) {
+    std::string escaped;
+    for (char c : text) {
+        if (c == '\\' || c == '"') escaped += '\\';
+        if (c == '\n') {
+            escaped += "\\n";
+            continue;
+        }
+        escaped += c;
+    }
+    return escaped;
+}
+
+// "Key:   value kB" style line of /proc/self/status and "key: value" of /proc/self/io
+uint64_t read_proc_field(const char* path, const std::string& key) {
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.compare(0, key.size(), key) == 0) {
+            return std::strtoull(line.c_str() + key.size(), nullptr, 10);
+        }
+    }
+    return 0;
+}
+
+double read_cpu_seconds() {
+#ifdef WIN32
+    return 0.0;
+#else
+    // utime and stime are fields 14 and 15, counted after the ")" closing the command name
+    std::ifstream file("/proc/self/stat");
+    std::string stat((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    const size_t end_of_name = stat.rfind(')');
+    if (end_of_name == std::string::npos) return 0.0;
+
+    std::istringstream fields(stat.substr(end_of_name + 2));
+    std::vector<std::string> values;
+    std::string value;
+    while (values.size() < 13 && fields >> value) {
+        values.push_back(value);
+    }
+    if (values.size() < 13) return 0.0;
+
+    const long ticks = sysconf(_SC_CLK_TCK);
+    const double utime = std::strtod(values[11].c_str(), nullptr);
+    const double stime = std::strtod(values[12].c_str(), nullptr);
+    return ticks > 0 ? (utime + stime) / ticks : 0.0;
+#endif
+}
+
+} // namespace
+
+ProcessSample sample_process() {
+    ProcessSample sample;
+    sample.cpu_seconds = read_cpu_seconds();
+    sample.rss_bytes = read_proc_field("/proc/self/status", "VmRSS:") * 1024;
+    sample.read_bytes = read_proc_field("/proc/self/io", "read_bytes:");
+    sample.write_bytes = read_proc_field("/proc/self/io", "write_bytes:");
+    return sample;
+}
+
+StitchTelemetry::StitchTelemetry(TelemetrySettings settings) : settings_(std::move(settings)) {
+    if (!settings_.jsonl_path.empty()) {
+        jsonl_.open(settings_.jsonl_path, std::ios::app);
+        if (!jsonl_) {
+            std::cout << "Failed to open the telemetry file " << settings_.jsonl_path << std::endl;
+        }
+    }
+
+    if (settings_.enabled() && settings_.interval_seconds > 0.0) {
+        heartbeat_ = std::thread([this] { heartbeat_loop(); });
+    }
+}
+
+StitchTelemetry::~StitchTelemetry() {
+    {
+        std::lock_guard<std::mutex> lck(mutex_);
+        stopping_ = true;
+    }
+    stop_cond_.notify_all();
+    if (heartbeat_.joinable()) {
+        heartbeat_.join();
+    }
+}
+
+void StitchTelemetry::begin_job(const std::string& job, uint64_t frames) {
+    const ProcessSample process = sample_process();
+
+    std::lock_guard<std::mutex> lck(mutex_);
+    JobState& state = jobs_[job];
+    state = JobState();
+    state.frames = frames;
+    state.start_seconds = steady_seconds();
+    state.last_progress_seconds = state.start_seconds;
+
+    write_record("start", job, state, process, nullptr);
+    write_prometheus(process);
+}
+
+void StitchTelemetry::progress(const std::string& job, int progress) {
+    const ProcessSample process = sample_process();
+    const double now = steady_seconds();
+
+    std::lock_guard<std::mutex> lck(mutex_);
+    auto it = jobs_.find(job);
+    if (it == jobs_.end() || progress == it->second.progress) return;
+    JobState& state = it->second;
+
+    const double elapsed = now - state.last_progress_seconds;
+    if (state.frames > 0 && elapsed > 0.0 && progress > state.progress) {
+        const double rate = state.frames * (progress - state.progress) / 100.0 / elapsed;
+        state.smoothed_fps = state.smoothed_fps > 0.0 ? RATE_SMOOTHING * rate + (1.0 - RATE_SMOOTHING) * state.smoothed_fps : rate;
+    }
+    state.progress = progress;
+    state.last_progress_seconds = now;
+
+    write_record("progress", job, state, process, nullptr);
+    write_prometheus(process);
+}
+
+void StitchTelemetry::end_job(const std::string& job, const StitchResult& result) {
+    const ProcessSample process = sample_process();
+
+    std::lock_guard<std::mutex> lck(mutex_);
+    JobState& state = jobs_[job];
+    state.running = false;
+    state.ok = result.ok;
+    state.cached = result.cached;
+    state.error = result.error;
+    state.wall_seconds = result.wall_seconds;
+    if (result.ok) {
+        state.progress = 100;
+    }
+    if (state.frames == 0) {
+        state.frames = result.frames;
+    }
+
+    write_record("end", job, state, process, &result);
+
+    // Only the totals outlive the job, a long running process would otherwise keep every job it ever ran
+    if (result.ok) {
+        ++jobs_succeeded_;
+        frames_stitched_ += state.frames;
+    }
+    else {
+        ++jobs_failed_;
+        last_error_ = result.error;
+    }
+    job_seconds_ += result.wall_seconds;
+    jobs_.erase(job);
+
+    write_prometheus(process);
+}
+
+void StitchTelemetry::write_record(const std::string& event, const std::string& job, const JobState& state,
+                                   const ProcessSample& process, const StitchResult* result) {
+    if (!jsonl_.is_open()) return;
+
+    const double now = steady_seconds();
+    const double elapsed = state.running ? now - state.start_seconds : state.wall_seconds;
+    const uint64_t frames_done = state.frames * state.progress / 100;
+    const double average_fps = elapsed > 0.0 ? frames_done / elapsed : 0.0;
+
+    std::ostringstream line;
+    line << std::fixed << std::setprecision(3);
+    line << "{\"ts\": " << unix_seconds() << ", \"event\": " << json_string(event) << ", \"job\": " << json_string(job)
+         << ", \"progress\": " << state.progress << ", \"frames\": " << state.frames << ", \"frames_done\": " << frames_done
+         << ", \"elapsed_s\": " << elapsed << ", \"fps\": " << average_fps;
+
+    if (state.running) {
+        const double fps = state.smoothed_fps > 0.0 ? state.smoothed_fps : average_fps;
+        line << ", \"fps_smoothed\": " << state.smoothed_fps;
+        if (fps > 0.0 && state.frames > 0) {
+            line << ", \"eta_s\": " << (state.frames - frames_done) / fps;
+        }
+        else {
+            line << ", \"eta_s\": null";
+        }
+        line << ", \"since_progress_s\": " << now - state.last_progress_seconds;
+    }
+
+    line << ", \"cpu_s\": " << process.cpu_seconds << ", \"rss_bytes\": " << process.rss_bytes
+         << ", \"read_bytes\": " << process.read_bytes << ", \"write_bytes\": " << process.write_bytes;
+
+    if (result) {
+        line << ", \"ok\": " << (result->ok ? "true" : "false") << ", \"cached\": " << (result->cached ? "true" : "false")
+             << ", \"error\": " << result->error << ", \"error_info\": " << json_string(result->error_info)
+             << ", \"wall_s\": " << result->wall_seconds;
+    }
+    line << "}\n";
+
+    jsonl_ << line.str() << std::flush;
+}
+
+void StitchTelemetry::write_prometheus(const ProcessSample& process) {
+    if (settings_.prom_path.empty()) return;
+
+    const double now = steady_seconds();
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(3);
+
+    auto per_job = [&](const char* name, const char* type, const char* help, auto value) {
+        out << "# HELP " << name << " " << help << "\n# TYPE " << name << " " << type << "\n";
+        for (const auto& [job, state] : jobs_) {
+            out << name << "{job=\"" << prom_label(job) << "\"} " << value(state) << "\n";
+        }
+    };
+    auto single = [&](const char* name, const char* type, const char* help, auto value) {
+        out << "# HELP " << name << " " << help << "\n# TYPE " << name << " " << type << "\n" << name << " " << value << "\n";
+    };
+
+    // Per job series only exist while the job runs, finished jobs are in the totals
+    per_job("insv_stitch_progress_percent", "gauge", "Progress reported by the stitcher",
+            [](const JobState& s) { return s.progress; });
+    per_job("insv_stitch_frames_per_second", "gauge", "Smoothed stitch throughput",
+            [](const JobState& s) { return s.smoothed_fps; });
+    per_job("insv_stitch_eta_seconds", "gauge", "Estimated time left, 0 while unknown",
+            [](const JobState& s) {
+                if (s.smoothed_fps <= 0.0) return 0.0;
+                return (s.frames - s.frames * s.progress / 100) / s.smoothed_fps;
+            });
+    per_job("insv_stitch_seconds_since_progress", "gauge", "Time since the progress last moved",
+            [now](const JobState& s) { return now - s.last_progress_seconds; });
+    single("insv_stitch_jobs_running", "gauge", "Jobs stitching right now", jobs_.size());
+    single("insv_stitch_jobs_succeeded_total", "counter", "Jobs that finished successfully", jobs_succeeded_);
+    single("insv_stitch_jobs_failed_total", "counter", "Jobs that failed or were cancelled", jobs_failed_);
+    single("insv_stitch_frames_total", "counter", "Frames of the jobs that finished successfully", frames_stitched_);
+    single("insv_stitch_job_seconds_total", "counter", "Wall time of every finished job", job_seconds_);
+    single("insv_stitch_last_error_code", "gauge", "Error code of the last failed job, 0 without one", last_error_);
+    single("insv_stitch_process_cpu_seconds_total", "counter", "User and system CPU time of the converter", process.cpu_seconds);
+    single("insv_stitch_process_resident_memory_bytes", "gauge", "Resident set size of the converter", process.rss_bytes);
+    single("insv_stitch_process_read_bytes_total", "counter", "Bytes the converter read from storage", process.read_bytes);
+    single("insv_stitch_process_write_bytes_total", "counter", "Bytes the converter wrote to storage", process.write_bytes);
+
+    // The node exporter may read the file at any moment, so it is replaced in one rename
+    const std::string temp_path = settings_.prom_path + ".tmp";
+    {
+        std::ofstream file(temp_path, std::ios::trunc);
+        file << out.str();
+        if (!file) return;
+    }
+    std::error_code ec;
+    std::filesystem::rename(temp_path, settings_.prom_path, ec);
+}
+
+void StitchTelemetry::heartbeat_loop() {
+    const auto interval = std::chrono::duration<double>(settings_.interval_seconds);
+
+    std::unique_lock<std::mutex> lck(mutex_);
+    while (!stop_cond_.wait_for(lck, interval, [&] { return stopping_; })) {
+        bool any_running = false;
+        for (const auto& entry : jobs_) {
+            any_running = any_running || entry.second.running;
+        }
+        if (!any_running) continue;
+
+        // /proc reads don't need the lock
+        lck.unlock();
+        const ProcessSample process = sample_process();
+        lck.lock();
+
+        for (const auto& [job, state] : jobs_) {
+            if (state.running) {
+                write_record("heartbeat", job, state, process, nullptr);
+            }
+        }
+        write_prometheus(process);
+    }
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "stitch_runner.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+struct TelemetrySettings {
+    std::string jsonl_path;        // appended with one JSON record per line, empty -> off
+    std::string prom_path;         // Prometheus textfile for the node exporter, empty -> off
+    double interval_seconds = 5.0; // heartbeat while the progress doesn't move, <= 0 -> only on progress
+
+    bool enabled() const { return !jsonl_path.empty() || !prom_path.empty(); }
+};
+
+// Counters of the whole process read from /proc/self. Zero where /proc isn't available
+struct ProcessSample {
+    double cpu_seconds = 0.0; // user + system time of every thread, the SDK ones included
+    uint64_t rss_bytes = 0;
+    uint64_t read_bytes = 0;  // bytes fetched from storage
+    uint64_t write_bytes = 0; // bytes sent to storage
+};
+
+ProcessSample sample_process();
+
+// Live telemetry of the stitch jobs of this process. Every progress change, every heartbeat and
+// the end of every job writes a timestamped JSON line with the progress, frames/s, a smoothed ETA and
+// the process counters, and rewrites the Prometheus textfile with the state of the running jobs and
+// the totals of the finished ones. The heartbeat keeps records coming while a job is stuck,
+// "since_progress_s" is what shows a stall.
+// Safe to call from the stitcher threads and from several jobs at once
+class StitchTelemetry {
+public:
+    explicit StitchTelemetry(TelemetrySettings settings);
+    ~StitchTelemetry();
+
+    StitchTelemetry(const StitchTelemetry&) = delete;
+    StitchTelemetry& operator=(const StitchTelemetry&) = delete;
+
+    // frames is the length of the job, 0 when unknown (no fps nor ETA then)
+    void begin_job(const std::string& job, uint64_t frames);
+    void progress(const std::string& job, int progress);
+    // Final summary record, with the error code and info the stitcher reported
+    void end_job(const std::string& job, const StitchResult& result);
+
+    const TelemetrySettings& settings() const { return settings_; }
+
+private:
+    struct JobState {
+        uint64_t frames = 0;
+        int progress = 0;
+        double start_seconds = 0.0;         // steady clock
+        double last_progress_seconds = 0.0;
+        double smoothed_fps = 0.0;          // exponential average of the rate between progress changes
+        bool running = true;
+        bool ok = false;
+        bool cached = false;
+        int error = 0;
+        double wall_seconds = 0.0;
+    };
+
+    void write_record(const std::string& event, const std::string& job, const JobState& state,
+                      const ProcessSample& process, const StitchResult* result);
+    void write_prometheus(const ProcessSample& process);
+    void heartbeat_loop();
+
+    TelemetrySettings settings_;
+    std::ofstream jsonl_;
+    std::map<std::string, JobState> jobs_; // running jobs only
+
+    // Totals of the finished jobs
+    uint64_t jobs_succeeded_ = 0;
+    uint64_t jobs_failed_ = 0;
+    uint64_t frames_stitched_ = 0;
+    double job_seconds_ = 0.0;
+    int last_error_ = 0;
+
+    std::mutex mutex_;
+    std::condition_variable stop_cond_;
+    bool stopping_ = false;
+    std::thread heartbeat_;
+};
@@ -0,0 +1,251 @@
+// Checks of the chunked output against the fake stitcher: the manifest a consumer follows and the order
+// chunks are published in. The lens files are generated, an mp4 header with frame times and keyframes,
+// and ffmpeg is replaced by a script that copies them whole (POSIX only).
+// Build: g++ -O2 -std=c++17 -DNO_INSTA360_SDK test_chunked_output.cc chunked_output.cc stitch_job.cc stitch_runner.cc
+//        stitch_backend.cc fake_stitch_backend.cc stitch_options.cc stitch_telemetry.cc mp4_info.cc ffmpeg.cc -lpthread
+#include "chunked_output.h"
+#include "fake_stitch_backend.h"
+#include "stitch_backend.h"
+#include "stitch_options.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(condition)                                                              \
+    do {                                                                              \
+        if (!(condition)) {                                                           \
+            std::cout << __FILE__ << ":" << __LINE__ << ": failed " #condition << std::endl; \
+            ++failures;                                                               \
+        }                                                                             \
+    } while (0)
+
+const uint64_t FRAMES = 300;
+const uint32_t TIMESCALE = 30000;
+const uint32_t FRAME_TICKS = 1000;  // 30 fps
+const uint64_t KEYFRAME_INTERVAL = 30;
+
+void put_u32(std::string& data, uint32_t value) {
+    for (int shift = 24; shift >= 0; shift -= 8) data += char((value >> shift) & 0xff);
+}
+
+std::string mp4_box(const char* type, const std::string& payload) {
+    std::string box;
+    put_u32(box, static_cast<uint32_t>(8 + payload.size()));
+    return box + type + payload;
+}
+
+// Just what read_mp4_info looks at: the handler, the timescale, the sample sizes, times and keyframes
+void write_lens_file(const std::string& path) {
+    std::string hdlr(8, '\0');
+    hdlr += "vide" + std::string(12, '\0');
+
+    std::string mdhd(12, '\0');
+    put_u32(mdhd, TIMESCALE);
+    put_u32(mdhd, static_cast<uint32_t>(FRAMES * FRAME_TICKS));
+    mdhd += std::string(4, '\0');
+
+    std::string stsz(4, '\0');
+    put_u32(stsz, 0);
+    put_u32(stsz, static_cast<uint32_t>(FRAMES));
+
+    std::string stts(4, '\0');
+    put_u32(stts, 1);
+    put_u32(stts, static_cast<uint32_t>(FRAMES));
+    put_u32(stts, FRAME_TICKS);
+
+    std::string stss(4, '\0');
+    put_u32(stss, static_cast<uint32_t>(FRAMES / KEYFRAME_INTERVAL));
+    for (uint64_t frame = 0; frame < FRAMES; frame += KEYFRAME_INTERVAL) put_u32(stss, static_cast<uint32_t>(frame + 1));
+
+    const std::string stbl = mp4_box("stbl", mp4_box("stsz", stsz) + mp4_box("stts", stts) + mp4_box("stss", stss));
+    const std::string moov = mp4_box("moov", mp4_box("trak", mp4_box("mdia",
+        mp4_box("hdlr", hdlr) + mp4_box("mdhd", mdhd) + mp4_box("minf", stbl))));
+    std::ofstream(path, std::ios::binary) << moov << mp4_box("mdat", "");
+}
+
+// Takes the input after -i and copies it to the last argument
+void use_fake_ffmpeg(const std::string& root) {
+    const std::string path = root + "/ffmpeg.sh";
+    std::ofstream(path) << "#!/bin/sh\nwhile [ $# -gt 1 ]; do [ \"$1\" = -i ] && input=\"$2\"; shift; done\ncp \"$input\" \"$1\"\n";
+    std::filesystem::permissions(path, std::filesystem::perms::owner_all);
+    setenv("FFMPEG_BINARY", path.c_str(), 1);
+}
+
+void use_fake_stitcher(int fail_at) {
+    set_stitch_backend_factory([fail_at] {
+        FakeStitchSettings fake;
+        fake.time_scale = 0.01;
+        fake.fail_at = fail_at;
+        return std::unique_ptr<StitchBackend>(new FakeStitchBackend(fake));
+    });
+}
+
+std::vector<std::string> manifest_kinds(const std::string& path) {
+    std::vector<std::string> kinds;
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line)) kinds.push_back(line.substr(0, line.find('\t')));
+    return kinds;
+}
+
+size_t count_files(const std::string& dir) {
+    size_t count = 0;
+    std::error_code ec;
+    for (auto it = std::filesystem::directory_iterator(dir, ec); !ec && it != std::filesystem::directory_iterator(); ++it) ++count;
+    return count;
+}
+
+// Every chunk read while the stitch runs is complete on the disk the moment its line is there
+void test_publish_order(const std::vector<std::string>& inputs, const std::string& root) {
+    const std::string output_dir = root + "/chunks";
+    // The consumer may start following before the stitch starts
+    std::filesystem::create_directories(output_dir);
+    std::ofstream(output_dir + "/" + CHUNK_MANIFEST_NAME, std::ios::trunc);
+    use_fake_stitcher(-1);
+
+    StitchOptions options;
+    options.image_sequence_dir = output_dir;
+    ChunkSettings settings;
+    settings.chunk_seconds = 2.0;
+    settings.max_jobs = 3;
+    // The pieces start a keyframe before the chunks, their frame numbers overlap the recording's
+    settings.overlap_frames = 15;
+
+    bool stitched = false;
+    std::thread stitcher([&] { stitched = run_chunked_stitch(inputs, output_dir, options, settings); });
+
+    ChunkManifestReader reader(output_dir + "/" + CHUNK_MANIFEST_NAME);
+    std::vector<ChunkEntry> entries;
+    std::vector<bool> complete;
+    ChunkEntry entry;
+    while (reader.next(entry, 30.0)) {
+        entries.push_back(entry);
+        complete.push_back(std::filesystem::is_directory(entry.path) && count_files(entry.path) == entry.end - entry.begin);
+    }
+    stitcher.join();
+
+    CHECK(stitched);
+    CHECK(reader.has_stream());
+    CHECK(reader.kind() == "jpg");
+    CHECK(reader.frames() == FRAMES);
+    CHECK(reader.finished());
+    CHECK(!reader.failed());
+
+    // 2 s chunks on keyframes every second: [0, 60), [60, 120) ... in order
+    CHECK(entries.size() == FRAMES / 60);
+    uint64_t next_begin = 0;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        CHECK(entries[i].index == i);
+        CHECK(entries[i].begin == next_begin);
+        CHECK(entries[i].first_frame == entries[i].begin);
+        CHECK(complete[i]);
+        CHECK(std::filesystem::exists(entries[i].path + "/" + std::to_string(entries[i].begin) + ".jpg"));
+        CHECK(i == 0 || entries[i].published_ms >= entries[i - 1].published_ms);
+        next_begin = entries[i].end;
+    }
+    CHECK(next_begin == FRAMES);
+
+    std::vector<std::string> expected = { "stream" };
+    expected.insert(expected.end(), entries.size(), "chunk");
+    expected.push_back("end");
+    CHECK(manifest_kinds(output_dir + "/" + CHUNK_MANIFEST_NAME) == expected);
+}
+
+// A failing chunk ends the stream with a failed line, the reader stops there
+void test_failed_chunk(const std::vector<std::string>& inputs, const std::string& root) {
+    const std::string output_dir = root + "/failed";
+    use_fake_stitcher(50);
+
+    StitchOptions options;
+    options.image_sequence_dir = output_dir;
+    ChunkSettings settings;
+    settings.chunk_seconds = 2.0;
+
+    CHECK(!run_chunked_stitch(inputs, output_dir, options, settings));
+
+    ChunkManifestReader reader(output_dir + "/" + CHUNK_MANIFEST_NAME);
+    ChunkEntry entry;
+    CHECK(!reader.next(entry, 5.0));
+    CHECK(reader.failed());
+    CHECK(!reader.finished());
+    CHECK(reader.error().rfind("chunk 0 failed", 0) == 0);
+    CHECK(manifest_kinds(output_dir + "/" + CHUNK_MANIFEST_NAME) == std::vector<std::string>({ "stream", "failed" }));
+    CHECK(!std::filesystem::exists(output_dir + "/chunk_000000"));
+}
+
+// With flowstate nothing is cut, ffmpeg fails if it's run at all
+void test_stabilised_images(const std::vector<std::string>& inputs, const std::string& root) {
+    const std::string output_dir = root + "/stabilised";
+    use_fake_stitcher(-1);
+    setenv("FFMPEG_BINARY", "false", 1);
+
+    StitchOptions options;
+    options.image_sequence_dir = output_dir;
+    options.enable_flowstate = true;
+    ChunkSettings settings;
+    settings.chunk_seconds = 4.0;
+
+    CHECK(run_chunked_stitch(inputs, output_dir, options, settings));
+
+    ChunkManifestReader reader(output_dir + "/" + CHUNK_MANIFEST_NAME);
+    ChunkEntry entry;
+    uint64_t chunks = 0;
+    while (reader.next(entry, 5.0)) {
+        CHECK(entry.first_frame == entry.begin);
+        CHECK(count_files(entry.path) == entry.end - entry.begin);
+        CHECK(std::filesystem::exists(entry.path + "/" + std::to_string(entry.end - 1) + ".jpg"));
+        ++chunks;
+    }
+    CHECK(reader.finished());
+    CHECK(chunks == FRAMES / 120 + 1);
+
+    options.image_sequence_dir.clear();
+    CHECK(!run_chunked_stitch(inputs, root + "/stabilised_video", options, settings));
+}
+
+// A line without its '\n' yet is left for the next poll
+void test_partial_line(const std::string& root) {
+    const std::string path = root + "/partial.tsv";
+    std::ofstream manifest(path, std::ios::trunc);
+    manifest << "stream\tjpg\t30\t300\t1920\t960\n" << "chunk\t0\t/tmp/chunk_000000\t0\t0\t6";
+    manifest.flush();
+
+    ChunkManifestReader reader(path);
+    CHECK(reader.poll().empty());
+    CHECK(reader.has_stream());
+
+    manifest << "0\t0.000\t1700000000000\n";
+    manifest.flush();
+    const std::vector<ChunkEntry> entries = reader.poll();
+    CHECK(entries.size() == 1);
+    CHECK(!entries.empty() && entries[0].end == 60);
+    CHECK(!entries.empty() && entries[0].published_ms == 1700000000000);
+    CHECK(reader.poll().empty());
+}
+
+int main(int argc, char* argv[]) {
+    const std::string root = argc > 1 ? argv[1] : (std::filesystem::temp_directory_path() / "test_chunked_output").string();
+    std::filesystem::remove_all(root);
+    std::filesystem::create_directories(root);
+
+    const std::vector<std::string> inputs = { root + "/VID_00_000.insv", root + "/VID_10_000.insv" };
+    for (const auto& input : inputs) write_lens_file(input);
+
+    use_fake_ffmpeg(root);
+    test_publish_order(inputs, root);
+    test_failed_chunk(inputs, root);
+    test_stabilised_images(inputs, root);
+    test_partial_line(root);
+
+    std::filesystem::remove_all(root);
+    std::cout << (failures == 0 ? "all checks passed" : std::to_string(failures) + " checks failed") << std::endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,77 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned threads) {
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // The thread calling parallel_for also works, so start one less
+    for (unsigned i = 1; i < threads; ++i) {
+        workers_.emplace_back([this] { worker_loop(); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::unique_lock<std::mutex> lck(mutex_);
+        stopping_ = true;
+    }
+    start_cond_.notify_all();
+
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+void ThreadPool::parallel_for(size_t count, const std::function<void(size_t)>& fn) {
+    if (count == 0) return;
+
+    {
+        std::unique_lock<std::mutex> lck(mutex_);
+        task_ = &fn;
+        task_count_ = count;
+        next_index_ = 0;
+        finished_ = 0;
+        ++generation_;
+    }
+    start_cond_.notify_all();
+
+    run_tasks();
+
+    std::unique_lock<std::mutex> lck(mutex_);
+    done_cond_.wait(lck, [&] { return finished_ == task_count_; });
+    task_ = nullptr;
+}
+
+void ThreadPool::run_tasks() {
+    std::unique_lock<std::mutex> lck(mutex_);
+    while (task_ && next_index_ < task_count_) {
+        const size_t index = next_index_++;
+        const auto* task = task_;
+
+        lck.unlock();
+        (*task)(index);
+        lck.lock();
+
+        if (++finished_ == task_count_) {
+            done_cond_.notify_all();
+        }
+    }
+}
+
+void ThreadPool::worker_loop() {
+    unsigned long seen_generation = 0;
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lck(mutex_);
+            start_cond_.wait(lck, [&] { return stopping_ || (task_ && generation_ != seen_generation); });
+            if (stopping_) return;
+            seen_generation = generation_;
+        }
+
+        run_tasks();
+    }
+}
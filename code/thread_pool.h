@@ -0,0 +1,42 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent pool of worker threads. Unlike the python ThreadPoolExecutor that was
+// created for every frame, the threads are started once and reused for every call
+class ThreadPool {
+public:
+    // 0 threads -> one per hardware thread
+    explicit ThreadPool(unsigned threads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Calls fn(i) for every i in [0, count) and blocks until all of them finished.
+    // Work is handed out in order, so lower indices start first. The calling thread helps too
+    void parallel_for(size_t count, const std::function<void(size_t)>& fn);
+
+    unsigned size() const { return static_cast<unsigned>(workers_.size()) + 1; }
+
+private:
+    void worker_loop();
+    void run_tasks();
+
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable start_cond_;
+    std::condition_variable done_cond_;
+
+    const std::function<void(size_t)>* task_ = nullptr;
+    size_t task_count_ = 0;
+    size_t next_index_ = 0;
+    size_t finished_ = 0;
+    unsigned long generation_ = 0;
+    bool stopping_ = false;
+};
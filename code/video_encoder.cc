@@ -0,0 +1,385 @@
+#include "video_encoder.h"
+
+#ifndef NO_LIBAV
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/opt.h>
+}
+#endif
+
+#include <opencv2/videoio.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+using namespace std::chrono;
+
+namespace {
+
+const char* const MP4V = "mp4v";
+
+// BT.601 limited range, 8 bit fixed point. Chroma takes the sum of a 2x2 block, hence the 10 bit shift
+inline uint8_t luma(int b, int g, int r) {
+    return static_cast<uint8_t>(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+}
+
+inline uint8_t chroma(int c) {
+    return static_cast<uint8_t>(std::min(255, std::max(0, ((c + 512) >> 10) + 128)));
+}
+
+void convert_pixels_scalar(const uint8_t* row0, const uint8_t* row1, int x_begin, int x_end,
+                           uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v) {
+    for (int x = x_begin; x < x_end; x += 2) {
+        const uint8_t* a = row0 + x * 3;
+        const uint8_t* b = row1 + x * 3;
+        y0[x] = luma(a[0], a[1], a[2]);
+        y0[x + 1] = luma(a[3], a[4], a[5]);
+        y1[x] = luma(b[0], b[1], b[2]);
+        y1[x + 1] = luma(b[3], b[4], b[5]);
+
+        const int sb = a[0] + a[3] + b[0] + b[3];
+        const int sg = a[1] + a[4] + b[1] + b[4];
+        const int sr = a[2] + a[5] + b[2] + b[5];
+        u[x / 2] = chroma(-38 * sr - 74 * sg + 112 * sb);
+        v[x / 2] = chroma(112 * sr - 94 * sg - 18 * sb);
+    }
+}
+
+#if defined(__AVX2__)
+
+// B, G and R of 8 consecutive pixels as 32 bit lanes. Reads 25 bytes
+inline void load_8_bgr(const uint8_t* src, __m256i& b, __m256i& g, __m256i& r) {
+    const __m256i words = _mm256_i32gather_epi32(reinterpret_cast<const int*>(src),
+                                                  _mm256_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21), 1);
+    const __m256i mask = _mm256_set1_epi32(0xFF);
+    b = _mm256_and_si256(words, mask);
+    g = _mm256_and_si256(_mm256_srli_epi32(words, 8), mask);
+    r = _mm256_and_si256(_mm256_srli_epi32(words, 16), mask);
+}
+
+inline __m256i weighted(__m256i b, __m256i g, __m256i r, int cb, int cg, int cr) {
+    return _mm256_add_epi32(_mm256_add_epi32(_mm256_mullo_epi32(b, _mm256_set1_epi32(cb)),
+                                             _mm256_mullo_epi32(g, _mm256_set1_epi32(cg))),
+                            _mm256_mullo_epi32(r, _mm256_set1_epi32(cr)));
+}
+
+// 8 luma values as bytes
+inline void store_luma_8(__m256i b, __m256i g, __m256i r, uint8_t* out) {
+    __m256i y = weighted(b, g, r, 25, 129, 66);
+    y = _mm256_add_epi32(_mm256_srai_epi32(_mm256_add_epi32(y, _mm256_set1_epi32(128)), 8), _mm256_set1_epi32(16));
+    const __m128i words = _mm_packus_epi32(_mm256_castsi256_si128(y), _mm256_extracti128_si256(y, 1));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(out), _mm_packus_epi16(words, words));
+}
+
+// 4 chroma values out of the 2x2 sums, which come as (0,1 | 4,5) of a horizontal add
+inline void store_chroma_4(__m256i sb, __m256i sg, __m256i sr, int cb, int cg, int cr, uint8_t* out) {
+    __m256i c = weighted(sb, sg, sr, cb, cg, cr);
+    c = _mm256_add_epi32(_mm256_srai_epi32(_mm256_add_epi32(c, _mm256_set1_epi32(512)), 10), _mm256_set1_epi32(128));
+    c = _mm256_permutevar8x32_epi32(c, _mm256_setr_epi32(0, 1, 4, 5, 0, 1, 4, 5));
+    const __m128i words = _mm_packus_epi32(_mm256_castsi256_si128(c), _mm256_castsi256_si128(c));
+    const int bytes = _mm_cvtsi128_si32(_mm_packus_epi16(words, words));
+    std::memcpy(out, &bytes, 4);
+}
+
+// 8 pixels of two rows: 16 luma, 4 u and 4 v values
+inline void convert_8_avx2(const uint8_t* row0, const uint8_t* row1, uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v) {
+    __m256i b0, g0, r0, b1, g1, r1;
+    load_8_bgr(row0, b0, g0, r0);
+    load_8_bgr(row1, b1, g1, r1);
+    store_luma_8(b0, g0, r0, y0);
+    store_luma_8(b1, g1, r1, y1);
+
+    const __m256i sb = _mm256_add_epi32(b0, b1);
+    const __m256i sg = _mm256_add_epi32(g0, g1);
+    const __m256i sr = _mm256_add_epi32(r0, r1);
+    const __m256i hb = _mm256_hadd_epi32(sb, sb);
+    const __m256i hg = _mm256_hadd_epi32(sg, sg);
+    const __m256i hr = _mm256_hadd_epi32(sr, sr);
+    store_chroma_4(hb, hg, hr, 112, -74, -38, u);
+    store_chroma_4(hb, hg, hr, -18, -94, 112, v);
+}
+
+#endif
+
+} // namespace
+
+void bgr_to_yuv420(const ImageView& src, uint8_t* y, int y_stride, uint8_t* u, int u_stride, uint8_t* v, int v_stride) {
+    for (int row = 0; row + 1 < src.height; row += 2) {
+        const uint8_t* row0 = src.row(row);
+        const uint8_t* row1 = src.row(row + 1);
+        uint8_t* y0 = y + static_cast<size_t>(row) * y_stride;
+        uint8_t* y1 = y0 + y_stride;
+        uint8_t* u_row = u + static_cast<size_t>(row / 2) * u_stride;
+        uint8_t* v_row = v + static_cast<size_t>(row / 2) * v_stride;
+
+        int x = 0;
+#if defined(__AVX2__)
+        for (; x + 8 <= src.width; x += 8) {
+            convert_8_avx2(row0 + x * 3, row1 + x * 3, y0 + x, y1 + x, u_row + x / 2, v_row + x / 2);
+        }
+#endif
+        convert_pixels_scalar(row0, row1, x, src.width, y0, y1, u_row, v_row);
+    }
+}
+
+#ifndef NO_LIBAV
+struct VideoEncoder::Codec {
+    AVFormatContext* format = nullptr;
+    AVCodecContext* context = nullptr;
+    AVStream* stream = nullptr;
+    AVFrame* frame = nullptr;
+    AVPacket* packet = nullptr;
+    bool header_written = false;
+    cv::VideoWriter writer; // mp4v
+
+    ~Codec() {
+        av_packet_free(&packet);
+        av_frame_free(&frame);
+        avcodec_free_context(&context);
+        if (format) {
+            if (format->pb) avio_closep(&format->pb);
+            avformat_free_context(format);
+        }
+    }
+};
+#else
+struct VideoEncoder::Codec {
+    cv::VideoWriter writer;
+};
+#endif
+
+namespace {
+
+#ifndef NO_LIBAV
+std::string av_error(int code) {
+    char text[AV_ERROR_MAX_STRING_SIZE] = {};
+    av_strerror(code, text, sizeof(text));
+    return text;
+}
+#endif
+
+} // namespace
+
+VideoEncoder::VideoEncoder(const std::string& path, int width, int height, double fps, EncoderSettings settings)
+    : path_(path), width_(width), height_(height), fps_(fps > 0.0 ? fps : 30.0), settings_(std::move(settings)),
+      codec_(std::make_unique<Codec>()), pool_(std::max<size_t>(2, settings_.pool_size), width, height) {
+    if (settings_.codec.empty()) {
+#ifndef NO_LIBAV
+        settings_.codec = "libx264";
+#else
+        settings_.codec = MP4V;
+#endif
+    }
+
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(path_).parent_path(), ec);
+
+    if (settings_.codec == MP4V) {
+        codec_->writer.open(path_, cv::VideoWriter::fourcc('m', 'p', '4', 'v'), fps_, cv::Size(width_, height_));
+        if (!codec_->writer.isOpened()) {
+            error_ = "failed to open the output video " + path_;
+            return;
+        }
+        thread_ = std::thread([this] { run(); });
+        return;
+    }
+
+#ifndef NO_LIBAV
+    if (width_ % 2 || height_ % 2) {
+        error_ = "YUV 4:2:0 needs an even output size";
+        return;
+    }
+
+    const AVCodec* encoder = avcodec_find_encoder_by_name(settings_.codec.c_str());
+    if (!encoder) {
+        error_ = "encoder " + settings_.codec + " not available in this libavcodec";
+        return;
+    }
+
+    int ret = avformat_alloc_output_context2(&codec_->format, nullptr, "mp4", path_.c_str());
+    if (ret < 0 || !codec_->format) {
+        error_ = "failed to create the mp4 muxer: " + av_error(ret);
+        return;
+    }
+
+    codec_->context = avcodec_alloc_context3(encoder);
+    AVCodecContext* context = codec_->context;
+    const AVRational rate = av_d2q(fps_, 100000);
+    context->width = width_;
+    context->height = height_;
+    context->pix_fmt = AV_PIX_FMT_YUV420P;
+    context->time_base = av_inv_q(rate);
+    context->framerate = rate;
+    context->thread_count = settings_.threads;
+    context->thread_type = FF_THREAD_FRAME;
+    if (codec_->format->oformat->flags & AVFMT_GLOBALHEADER) {
+        context->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    }
+    av_opt_set(context->priv_data, "preset", settings_.preset.c_str(), 0);
+    if (settings_.bitrate > 0) {
+        context->bit_rate = settings_.bitrate;
+    }
+    else {
+        av_opt_set(context->priv_data, "crf", std::to_string(settings_.crf).c_str(), 0);
+    }
+
+    ret = avcodec_open2(context, encoder, nullptr);
+    if (ret < 0) {
+        error_ = "failed to open " + settings_.codec + ": " + av_error(ret);
+        return;
+    }
+
+    codec_->stream = avformat_new_stream(codec_->format, nullptr);
+    avcodec_parameters_from_context(codec_->stream->codecpar, context);
+    codec_->stream->time_base = context->time_base;
+    codec_->stream->avg_frame_rate = rate;
+    if (encoder->id == AV_CODEC_ID_HEVC) {
+        // hvc1 is the tag Apple players insist on
+        codec_->stream->codecpar->codec_tag = MKTAG('h', 'v', 'c', '1');
+    }
+
+    ret = avio_open(&codec_->format->pb, path_.c_str(), AVIO_FLAG_WRITE);
+    if (ret >= 0) ret = avformat_write_header(codec_->format, nullptr);
+    if (ret < 0) {
+        error_ = "failed to open the output video " + path_ + ": " + av_error(ret);
+        return;
+    }
+    codec_->header_written = true;
+
+    codec_->frame = av_frame_alloc();
+    codec_->frame->format = AV_PIX_FMT_YUV420P;
+    codec_->frame->width = width_;
+    codec_->frame->height = height_;
+    codec_->packet = av_packet_alloc();
+    if (av_frame_get_buffer(codec_->frame, 32) < 0 || !codec_->packet) {
+        error_ = "failed to allocate the encoder frames";
+        return;
+    }
+
+    thread_ = std::thread([this] { run(); });
+#else
+    error_ = "built without libavcodec (NO_LIBAV), only " + std::string(MP4V) + " is available";
+#endif
+}
+
+VideoEncoder::~VideoEncoder() {
+    finish();
+}
+
+FrameSlot* VideoEncoder::acquire() {
+    if (!thread_.joinable()) return nullptr;
+    return pool_.acquire_write();
+}
+
+void VideoEncoder::submit(FrameSlot* frame) {
+    pool_.commit_write(frame);
+}
+
+void VideoEncoder::run() {
+    while (true) {
+        FrameSlot* slot = pool_.acquire_read();
+        if (!slot) break;
+
+        auto start = steady_clock::now();
+        const bool encoded = encode(slot->image.view());
+        stats_.encode_seconds += duration<double>(steady_clock::now() - start).count();
+        pool_.release_read(slot);
+
+        if (!encoded) {
+            // The reframe stage gets nullptr from acquire() and stops
+            pool_.abort();
+            break;
+        }
+        ++stats_.frames;
+    }
+}
+
+bool VideoEncoder::encode(const ImageView& image) {
+    if (settings_.codec == MP4V) {
+        codec_->writer.write(cv::Mat(image.height, image.width, CV_8UC3, image.data, image.stride));
+        return true;
+    }
+
+#ifndef NO_LIBAV
+    AVFrame* frame = codec_->frame;
+    AVCodecContext* context = codec_->context;
+    int ret = 0;
+    if (image.data) {
+        // The encoder may still hold the previous buffer with frame threading
+        ret = av_frame_make_writable(frame);
+        if (ret < 0) {
+            error_ = "failed to get an encoder frame: " + av_error(ret);
+            return false;
+        }
+
+        auto convert_start = steady_clock::now();
+        bgr_to_yuv420(image, frame->data[0], frame->linesize[0], frame->data[1], frame->linesize[1],
+                      frame->data[2], frame->linesize[2]);
+        stats_.convert_seconds += duration<double>(steady_clock::now() - convert_start).count();
+
+        frame->pts = static_cast<int64_t>(stats_.frames);
+        ret = avcodec_send_frame(context, frame);
+    }
+    else {
+        // Flush
+        ret = avcodec_send_frame(context, nullptr);
+    }
+    if (ret < 0) {
+        error_ = "encoding failed: " + av_error(ret);
+        return false;
+    }
+
+    while ((ret = avcodec_receive_packet(context, codec_->packet)) >= 0) {
+        av_packet_rescale_ts(codec_->packet, context->time_base, codec_->stream->time_base);
+        codec_->packet->stream_index = codec_->stream->index;
+        ret = av_interleaved_write_frame(codec_->format, codec_->packet);
+        if (ret < 0) {
+            error_ = "writing " + path_ + " failed: " + av_error(ret);
+            return false;
+        }
+    }
+    if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF) {
+        error_ = "encoding failed: " + av_error(ret);
+        return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool VideoEncoder::finish() {
+    if (finished_) return ok();
+    finished_ = true;
+
+    if (thread_.joinable()) {
+        pool_.close();
+        thread_.join();
+    }
+
+    if (settings_.codec == MP4V) {
+        codec_->writer.release();
+    }
+#ifndef NO_LIBAV
+    else if (codec_->header_written) {
+        auto start = steady_clock::now();
+        if (ok()) encode(ImageView());
+        av_write_trailer(codec_->format);
+        avio_closep(&codec_->format->pb);
+        stats_.encode_seconds += duration<double>(steady_clock::now() - start).count();
+    }
+#endif
+
+    std::error_code ec;
+    stats_.bytes = std::filesystem::file_size(path_, ec);
+    if (ec) stats_.bytes = 0;
+    stats_.video_seconds = stats_.frames / fps_;
+    return ok();
+}
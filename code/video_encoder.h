@@ -0,0 +1,83 @@
+#pragma once
+
+#include "frame_ring.h"
+#include "image.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+
+struct EncoderSettings {
+    // libx264 or libx265 through libavcodec, or mp4v through cv::VideoWriter (the old output).
+    // Empty -> libx264, mp4v when built without libavcodec (NO_LIBAV)
+    std::string codec;
+    std::string preset = "veryfast";
+    int crf = 23;         // quality when no bitrate is given
+    int64_t bitrate = 0;  // bits per second, 0 -> constant quality
+    int threads = 0;      // encoder frame threads, 0 -> one per hardware thread
+    size_t pool_size = 4; // frames between the reframe stage and the encoder
+};
+
+struct EncoderStats {
+    uint64_t frames = 0;
+    uint64_t bytes = 0;          // of the finished file
+    double encode_seconds = 0.0; // busy time of the encoder thread, conversion included
+    double convert_seconds = 0.0; // BGR -> YUV 4:2:0 alone
+    double video_seconds = 0.0;  // duration of the written video
+
+    double fps() const { return encode_seconds > 0.0 ? static_cast<double>(frames) / encode_seconds : 0.0; }
+    double bitrate_kbps() const { return video_seconds > 0.0 ? bytes * 8.0 / video_seconds / 1000.0 : 0.0; }
+};
+
+// BGR24 -> planar YUV 4:2:0 (BT.601, limited range), chroma averaged over every 2x2 block.
+// Width and height have to be even. The AVX2 path reads one byte past the last pixel of a row,
+// which the padding of Image covers
+void bgr_to_yuv420(const ImageView& src, uint8_t* y, int y_stride, uint8_t* u, int u_stride, uint8_t* v, int v_stride);
+
+// Encoder sink of the reframed video. Frames are taken from a small pool (a FrameRing), filled by
+// the caller in place and handed back with submit(); a dedicated thread converts them to YUV and
+// feeds a frame threaded libavcodec encoder, and the packets are muxed into an mp4 at the source fps.
+// The reframe stage only blocks when the whole pool is waiting to be encoded
+class VideoEncoder {
+public:
+    VideoEncoder(const std::string& path, int width, int height, double fps, EncoderSettings settings = EncoderSettings());
+    // Finishes the file if finish() wasn't called
+    ~VideoEncoder();
+
+    VideoEncoder(const VideoEncoder&) = delete;
+    VideoEncoder& operator=(const VideoEncoder&) = delete;
+
+    bool ok() const { return error_.empty(); }
+    const std::string& error() const { return error_; }
+    const std::string& codec() const { return settings_.codec; }
+
+    // Free frame of the pool, blocks while every frame is queued. nullptr once the encoder failed
+    FrameSlot* acquire();
+    // Queues a frame acquired with acquire(), frames are encoded in submission order
+    void submit(FrameSlot* frame);
+
+    // Encodes what is queued, flushes the encoder and closes the file
+    bool finish();
+
+    EncoderStats stats() const { return stats_; }
+
+private:
+    struct Codec;
+
+    void run();
+    bool encode(const ImageView& frame);
+
+    std::string path_;
+    int width_;
+    int height_;
+    double fps_;
+    EncoderSettings settings_;
+    std::string error_;
+
+    std::unique_ptr<Codec> codec_;
+    FrameRing pool_;
+    std::thread thread_;
+    bool finished_ = false;
+    EncoderStats stats_;
+};
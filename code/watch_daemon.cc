@@ -0,0 +1,360 @@
+#include "watch_daemon.h"
+#include "conversion_cache.h"
+#include "recording_catalog.h"
+#include "stitch_job.h"
+#include "stitch_runner.h"
+#include "stitch_telemetry.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// How often the sizes are checked while some copy is still settling, and how long the
+// watcher sleeps otherwise when no event wakes it up
+const int SETTLE_POLL_MS = 1000;
+const int IDLE_POLL_MS = 5000;
+
+volatile std::sig_atomic_t stop_signals = 0;
+
+extern "C" void handle_stop_signal(int) {
+    stop_signals = stop_signals + 1;
+}
+
+enum class QueueState { PENDING, DONE, FAILED };
+
+struct QueueEntry {
+    QueueState state = QueueState::PENDING;
+    std::string lens00;
+    std::string lens10;
+    std::string output_path;
+};
+
+const char* state_name(QueueState state) {
+    switch (state) {
+    case QueueState::DONE: return "done";
+    case QueueState::FAILED: return "failed";
+    case QueueState::PENDING: break;
+    }
+    return "pending";
+}
+
+// The persistent queue, one "state \t lens00 \t lens10 \t output" line per pair.
+// Rewritten through a temp file and renamed on every change, so a crash never leaves half of it
+class QueueFile {
+public:
+    explicit QueueFile(std::string path) : path_(std::move(path)) {}
+
+    void load() {
+        std::lock_guard<std::mutex> lck(mutex_);
+        std::ifstream file(path_);
+        std::string line;
+        while (std::getline(file, line)) {
+            std::istringstream row(line);
+            std::string state;
+            QueueEntry entry;
+            if (!std::getline(row, state, '\t') || !std::getline(row, entry.lens00, '\t') ||
+                !std::getline(row, entry.lens10, '\t') || !std::getline(row, entry.output_path)) continue;
+
+            entry.state = state == "done" ? QueueState::DONE : state == "failed" ? QueueState::FAILED : QueueState::PENDING;
+            entries_[entry.lens00] = entry;
+        }
+    }
+
+    bool contains(const std::string& lens00) {
+        std::lock_guard<std::mutex> lck(mutex_);
+        return entries_.count(lens00) > 0;
+    }
+
+    // Pending ones were queued or running when the last run stopped, failed ones get another try
+    std::vector<QueueEntry> unfinished() {
+        std::lock_guard<std::mutex> lck(mutex_);
+        std::vector<QueueEntry> result;
+        for (const auto& entry : entries_) {
+            if (entry.second.state != QueueState::DONE) result.push_back(entry.second);
+        }
+        return result;
+    }
+
+    void set(const QueueEntry& entry) {
+        std::lock_guard<std::mutex> lck(mutex_);
+        entries_[entry.lens00] = entry;
+
+        const std::string temp_path = path_ + ".tmp";
+        {
+            std::ofstream file(temp_path, std::ios::trunc);
+            for (const auto& [key, queued] : entries_) {
+                file << state_name(queued.state) << '\t' << queued.lens00 << '\t' << queued.lens10 << '\t' << queued.output_path << '\n';
+            }
+            if (!file) {
+                std::cout << "Failed to write the job queue " << temp_path << std::endl;
+                return;
+            }
+        }
+        std::error_code ec;
+        std::filesystem::rename(temp_path, path_, ec);
+    }
+
+private:
+    std::string path_;
+    std::map<std::string, QueueEntry> entries_;
+    std::mutex mutex_;
+};
+
+struct FileStamp {
+    uintmax_t size = 0;
+    std::filesystem::file_time_type mtime;
+
+    bool operator==(const FileStamp& other) const { return size == other.size && mtime == other.mtime; }
+};
+
+bool stamp_file(const std::string& path, FileStamp& stamp) {
+    std::error_code ec;
+    stamp.size = std::filesystem::file_size(path, ec);
+    if (ec) return false;
+    stamp.mtime = std::filesystem::last_write_time(path, ec);
+    return !ec;
+}
+
+// A pair that showed up but may still be copying
+struct Candidate {
+    std::string lens10;
+    FileStamp lens00_stamp;
+    FileStamp lens10_stamp;
+    std::chrono::steady_clock::time_point unchanged_since;
+};
+
+std::string queue_path(const std::string& dir) {
+    std::filesystem::path path = std::filesystem::path(dir).lexically_normal();
+    if (path.filename().empty()) path = path.parent_path();
+    path += ".queue";
+    return path.string();
+}
+
+// Every _00_/_10_ pair present in the directory, keyed by the _00_ file
+std::map<std::string, std::string> find_pairs(const std::string& dir) {
+    std::map<std::string, std::map<std::string, std::string>> lenses;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(dir, ec)) {
+        RecordingFileName name;
+        if (!parse_recording_file_name(entry.path().filename().string(), name)) continue;
+        const std::string key = name.date + "_" + name.id + "_" + std::to_string(name.number);
+        lenses[key][name.lens] = entry.path().string();
+    }
+
+    std::map<std::string, std::string> pairs;
+    for (auto& entry : lenses) {
+        auto& files = entry.second;
+        if (files.count("00") && files.count("10")) {
+            pairs[files["00"]] = files["10"];
+        }
+    }
+    return pairs;
+}
+
+} // namespace
+
+int run_watch(const WatchSettings& settings, const StitchOptions& options, const WatchOutputPath& output_path_for) {
+    std::error_code ec;
+    if (!std::filesystem::is_directory(settings.dir, ec)) {
+        std::cout << "Directory does not exist: " << settings.dir << std::endl;
+        return -1;
+    }
+
+    stop_signals = 0;
+    std::signal(SIGTERM, handle_stop_signal);
+    std::signal(SIGINT, handle_stop_signal);
+
+    QueueFile queue(queue_path(settings.dir));
+    queue.load();
+
+    const BatchSettings& batch = settings.batch;
+    // Only for the jobs still queued or running, pruned on every loop so a long lived daemon doesn't grow
+    std::map<std::string, std::unique_ptr<ConversionCache>> caches;
+    std::mutex output_mutex;
+
+    struct Submitted {
+        std::shared_ptr<StitchJob> job;
+        std::shared_ptr<std::atomic<bool>> started;
+        std::string manifest;
+    };
+    std::vector<Submitted> submitted;
+
+    StitchExecutor executor(batch.max_jobs, batch.max_hw_sessions);
+
+    auto submit = [&](QueueEntry entry) {
+        entry.state = QueueState::PENDING;
+        queue.set(entry);
+
+        const std::string name = std::filesystem::path(entry.output_path).filename().string();
+        auto started = std::make_shared<std::atomic<bool>>(false);
+
+        StitchJobSpec spec;
+        spec.input_paths = { entry.lens00, entry.lens10 };
+        spec.output_path = entry.output_path;
+        spec.options = options;
+        spec.timeout_seconds = batch.timeout_seconds;
+
+        spec.on_start = [&, name, started, inputs = spec.input_paths] {
+            *started = true;
+            if (batch.telemetry) {
+                batch.telemetry->begin_job(name, stitch_frame_count(inputs, options));
+            }
+            std::lock_guard<std::mutex> lck(output_mutex);
+            std::cout << "start stitch " << name << std::endl;
+        };
+        if (batch.telemetry) {
+            spec.on_progress = [&, name](int progress) { batch.telemetry->progress(name, progress); };
+        }
+        spec.on_finished = [&, name, entry](StitchResult& result) {
+            if (batch.telemetry) {
+                batch.telemetry->end_job(name, result);
+            }
+
+            // Jobs cancelled by the drain stay pending for the next start
+            if (!(result.error == STITCH_CANCELLED && stop_signals > 0)) {
+                QueueEntry finished = entry;
+                finished.state = result.ok ? QueueState::DONE : QueueState::FAILED;
+                queue.set(finished);
+            }
+
+            std::lock_guard<std::mutex> lck(output_mutex);
+            if (result.ok) {
+                std::cout << "end stitch " << name << std::endl;
+            }
+            else {
+                std::cout << "error stitching " << name << ": " << result.error_info << std::endl;
+            }
+        };
+
+        const std::string manifest = default_manifest_path(entry.output_path);
+        if (!caches.count(manifest)) {
+            caches[manifest] = std::make_unique<ConversionCache>(manifest);
+        }
+        submitted.push_back({ submit_stitch_cached(executor, *caches[manifest], std::move(spec), batch.force), started, manifest });
+    };
+
+    // A finished job no longer touches its cache, on_finished runs before done()
+    auto prune_finished = [&] {
+        submitted.erase(std::remove_if(submitted.begin(), submitted.end(), [](const Submitted& entry) { return entry.job->done(); }),
+                        submitted.end());
+        for (auto it = caches.begin(); it != caches.end();) {
+            const bool used = std::any_of(submitted.begin(), submitted.end(), [&](const Submitted& entry) { return entry.manifest == it->first; });
+            it = used ? std::next(it) : caches.erase(it);
+        }
+    };
+
+    // Whatever the last run didn't finish goes first
+    for (const auto& entry : queue.unfinished()) {
+        std::cout << "Resuming " << entry.lens00 << std::endl;
+        submit(entry);
+    }
+
+#ifdef __linux__
+    const int inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    // No IN_MODIFY: a copy in progress would wake the loop on every write, the settle poll
+    // already checks the sizes of the pairs that are still changing
+    if (inotify_fd < 0 || inotify_add_watch(inotify_fd, settings.dir.c_str(),
+                                            IN_CREATE | IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE) < 0) {
+        std::cout << "inotify is not available, falling back to scanning " << settings.dir << std::endl;
+    }
+#endif
+
+    std::cout << "Watching " << settings.dir << ", pairs are queued once their files stop changing for "
+              << settings.settle_seconds << " s" << std::endl;
+
+    std::map<std::string, Candidate> candidates;
+    while (stop_signals == 0) {
+        prune_finished();
+
+        // The directory is listed again on every wake up instead of trusting the event names,
+        // so a dropped event (queue overflow) can't lose a pair
+        const auto now = std::chrono::steady_clock::now();
+        const std::map<std::string, std::string> pairs = find_pairs(settings.dir);
+
+        for (auto it = candidates.begin(); it != candidates.end();) {
+            it = pairs.count(it->first) ? std::next(it) : candidates.erase(it);
+        }
+
+        for (const auto& [lens00, lens10] : pairs) {
+            if (queue.contains(lens00)) continue;
+
+            Candidate current;
+            current.lens10 = lens10;
+            if (!stamp_file(lens00, current.lens00_stamp) || !stamp_file(lens10, current.lens10_stamp)) continue;
+
+            auto it = candidates.find(lens00);
+            if (it == candidates.end() || !(it->second.lens00_stamp == current.lens00_stamp) ||
+                !(it->second.lens10_stamp == current.lens10_stamp)) {
+                current.unchanged_since = now;
+                candidates[lens00] = current;
+                continue;
+            }
+
+            if (std::chrono::duration<double>(now - it->second.unchanged_since).count() >= settings.settle_seconds) {
+                QueueEntry entry;
+                entry.lens00 = lens00;
+                entry.lens10 = lens10;
+                entry.output_path = output_path_for(lens00);
+                {
+                    std::lock_guard<std::mutex> lck(output_mutex);
+                    std::cout << "Queued " << std::filesystem::path(lens00).filename().string() << std::endl;
+                }
+                submit(entry);
+                candidates.erase(it);
+            }
+        }
+
+        const int timeout_ms = candidates.empty() ? IDLE_POLL_MS : SETTLE_POLL_MS;
+#ifdef __linux__
+        if (inotify_fd >= 0) {
+            pollfd fd = { inotify_fd, POLLIN, 0 };
+            if (poll(&fd, 1, timeout_ms) > 0) {
+                // Only the wake up matters, drain the events
+                char buffer[4096];
+                while (read(inotify_fd, buffer, sizeof(buffer)) > 0) {}
+            }
+            continue;
+        }
+#endif
+        std::this_thread::sleep_for(std::chrono::milliseconds(timeout_ms));
+    }
+
+#ifdef __linux__
+    if (inotify_fd >= 0) {
+        close(inotify_fd);
+    }
+#endif
+
+    // Drain: queued jobs stay pending in the queue file, running ones are allowed to finish
+    std::cout << std::endl << "Stopping, waiting for the running stitches. Send the signal again to cancel them" << std::endl;
+    for (const auto& entry : submitted) {
+        if (!*entry.started) entry.job->cancel();
+    }
+    for (const auto& entry : submitted) {
+        while (!entry.job->wait_for(0.5)) {
+            if (stop_signals > 1) entry.job->cancel();
+        }
+    }
+
+    std::signal(SIGTERM, SIG_DFL);
+    std::signal(SIGINT, SIG_DFL);
+    return 0;
+}
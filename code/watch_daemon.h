@@ -0,0 +1,25 @@
+#pragma once
+
+#include "batch.h"
+#include "stitch_options.h"
+
+#include <functional>
+#include <string>
+
+struct WatchSettings {
+    std::string dir;              // directory the lens files are copied into
+    double settle_seconds = 10.0; // a lens file whose size and mtime didn't change for this long is fully copied
+    BatchSettings batch;          // jobs, hardware sessions, force, timeout and telemetry of the stitches
+};
+
+// Where the stitched output of the pair starting with this _00_ file goes
+using WatchOutputPath = std::function<std::string(const std::string& lens00_path)>;
+
+// Long running mode: watches the directory (inotify on Linux, a periodic scan elsewhere) and queues
+// every _00_/_10_ pair as soon as both files stopped changing, so the first recordings are stitched
+// while the rest of the card is still being copied.
+//
+// The queue is kept in <dir>.queue. Pairs still pending or running when the process stops are queued
+// again on the next start, finished ones are never stitched twice. SIGTERM/SIGINT drain: no new job
+// starts, the running ones finish and the converter exits; a second signal cancels them too
+int run_watch(const WatchSettings& settings, const StitchOptions& options, const WatchOutputPath& output_path_for);